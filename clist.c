@@ -9,296 +9,519 @@
 #include "clist.h"
 
 #include <assert.h>
-#include <stdio.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "clist_impl.h"
+
+#ifndef NDEBUG
 #define DEBUG
+#endif  // NDEBUG
 
-struct _cl_node {
-    CListElementType element;
-    struct _cl_node *next;
-};
+static const struct _cl_ops _CL_linked_ops;
 
-struct _clist {
-    struct _cl_node *head;
-    int length;
-};
+// Links between CL_LINKED nodes at most this many bytes apart count as
+// local for CL_fragmentation
+#define CL_FRAG_NEAR 256
+
+// Auto compaction never runs on lists shorter than this
+#define CL_AUTO_COMPACT_MIN 64
+
+// How many nodes ahead of a walk over a CL_LINKED list to prefetch;
+// see CL_set_prefetch_distance
+static atomic_int _CL_prefetch_distance = CL_PREFETCH_DEFAULT_DISTANCE;
+
+// Documented in .h file
+void CL_set_prefetch_distance(int distance) {
+    assert(distance >= 0);
+    atomic_store(&_CL_prefetch_distance, distance);
+}
+
+/*
+ * Start a scout for a walk beginning at node: a pointer that runs the
+ * prefetch distance ahead of the walk, so that the nodes the walk is
+ * about to visit are already on their way into the cache.
+ *
+ * Returns: The scout, or NULL if prefetching is off or the list is
+ *   shorter than the distance
+ */
+static inline struct _cl_node *_CL_scout_start(struct _cl_node *node) {
+    const int distance = atomic_load_explicit(&_CL_prefetch_distance, memory_order_relaxed);
+    if (distance == 0) return NULL;
+    for (int i = 0; i < distance && node; i++) {
+        __builtin_prefetch(node);
+        node = node->next;
+    }
+    return node;
+}
+
+/*
+ * Advance a scout by one node, prefetching that node, and the string
+ * of the node it leaves if the walk will read the strings
+ *
+ * Returns: The new scout
+ */
+static inline struct _cl_node *_CL_scout_step(struct _cl_node *scout, bool strings) {
+    if (scout == NULL) return NULL;
+    if (strings) __builtin_prefetch(scout->element);
+    scout = scout->next;
+    if (scout) __builtin_prefetch(scout);
+    return scout;
+}
+
+// Documented in clist_impl.h
+void *_CL_alloc(CList list, size_t size) {
+    void *ptr = list->alloc_fn ? list->alloc_fn(list->alloc_ctx, size) : malloc(size);
+    assert(ptr);
+    return ptr;
+}
+
+// Documented in clist_impl.h
+void _CL_dealloc(CList list, void *ptr, size_t size) {
+    if (list->alloc_fn == NULL) {
+        free(ptr);
+    } else if (list->free_fn) {
+        list->free_fn(list->alloc_ctx, ptr, size);
+    }
+}
+
+// Documented in clist_impl.h
+void *_CL_node_alloc(CList list) {
+    struct _cl_free_node *node = list->cache;
+    if (node) {
+        list->cache = node->next;
+        list->cache_count--;
+        list->cache_hits++;
+        return node;
+    }
+
+    list->cache_misses++;
+    // Magazines only hold malloc'd blocks, so custom allocators bypass them
+    if (list->alloc_fn == NULL) {
+        node = (struct _cl_free_node *)_CL_mag_alloc(list->node_size);
+        if (node) return node;
+    }
+    return _CL_alloc(list, list->node_size);
+}
+
+// Documented in clist_impl.h
+void _CL_node_recycle(CList list, void *node) {
+    if (list->cache_count >= list->cache_limit) {
+        _CL_node_release(list, node);
+        return;
+    }
+
+    struct _cl_free_node *free_node = (struct _cl_free_node *)node;
+    free_node->next = list->cache;
+    list->cache = free_node;
+    list->cache_count++;
+    if (list->cache_count > list->cache_high_water) list->cache_high_water = list->cache_count;
+}
+
+/*
+ * Release the list's reference to its block, freeing the block's
+ * bookkeeping once no list refers to it. All of the list's nodes from
+ * the block must have been released.
+ */
+static void _CL_block_drop(CList list) {
+    struct _cl_block *block = list->block;
+    if (block == NULL) return;
+    list->block = NULL;
+    if (--block->refs == 0) {
+        assert(block->live == 0);
+        _CL_dealloc(list, block, sizeof(*block));
+    }
+}
+
+// Documented in clist_impl.h
+struct _cl_block *_CL_block_new(CList list, size_t count) {
+    struct _cl_block *block = (struct _cl_block *)_CL_alloc(list, sizeof(*block));
+    block->size = count * list->node_size;
+    block->base = (char *)_CL_alloc(list, block->size);
+    block->live = count;
+    block->refs = 0;
+    return block;
+}
+
+// Documented in clist_impl.h
+void _CL_block_install(CList list, struct _cl_block *block) {
+    _CL_block_drop(list);
+    list->block = block;
+    block->refs++;
+}
+
+// Documented in clist_impl.h
+void _CL_node_release(CList list, void *node) {
+    struct _cl_block *block = list->block;
+    if (block && (char *)node >= block->base && (char *)node < block->base + block->size) {
+        if (--block->live == 0) {
+            _CL_dealloc(list, block->base, block->size);
+            block->base = NULL;
+            block->size = 0;
+        }
+        return;
+    }
+
+    if (list->alloc_fn == NULL && _CL_mag_free(node, list->node_size)) return;
+    _CL_dealloc(list, node, list->node_size);
+}
 
 /*
- * Create (malloc) a new _cl_node and populate it with the supplied
- * values
+ * Create a new _cl_node and populate it with the supplied values
  *
  * Parameters:
+ *   list           the list the node will belong to
  *   element, next  the values for the node to be created
  *
- * Returns: The newly-malloc'd node, or NULL in case of error
+ * Returns: The new node
  */
-static struct _cl_node *_CL_new_node(CListElementType element, struct _cl_node *next) {
-    struct _cl_node *new = (struct _cl_node *)malloc(sizeof(struct _cl_node));
+static struct _cl_node *_CL_new_node(CList list, CListElementType element,
+                                     struct _cl_node *next) {
+    struct _cl_node *new = (struct _cl_node *)_CL_node_alloc(list);
 
     assert(new);
 
     new->element = element;
     new->next = next;
+    if (list->keyed) ((struct _cl_knode *)new)->key = _CL_key_make(element);
+    if (list->sso) {
+        struct _cl_snode *snode = (struct _cl_snode *)new;
+        const size_t len = strnlen(element, CL_INLINE_CAP);
+        if (len < CL_INLINE_CAP) {
+            memcpy(snode->buf, element, len + 1);
+            new->element = snode->buf;
+        }
+    }
 
     return new;
 }
 
-// Documented in .h file
-CList CL_new() {
-    CList list = (CList)malloc(sizeof(struct _clist));
-    assert(list);
+/*
+ * Return the element of a node that is being removed from list, in a
+ * form that outlives the node: a string stored inside the node is
+ * copied to the list's arena, where CL_compact_strings can reclaim it.
+ */
+static CListElementType _CL_node_take(CList list, struct _cl_node *node) {
+    if (list->sso && node->element == ((struct _cl_snode *)node)->buf) {
+        list->arena.dead += strlen(node->element) + 1;
+        return _CL_arena_adopt(node->element, list);
+    }
+    return node->element;
+}
 
-    list->head = NULL;
-    list->length = 0;
+/*
+ * Move the elements of a CL_LINKED list out of its small array into
+ * nodes. Does nothing if the list already uses nodes or is empty.
+ */
+static void _CL_linked_spill(CList list) {
+    if (list->head) return;
 
-    return list;
+    struct _cl_node **tail = &list->head;
+    for (int i = 0; i < list->length; i++) {
+        *tail = _CL_new_node(list, list->small[i], NULL);
+        tail = &(*tail)->next;
+    }
 }
 
-// Documented in .h file
-void CL_free(CList list) {
-    // free the members of the list
+/*
+ * Free the nodes of a CL_LINKED list
+ */
+static void _CL_linked_destroy(CList list) {
     struct _cl_node *iter = list->head;
+    struct _cl_node *scout = _CL_scout_start(iter);
     while (iter) {
         struct _cl_node *temp = iter;
         iter = iter->next;
-        free(temp);
+        scout = _CL_scout_step(scout, false);
+        _CL_node_release(list, temp);
     }
-    // free the list itself
-    free(list);
+    list->head = NULL;
+    _CL_finger_drop(list);
 }
 
-// Documented in .h file
-int CL_length(CList list) {
-    assert(list);
-#ifdef DEBUG
-    // In production code, we simply return the stored value for
-    // length. However, as a defensive programming method to prevent
-    // bugs in our code, in DEBUG mode we walk the list and ensure the
-    // number of elements on the list is equal to the stored length.
+/*
+ * Return whether a link from node to next leaves the neighbourhood of
+ * node, for CL_fragmentation
+ */
+static inline bool _CL_scattered(const struct _cl_node *node, const struct _cl_node *next) {
+    const char *a = (const char *)node;
+    const char *b = (const char *)next;
+    return (a < b ? b - a : a - b) > CL_FRAG_NEAR;
+}
+
+/*
+ * Count the nodes of a CL_LINKED list by walking it
+ */
+static int _CL_linked_count(CList list) {
+    if (list->head == NULL) {
+        assert(list->length <= CL_SMALL_CAP);
+        return list->length;
+    }
 
     int len = 0;
     for (struct _cl_node *node = list->head; node != NULL; node = node->next) len++;
-
-    assert(len == list->length);
-#endif  // DEBUG
-
-    return list->length;
+    return len;
 }
 
-// Documented in .h file
-void CL_print(CList list) {
-    assert(list);
-    int num = 0;
-    for (struct _cl_node *node = list->head; node != NULL; node = node->next)
-        printf("  [%d]: %s\n", num++, node->element);
-}
+static CListElementType _CL_linked_nth(CList list, int pos) {
+    if (list->head == NULL) return list->small[pos];
 
-// Documented in .h file
-void CL_push(CList list, CListElementType element) {
-    assert(list);
-    list->head = _CL_new_node(element, list->head);
-    list->length++;
+    struct _cl_node *iter = list->head;
+    struct _cl_node *scout = pos > 0 ? _CL_scout_start(iter) : NULL;
+    for (int current_position = 0; current_position < pos; current_position++) {
+        iter = iter->next;
+        scout = _CL_scout_step(scout, false);
+    }
+    return iter->element;
 }
 
-// Documented in .h file
-CListElementType CL_pop(CList list) {
-    assert(list);
-    struct _cl_node *node = list->head;
-    if (node == NULL) {
-        return INVALID_RETURN;
+static void _CL_linked_insert(CList list, CListElementType element, int pos) {
+    _CL_finger_drop(list);
+    if (list->head == NULL) {
+        // The small array only holds pointers, which an inline list
+        // cannot use for its short strings
+        if (list->length < CL_SMALL_CAP && !list->sso) {
+            memmove(&list->small[pos + 1], &list->small[pos],
+                    (list->length - pos) * sizeof(CListElementType));
+            list->small[pos] = element;
+            list->length++;
+            return;
+        }
+        _CL_linked_spill(list);
     }
-    CListElementType element = node->element;
-    list->head = node->next;
-    free(node);
-    list->length--;
-    return element;
-}
 
-// Documented in .h file
-void CL_append(CList list, CListElementType element) {
-    assert(list);
-    struct _cl_node *new_node = _CL_new_node(element, NULL);
+    struct _cl_node *new_node = _CL_new_node(list, element, NULL);
     assert(new_node);
-
-    // If the list is empty we just update the head, else we find the end and then update the
-    // last pointer
-    if (list->head == NULL) {
+    if (pos == 0) {
+        new_node->next = list->head;
         list->head = new_node;
     } else {
         struct _cl_node *iter = list->head;
-        while (iter->next) {
+        int current_position = 0;
+        while (current_position < pos - 1) {
             iter = iter->next;
+            current_position++;
         }
+        new_node->next = iter->next;
         iter->next = new_node;
     }
     list->length++;
 }
 
-// Documented in .h file
-CListElementType CL_nth(CList list, int pos) {
-    assert(list);
-    // Handling the case of an empty list
+static CListElementType _CL_linked_remove(CList list, int pos) {
+    CListElementType to_return;
+    _CL_finger_drop(list);
+
     if (list->head == NULL) {
-        return INVALID_RETURN;
-    }
-    const int len = CL_length(list);
-    if (pos >= -len && pos <= len - 1) {
+        to_return = list->small[pos];
+        memmove(&list->small[pos], &list->small[pos + 1],
+                (list->length - pos - 1) * sizeof(CListElementType));
+    } else if (pos == 0) {
+        // Handle the case when we are removing the head item
+        struct _cl_node *temp = list->head;
+        list->head = list->head->next;
+        to_return = _CL_node_take(list, temp);
+        _CL_node_recycle(list, temp);
+    } else {
         struct _cl_node *iter = list->head;
-        const int standard_pos = (pos < 0) ? pos + len : pos;
         int current_position = 0;
-        while (current_position < standard_pos) {
-            if (iter == NULL) return INVALID_RETURN;
+        while (current_position < pos - 1) {
             iter = iter->next;
             current_position++;
         }
-        return iter->element;
+        struct _cl_node *temp = iter->next;
+        iter->next = temp->next;
+        to_return = _CL_node_take(list, temp);
+        _CL_node_recycle(list, temp);
     }
-    return INVALID_RETURN;
+
+    list->length--;
+    return to_return;
 }
 
-// Documented in .h file
-bool CL_insert(CList list, CListElementType element, int pos) {
-    assert(list);
-    // Handle the case where the list is empty
-    if (list->head == NULL && pos != 0 && pos != -1) {
-        return false;
-    }
+static CList _CL_linked_copy(CList list) {
+    CList list_copy = _CL_new_like(list);
 
-    const int len = CL_length(list);
+    if (list->head == NULL) {
+        memcpy(list_copy->small, list->small, list->length * sizeof(CListElementType));
+        list_copy->length = list->length;
+        return list_copy;
+    }
 
-    if (pos < -(len + 1) || pos > len) {
-        return false;
-    } else {
-        const int standard_pos = (pos < 0) ? pos + len + 1 : pos;
-        struct _cl_node *new_node = _CL_new_node(element, NULL);
-        assert(new_node);
-        if (standard_pos == 0) {
-            new_node->next = list->head;
-            list->head = new_node;
-        } else {
-            struct _cl_node *iter = list->head;
-            int current_position = 0;
-            while (current_position < standard_pos - 1) {
-                iter = iter->next;
-                current_position++;
-            }
-            new_node->next = iter->next;
-            iter->next = new_node;
-        }
-        list->length++;
+    // Keep a pointer to the last next field so each element is appended in O(1)
+    // Keyed and inline nodes read their string when they are created
+    const bool strings = list->keyed || list->sso;
+    struct _cl_node **tail = &list_copy->head;
+    struct _cl_node *scout = _CL_scout_start(list->head);
+    for (struct _cl_node *iter = list->head; iter != NULL; iter = iter->next) {
+        scout = _CL_scout_step(scout, strings);
+        *tail = _CL_new_node(list_copy, iter->element, NULL);
+        tail = &(*tail)->next;
     }
-    return true;
-}
+    list_copy->length = list->length;
 
-// Documented in .h file
-CListElementType CL_remove(CList list, int pos) {
-    assert(list);
+    return list_copy;
+}
 
-    // Handle the case where the list is empty
+static int _CL_linked_insert_sorted(CList list, CListElementType element) {
     if (list->head == NULL) {
-        return INVALID_RETURN;
+        int index = 0;
+        while (index < list->length && strcmp(list->small[index], element) < 0) index++;
+        _CL_linked_insert(list, element, index);
+        return index;
     }
 
-    const int len = CL_length(list);
-
-    if (pos < -len || pos > len - 1) {
-        return INVALID_RETURN;
+    // Start after the node the last insertion went after if it is
+    // still before element, so that input arriving in order takes a
+    // step or two per insertion instead of a walk from the head
+    const struct _cl_key key = list->keyed ? _CL_key_make(element) : (struct _cl_key){0, 0};
+    struct _cl_node *prev = list->finger;
+    int index = 0;
+    if (prev != NULL &&
+        (list->keyed ? _CL_key_cmp(&((struct _cl_knode *)prev)->key, prev->element, &key, element)
+                     : strcmp(prev->element, element)) < 0) {
+        index = list->finger_pos + 1;
     } else {
-        const int standard_pos = (pos < 0) ? pos + len : pos;
-        CListElementType to_return;
+        prev = NULL;
+    }
+    struct _cl_node *iter = prev ? prev->next : list->head;
+    struct _cl_node *scout = _CL_scout_start(iter);
 
-        // Handle the case when we are removing the head item
-        if (standard_pos == 0) {
-            struct _cl_node *temp = list->head;
-            list->head = list->head->next;
-            to_return = temp->element;
-            free(temp);
-        } else {
-            struct _cl_node *iter = list->head;
-            int current_position = 0;
-            while (current_position < standard_pos - 1) {
-                iter = iter->next;
-                current_position++;
-            }
-            struct _cl_node *temp = iter->next;
-            iter->next = temp->next;
-            to_return = temp->element;
-            free(temp);
+    if (list->keyed) {
+        while (iter != NULL &&
+               _CL_key_cmp(&((struct _cl_knode *)iter)->key, iter->element, &key, element) < 0) {
+            prev = iter;
+            iter = iter->next;
+            scout = _CL_scout_step(scout, false);
+            index++;
+        }
+    } else {
+        while (iter != NULL && (strcmp(iter->element, element) < 0)) {
+            prev = iter;
+            iter = iter->next;
+            scout = _CL_scout_step(scout, true);
+            index++;
         }
+    }
 
-        list->length--;
-        return to_return;
+    struct _cl_node *new_node = _CL_new_node(list, element, iter);
+
+    if (prev == NULL) {
+        // Inserting at the beginning of the list
+        list->head = new_node;
+    } else {
+        // Inserting in the middle or at the end of the list
+        prev->next = new_node;
     }
 
-    return INVALID_RETURN;
+    list->length++;
+    list->finger = prev;
+    list->finger_pos = index - 1;
+    return index;
 }
 
-// Documented in .h file
-CList CL_copy(CList list) {
-    assert(list);
+static void _CL_linked_join(CList list1, CList list2) {
+    if (list1->head == NULL && list2->head == NULL &&
+        list1->length + list2->length <= CL_SMALL_CAP) {
+        memcpy(&list1->small[list1->length], list2->small,
+               list2->length * sizeof(CListElementType));
+        list1->length += list2->length;
+        list2->length = 0;
+        return;
+    }
 
-    CList list_copy = CL_new();
+    _CL_finger_drop(list1);
+    _CL_finger_drop(list2);
 
-    struct _cl_node *iter = list->head;
+    // Small lists have no chain to relink; give them one
+    _CL_linked_spill(list1);
+    _CL_linked_spill(list2);
 
-    while (iter) {
-        CL_append(list_copy, iter->element);
-        iter = iter->next;
-    }
+    // Find the last next field of list1 and hang list2's chain off it
+    struct _cl_node **link = &list1->head;
+    while (*link) link = &(*link)->next;
+    *link = list2->head;
 
-    return list_copy;
+    list1->length += list2->length;
+    list2->head = NULL;
+    list2->length = 0;
 }
 
-// Documented in .h file
-int CL_insert_sorted(CList list, CListElementType element) {
-    assert(list);
+static CList _CL_linked_split(CList list, int pos) {
+    CList tail = _CL_new_like(list);
+    _CL_finger_drop(list);
 
-    /* Handle the case where the list is empty */
-    if (list->length == 0) {
-        CL_append(list, element);
-        return 0;
-    } else { /* If the list is not empty */
+    if (list->head == NULL) {
+        memcpy(tail->small, &list->small[pos], (list->length - pos) * sizeof(CListElementType));
+        tail->length = list->length - pos;
+        list->length = pos;
+        return tail;
+    }
 
-        struct _cl_node *iter = list->head;
-        struct _cl_node *prev = NULL;
-        int index = 0;
+    struct _cl_node **link = &list->head;
+    for (int current_position = 0; current_position < pos; current_position++) {
+        link = &(*link)->next;
+    }
+    tail->head = *link;
+    *link = NULL;
 
-        while (iter != NULL && (strcmp(iter->element, element) < 0)) {
-            prev = iter;
-            iter = iter->next;
-            index++;
-        }
+    tail->length = list->length - pos;
+    list->length = pos;
+    return tail;
+}
 
-        struct _cl_node *new_node = _CL_new_node(element, iter);
+static void _CL_linked_splice(CList dest, int dest_pos, CList src, int start, int end) {
+    if (start == end) return;
+    _CL_finger_drop(dest);
+    _CL_finger_drop(src);
 
-        if (prev == NULL) {
-            // Inserting at the beginning of the list
-            list->head = new_node;
-        } else {
-            // Inserting in the middle or at the end of the list
-            prev->next = new_node;
+    if (src->head == NULL) {
+        // A small src has no chain to move; copy its few elements over
+        for (int i = start; i < end; i++) {
+            _CL_linked_insert(dest, src->small[i], dest_pos + i - start);
         }
-
-        list->length++;
-        return index;
+        memmove(&src->small[start], &src->small[end],
+                (src->length - end) * sizeof(CListElementType));
+        src->length -= end - start;
+        return;
     }
-}
+    _CL_linked_spill(dest);
 
-// Documented in .h file
-void CL_join(CList list1, CList list2) {
-    assert(list1);
-    assert(list2);
+    // Unlink the chain first..last from src
+    struct _cl_node **link = &src->head;
+    for (int current_position = 0; current_position < start; current_position++) {
+        link = &(*link)->next;
+    }
+    struct _cl_node *first = *link;
+    struct _cl_node *last = first;
+    for (int current_position = start; current_position < end - 1; current_position++) {
+        last = last->next;
+    }
+    *link = last->next;
 
-    while (list2->length) {
-        CL_append(list1, CL_pop(list2));
+    // Link it back in before dest_pos
+    link = &dest->head;
+    for (int current_position = 0; current_position < dest_pos; current_position++) {
+        link = &(*link)->next;
     }
+    last->next = *link;
+    *link = first;
+
+    src->length -= end - start;
+    dest->length += end - start;
 }
 
-// Documented in .h file
-void CL_reverse(CList list) {
-    assert(list);
+static void _CL_linked_reverse(CList list) {
+    _CL_finger_drop(list);
+    if (list->head == NULL) {
+        for (int i = 0, j = list->length - 1; i < j; i++, j--) {
+            CListElementType temp = list->small[i];
+            list->small[i] = list->small[j];
+            list->small[j] = temp;
+        }
+        return;
+    }
 
     // We use two pointers that sweep across
     struct _cl_node *current = list->head;
@@ -317,16 +540,1152 @@ void CL_reverse(CList list) {
     list->head = prev;
 }
 
-// Documented in .h file
-void CL_foreach(CList list, CL_foreach_callback callback, void *cb_data) {
-    assert(list);
+static void _CL_linked_foreach(CList list, CL_foreach_callback callback, void *cb_data) {
+    if (list->head == NULL) {
+        for (int pos = 0; pos < list->length; pos++) callback(pos, list->small[pos], cb_data);
+        return;
+    }
 
     int pos = 0;
     struct _cl_node *iter = list->head;
+    struct _cl_node *scout = _CL_scout_start(iter);
+    // With auto compaction on, the walk measures fragmentation as it goes
+    const bool measure = list->compact_threshold > 0;
+    int scattered = 0;
 
+    // Callbacks such as CL_print's read the strings
     while (iter != NULL) {
+        scout = _CL_scout_step(scout, true);
         callback(pos, iter->element, cb_data);
+        if (measure && iter->next && _CL_scattered(iter, iter->next)) scattered++;
         iter = iter->next;
         pos++;
     }
+
+    if (measure && list->length >= CL_AUTO_COMPACT_MIN &&
+        scattered > list->compact_threshold * (list->length - 1)) {
+        CL_compact(list);
+    }
+}
+
+static void _CL_linked_map(CList list, _CL_map_fn fn, void *data) {
+    // fn returns equal strings, so cached keys stay valid, and strings
+    // stored in nodes need not move
+    if (list->head == NULL) {
+        for (int pos = 0; pos < list->length; pos++) list->small[pos] = fn(list->small[pos], data);
+        return;
+    }
+
+    for (struct _cl_node *iter = list->head; iter != NULL; iter = iter->next) {
+        if (list->sso && iter->element == ((struct _cl_snode *)iter)->buf) continue;
+        iter->element = fn(iter->element, data);
+    }
+}
+
+static int _CL_linked_find(CList list, CListElementType key, bool count) {
+    int matches = 0;
+
+    if (list->head == NULL) {
+        for (int pos = 0; pos < list->length; pos++) {
+            if (strcmp(list->small[pos], key) == 0) {
+                if (!count) return pos;
+                matches++;
+            }
+        }
+        return count ? matches : -1;
+    }
+
+    // Keyed nodes settle most elements on their cached prefix
+    const struct _cl_key k = list->keyed ? _CL_key_make(key) : (struct _cl_key){0, 0};
+    int pos = 0;
+    struct _cl_node *scout = _CL_scout_start(list->head);
+    for (struct _cl_node *iter = list->head; iter != NULL; iter = iter->next, pos++) {
+        scout = _CL_scout_step(scout, !list->keyed);
+        const int cmp = list->keyed
+                            ? _CL_key_cmp(&((struct _cl_knode *)iter)->key, iter->element, &k, key)
+                            : strcmp(iter->element, key);
+        if (cmp == 0) {
+            if (!count) return pos;
+            matches++;
+        }
+    }
+    return count ? matches : -1;
+}
+
+static void _CL_linked_compact(CList list) {
+    // A list in its small array has no nodes
+    if (list->head == NULL) return;
+    _CL_finger_drop(list);
+
+    struct _cl_block *block = _CL_block_new(list, list->length);
+    char *slot = block->base;
+    struct _cl_node **link = &list->head;
+    struct _cl_node *iter = list->head;
+    while (iter) {
+        struct _cl_node *new = (struct _cl_node *)slot;
+        memcpy(new, iter, list->node_size);
+        // A string stored in the node moves with it
+        if (list->sso && iter->element == ((struct _cl_snode *)iter)->buf) {
+            new->element = ((struct _cl_snode *)new)->buf;
+        }
+        *link = new;
+        link = &new->next;
+
+        struct _cl_node *next = iter->next;
+        _CL_node_release(list, iter);
+        iter = next;
+        slot += list->node_size;
+    }
+    _CL_block_install(list, block);
+}
+
+static void _CL_linked_move(CList list, int from, int to) {
+    _CL_finger_drop(list);
+    if (list->head == NULL) {
+        CListElementType element = list->small[from];
+        if (from < to) {
+            memmove(&list->small[from], &list->small[from + 1], (to - from) * sizeof(element));
+        } else {
+            memmove(&list->small[to + 1], &list->small[to], (from - to) * sizeof(element));
+        }
+        list->small[to] = element;
+        return;
+    }
+
+    struct _cl_node **link = &list->head;
+    for (int i = 0; i < from; i++) link = &(*link)->next;
+    struct _cl_node *node = *link;
+    *link = node->next;
+
+    link = &list->head;
+    for (int i = 0; i < to; i++) link = &(*link)->next;
+    node->next = *link;
+    *link = node;
+}
+
+static const struct _cl_ops _CL_linked_ops = {
+    .destroy = _CL_linked_destroy,
+    .count = _CL_linked_count,
+    .nth = _CL_linked_nth,
+    .insert = _CL_linked_insert,
+    .remove = _CL_linked_remove,
+    .copy = _CL_linked_copy,
+    .insert_sorted = _CL_linked_insert_sorted,
+    .join = _CL_linked_join,
+    .split = _CL_linked_split,
+    .splice = _CL_linked_splice,
+    .reverse = _CL_linked_reverse,
+    .foreach = _CL_linked_foreach,
+    .map = _CL_linked_map,
+    .find = _CL_linked_find,
+    .compact = _CL_linked_compact,
+    .move = _CL_linked_move,
+};
+
+// Documented in .h file
+CList CL_new() {
+    return CL_new_backend(CL_LINKED);
+}
+
+/*
+ * Create a new, empty list
+ *
+ * Parameters:
+ *   backend              The storage backend
+ *   alloc_fn, free_fn,   The allocator for the list and its nodes, or
+ *   ctx                  NULL alloc_fn to use malloc
+ *
+ * Returns: The new list
+ */
+static CList _CL_create(CListBackend backend, CL_alloc_fn alloc_fn, CL_free_fn free_fn,
+                        void *ctx) {
+    CList list = (CList)(alloc_fn ? alloc_fn(ctx, sizeof(struct _clist))
+                                  : malloc(sizeof(struct _clist)));
+    assert(list);
+
+    list->alloc_fn = alloc_fn;
+    list->free_fn = free_fn;
+    list->alloc_ctx = ctx;
+
+    list->backend = backend;
+    list->head = NULL;
+    list->root = NULL;
+    list->seed = 0x9e3779b9u;
+    list->heap = NULL;
+    list->ring = NULL;
+    list->ring_cap = 0;
+    list->ring_start = 0;
+    list->ring_keys = NULL;
+    list->ring_keys_valid = false;
+    list->slab = NULL;
+    list->slab_cap = 0;
+    list->slab_used = 0;
+    list->slab_free = CL_NIL;
+    list->chead = CL_NIL;
+    list->dhead = NULL;
+    list->dtail = NULL;
+    memset(&list->arena, 0, sizeof(list->arena));
+    list->owning = false;
+    list->keyed = false;
+    list->sso = false;
+    list->retired = NULL;
+    list->retired_count = 0;
+    list->retired_cap = 0;
+    list->journal = NULL;
+    list->feed = NULL;
+    list->counts = NULL;
+    list->finger = NULL;
+    list->finger_pos = 0;
+    list->filter = NULL;
+    list->block = NULL;
+    list->compact_threshold = 0;
+    list->view = NULL;
+    list->view_cap = 0;
+    list->view_start = 0;
+    list->frozen = false;
+    list->view_valid = false;
+    list->length = 0;
+
+    list->cache = NULL;
+    list->cache_count = 0;
+    list->cache_limit = CL_CACHE_DEFAULT_LIMIT;
+    list->cache_high_water = 0;
+    list->cache_hits = 0;
+    list->cache_misses = 0;
+
+    switch (backend) {
+        case CL_LINKED:
+            list->ops = &_CL_linked_ops;
+            list->node_size = sizeof(struct _cl_node);
+            break;
+        case CL_TREE:
+            list->ops = &_CL_tree_ops;
+            list->node_size = sizeof(struct _cl_tnode);
+            break;
+        case CL_PRIORITY:
+            list->ops = &_CL_heap_ops;
+            list->node_size = sizeof(struct _cl_hnode);
+            break;
+        case CL_COMPACT:
+            // Nodes live in the list's slab; the node cache is never used
+            list->ops = &_CL_compact_ops;
+            list->node_size = 0;
+            break;
+        case CL_DEQUE:
+            // Elements live in one array; the node cache is never used
+            list->ops = &_CL_deque_ops;
+            list->node_size = 0;
+            break;
+        case CL_DLINKED:
+            list->ops = &_CL_dlist_ops;
+            list->node_size = sizeof(struct _cl_dnode);
+            break;
+        default:
+            assert(!"unknown CListBackend");
+    }
+
+    return list;
+}
+
+// Documented in .h file
+CList CL_new_backend(CListBackend backend) {
+    return _CL_create(backend, NULL, NULL, NULL);
+}
+
+// Documented in .h file
+CList CL_new_with_allocator(CL_alloc_fn alloc_fn, CL_free_fn free_fn, void *ctx) {
+    assert(alloc_fn);
+    return _CL_create(CL_LINKED, alloc_fn, free_fn, ctx);
+}
+
+// Documented in .h file
+CList CL_new_owning(CListBackend backend) {
+    CList list = _CL_create(backend, NULL, NULL, NULL);
+    // A compact list copies its strings already
+    list->owning = backend != CL_COMPACT;
+    return list;
+}
+
+// Documented in .h file
+CList CL_new_keyed() {
+    CList list = _CL_create(CL_LINKED, NULL, NULL, NULL);
+    list->keyed = true;
+    list->node_size = sizeof(struct _cl_knode);
+    return list;
+}
+
+// Documented in .h file
+CList CL_new_inline() {
+    CList list = _CL_create(CL_LINKED, NULL, NULL, NULL);
+    list->sso = true;
+    list->node_size = sizeof(struct _cl_snode);
+    return list;
+}
+
+// Documented in .h file
+CList CL_new_concurrent() {
+    CList list = _CL_create(CL_LINKED, NULL, NULL, NULL);
+    // Readers may be on any node, so the list never goes back to its
+    // small array
+    list->ops = &_CL_rcu_ops;
+    return list;
+}
+
+// Documented in clist_impl.h
+CList _CL_new_like(CList list) {
+    CList new = _CL_create(list->backend, list->alloc_fn, list->free_fn, list->alloc_ctx);
+    new->ops = list->ops;
+    new->cache_limit = list->cache_limit;
+    new->owning = list->owning;
+    new->keyed = list->keyed;
+    new->sso = list->sso;
+    new->node_size = list->node_size;
+    return new;
+}
+
+// Documented in clist_impl.h
+bool _CL_same_storage(CList list1, CList list2) {
+    // The strings of an owning list live in its arena, so its nodes
+    // cannot move to another list; keyed and inline nodes have their
+    // own layouts, even where their sizes match; and nodes from a
+    // block can only be released by a list that knows the block.
+    // Durable and subscribed lists must report what moves.
+    return list1 != list2 && !list1->journal && !list2->journal && !list1->feed &&
+           !list2->feed && list1->ops == list2->ops &&
+           list1->alloc_fn == list2->alloc_fn && list1->free_fn == list2->free_fn &&
+           list1->alloc_ctx == list2->alloc_ctx &&
+           !list1->owning && !list2->owning && list1->node_size == list2->node_size &&
+           list1->keyed == list2->keyed && list1->sso == list2->sso &&
+           (list2->block == NULL || list2->block == list1->block);
+}
+
+// Documented in .h file
+void CL_free(CList list) {
+    // The journal and feed are malloc'd whatever the list's allocator
+    if (list->journal) _CL_journal_close(list);
+    if (list->feed) _CL_feed_detach(list);
+    _CL_counts_free(list);
+
+    // An allocator that frees in bulk reclaims everything else at once
+    if (list->alloc_fn && list->free_fn == NULL) return;
+
+    CL_set_filter(list, 0);
+
+    // free the members of the list, and any nodes kept for reuse
+    list->ops->destroy(list);
+    _CL_arena_free(list, &list->arena);
+    CL_trim(list);
+    _CL_block_drop(list);
+    CL_thaw(list);
+    // free the list itself
+    _CL_dealloc(list, list, sizeof(struct _clist));
+}
+
+// Documented in .h file
+void CL_set_cache_limit(CList list, int limit) {
+    assert(list);
+    assert(limit >= 0);
+
+    list->cache_limit = limit;
+    while (list->cache_count > limit) {
+        struct _cl_free_node *node = list->cache;
+        list->cache = node->next;
+        list->cache_count--;
+        _CL_node_release(list, node);
+    }
+}
+
+// Documented in .h file
+void CL_trim(CList list) {
+    assert(list);
+
+    if (list->alloc_fn && list->free_fn == NULL) return;
+    while (list->cache) {
+        struct _cl_free_node *node = list->cache;
+        list->cache = node->next;
+        _CL_node_release(list, node);
+    }
+    list->cache_count = 0;
+}
+
+// Documented in .h file
+void CL_cache_stats(CList list, CListCacheStats *stats) {
+    assert(list);
+    assert(stats);
+
+    stats->hits = list->cache_hits;
+    stats->misses = list->cache_misses;
+    stats->cached = list->cache_count;
+    stats->high_water = list->cache_high_water;
+    stats->limit = list->cache_limit;
+}
+
+// Documented in .h file
+int CL_length(CList list) {
+    assert(list);
+#ifdef DEBUG
+    // In production code, we simply return the stored value for
+    // length. However, as a defensive programming method to prevent
+    // bugs in our code, in DEBUG mode we ask the backend to recount
+    // its elements and ensure that matches the stored length. A
+    // concurrent list may be changing while this thread reads it.
+    assert(list->ops == &_CL_rcu_ops || list->ops->count(list) == list->length);
+#endif  // DEBUG
+
+    // The writer of a concurrent list updates its length while readers
+    // read it here; for other lists this is an ordinary load
+    return __atomic_load_n(&list->length, __ATOMIC_RELAXED);
+}
+
+/*
+ * Return the element an owning list should store for element: a copy
+ * in its arena. Other lists store element itself.
+ */
+static inline CListElementType _CL_own(CList list, CListElementType element) {
+    return list->owning ? _CL_arena_adopt(element, list) : element;
+}
+
+/*
+ * Account for an element removed from an owning list, whose string
+ * stays in the arena until CL_compact_strings
+ *
+ * Returns: element
+ */
+static inline CListElementType _CL_disown(CList list, CListElementType element) {
+    if (list->owning) list->arena.dead += strlen(element) + 1;
+    return element;
+}
+
+/*
+ * CL_foreach callback used to fill the array view
+ */
+static void _CL_view_element(int pos, CListElementType element, void *cb_data) {
+    ((CListElementType *)cb_data)[pos] = element;
+}
+
+/*
+ * Make the array view of a frozen list current, rebuilding it if a
+ * change invalidated it. The array leaves room at both ends so that
+ * pushes and appends can be patched in.
+ */
+static void _CL_view_build(CList list) {
+    if (list->view_valid) return;
+
+    const int headroom = list->length / 8 + 8;
+    const int cap = list->length + 2 * headroom;
+    if (cap > list->view_cap || cap < list->view_cap / 4) {
+        if (list->view) _CL_dealloc(list, list->view, list->view_cap * sizeof(CListElementType));
+        list->view = (CListElementType *)_CL_alloc(list, cap * sizeof(CListElementType));
+        list->view_cap = cap;
+    }
+    // The walk may compact the list (see CL_set_auto_compact), which
+    // moves inline strings; the second walk will not compact again
+    do {
+        list->view_valid = true;
+        list->view_start = (list->view_cap - list->length) / 2;
+        list->ops->foreach(list, _CL_view_element, &list->view[list->view_start]);
+    } while (!list->view_valid);
+
+    // A heap is walked in no particular order, but its positions are ranks
+    if (list->backend == CL_PRIORITY) {
+        qsort(&list->view[list->view_start], list->length, sizeof(CListElementType),
+              _CL_element_cmp);
+    }
+}
+
+/*
+ * Whether an element handed to the backend's insert is the pointer it
+ * stores, so the view can be patched with it. Inline lists and
+ * CL_COMPACT store copies, and CL_PRIORITY chooses the position.
+ */
+static inline bool _CL_view_patchable(CList list) {
+    return (list->backend == CL_LINKED && !list->sso) || list->backend == CL_TREE ||
+           list->backend == CL_DEQUE || list->backend == CL_DLINKED;
+}
+
+/*
+ * Follow the insertion of element at pos into the view, if it is at
+ * either end and there is room there
+ */
+static void _CL_view_inserted(CList list, CListElementType element, int pos) {
+    if (!list->view_valid) return;
+
+    const int old_length = list->length - 1;
+    if (!_CL_view_patchable(list)) {
+        _CL_view_invalidate(list);
+    } else if (pos == 0 && list->view_start > 0) {
+        list->view[--list->view_start] = element;
+    } else if (pos == old_length && list->view_start + old_length < list->view_cap) {
+        list->view[list->view_start + old_length] = element;
+    } else {
+        _CL_view_invalidate(list);
+    }
+}
+
+/*
+ * Follow the removal of the element at pos from the view, if it was at
+ * either end
+ */
+static void _CL_view_removed(CList list, int pos) {
+    if (!list->view_valid) return;
+
+    if (pos == 0) {
+        list->view_start++;
+    } else if (pos != list->length) {
+        _CL_view_invalidate(list);
+    }
+}
+
+// Documented in .h file
+void CL_freeze(CList list) {
+    assert(list);
+    // Readers would race to build the array
+    assert(list->ops != &_CL_rcu_ops);
+    list->frozen = true;
+}
+
+// Documented in .h file
+void CL_thaw(CList list) {
+    assert(list);
+    if (list->view) _CL_dealloc(list, list->view, list->view_cap * sizeof(CListElementType));
+    list->view = NULL;
+    list->view_cap = 0;
+    list->frozen = false;
+    list->view_valid = false;
+}
+
+// Documented in .h file
+const CListElementType *CL_to_array(CList list) {
+    assert(list);
+    assert(list->ops != &_CL_rcu_ops);
+    list->frozen = true;
+    _CL_view_build(list);
+    return &list->view[list->view_start];
+}
+
+// Documented in .h file
+void CL_push(CList list, CListElementType element) {
+    assert(list);
+    element = _CL_own(list, element);
+    list->ops->insert(list, element, 0);
+    _CL_view_inserted(list, element, 0);
+    if (list->journal) {
+        _CL_journal_insert(list, 0, element);
+        _CL_journal_end(list);
+    }
+    if (list->feed) _CL_feed_insert(list, 0, element);
+    if (list->filter) _CL_filter_add(list, element);
+}
+
+// Documented in .h file
+CListElementType CL_pop(CList list) {
+    assert(list);
+    if (list->length == 0) {
+        return INVALID_RETURN;
+    }
+    CListElementType to_return = _CL_disown(list, list->ops->remove(list, 0));
+    _CL_view_removed(list, 0);
+    if (list->journal) {
+        _CL_journal_remove(list, 0, 1);
+        _CL_journal_end(list);
+    }
+    if (list->feed) _CL_feed_remove(list, 0, 1, to_return);
+    if (list->filter) _CL_filter_removed(list, 1);
+    return to_return;
+}
+
+// Documented in .h file
+void CL_append(CList list, CListElementType element) {
+    assert(list);
+    element = _CL_own(list, element);
+    const int pos = list->length;
+    list->ops->insert(list, element, pos);
+    _CL_view_inserted(list, element, pos);
+    if (list->journal) {
+        _CL_journal_insert(list, pos, element);
+        _CL_journal_end(list);
+    }
+    if (list->feed) _CL_feed_insert(list, pos, element);
+    if (list->filter) _CL_filter_add(list, element);
+}
+
+// Documented in .h file
+CListElementType CL_nth(CList list, int pos) {
+    assert(list);
+    const int len = CL_length(list);
+    if (pos < -len || pos > len - 1) {
+        return INVALID_RETURN;
+    }
+    const int standard_pos = (pos < 0) ? pos + len : pos;
+    if (list->frozen) {
+        _CL_view_build(list);
+        return list->view[list->view_start + standard_pos];
+    }
+    return list->ops->nth(list, standard_pos);
+}
+
+// Documented in .h file
+bool CL_insert(CList list, CListElementType element, int pos) {
+    assert(list);
+    const int len = CL_length(list);
+
+    if (pos < -(len + 1) || pos > len) {
+        return false;
+    }
+    const int standard_pos = (pos < 0) ? pos + len + 1 : pos;
+    element = _CL_own(list, element);
+    list->ops->insert(list, element, standard_pos);
+    _CL_view_inserted(list, element, standard_pos);
+    if (list->journal) {
+        _CL_journal_insert(list, standard_pos, element);
+        _CL_journal_end(list);
+    }
+    if (list->feed) _CL_feed_insert(list, standard_pos, element);
+    if (list->filter) _CL_filter_add(list, element);
+    return true;
+}
+
+// Documented in .h file
+CListElementType CL_remove(CList list, int pos) {
+    assert(list);
+    const int len = CL_length(list);
+
+    if (pos < -len || pos > len - 1) {
+        return INVALID_RETURN;
+    }
+    const int standard_pos = (pos < 0) ? pos + len : pos;
+    CListElementType to_return = _CL_disown(list, list->ops->remove(list, standard_pos));
+    _CL_view_removed(list, standard_pos);
+    if (list->journal) {
+        _CL_journal_remove(list, standard_pos, standard_pos + 1);
+        _CL_journal_end(list);
+    }
+    if (list->feed) _CL_feed_remove(list, standard_pos, 1, to_return);
+    if (list->filter) _CL_filter_removed(list, 1);
+    return to_return;
+}
+
+// Documented in .h file
+CList CL_copy(CList list) {
+    assert(list);
+    CList list_copy = list->ops->copy(list);
+    // The copy of an owning list starts out pointing into list's arena
+    if (list->owning) list_copy->ops->map(list_copy, _CL_arena_adopt, list_copy);
+    return list_copy;
+}
+
+// Documented in .h file
+int CL_insert_sorted(CList list, CListElementType element) {
+    assert(list);
+    element = _CL_own(list, element);
+    const int pos = list->ops->insert_sorted(list, element);
+    if (pos >= 0) {
+        _CL_view_inserted(list, element, pos);
+    } else {
+        _CL_view_invalidate(list);
+    }
+    // A CL_PRIORITY list ignores the position on replay
+    if (list->journal) {
+        _CL_journal_insert(list, pos >= 0 ? pos : 0, element);
+        _CL_journal_end(list);
+    }
+    if (list->feed) _CL_feed_insert(list, pos, element);
+    if (list->filter) _CL_filter_add(list, element);
+    return pos;
+}
+
+// Documented in .h file
+void CL_insert_sorted_stream(CList list, const CListElementType *elements, int count) {
+    assert(list);
+    assert(elements || count == 0);
+
+    // Each insertion starts where the one before it went, so elements
+    // taken in order are merged into the list in a single pass; a
+    // batch that is out of order is sorted first
+    bool in_order = true;
+    for (int i = 1; i < count && in_order; i++) {
+        in_order = strcmp(elements[i - 1], elements[i]) <= 0;
+    }
+    if (in_order) {
+        for (int i = 0; i < count; i++) CL_insert_sorted(list, elements[i]);
+        return;
+    }
+
+    CListElementType *sorted = (CListElementType *)malloc(count * sizeof(CListElementType));
+    assert(sorted);
+    memcpy(sorted, elements, count * sizeof(CListElementType));
+    qsort(sorted, count, sizeof(CListElementType), _CL_element_cmp);
+    for (int i = 0; i < count; i++) CL_insert_sorted(list, sorted[i]);
+    free(sorted);
+}
+
+// Documented in .h file
+void CL_join(CList list1, CList list2) {
+    assert(list1);
+    assert(list2);
+    _CL_view_invalidate(list1);
+    _CL_view_invalidate(list2);
+
+    if (_CL_same_storage(list1, list2)) {
+        // Filters are built again rather than fed every moved element
+        if (list1->filter) _CL_filter_invalidate(list1);
+        if (list2->filter) _CL_filter_removed(list2, list2->length);
+        list1->ops->join(list1, list2);
+        return;
+    }
+
+    // Lists that cannot share nodes move element by element
+    while (list2->length) {
+        CL_append(list1, CL_pop(list2));
+    }
+}
+
+// Documented in .h file
+CList CL_split(CList list, int pos) {
+    assert(list);
+    const int len = CL_length(list);
+
+    if (pos < -len || pos > len) {
+        return NULL;
+    }
+    const int standard_pos = (pos < 0) ? pos + len : pos;
+    _CL_view_invalidate(list);
+    CList tail = list->ops->split(list, standard_pos);
+    // Nodes that moved to the tail may come from list's block
+    if (list->block) _CL_block_install(tail, list->block);
+    if (list->owning) {
+        tail->ops->map(tail, _CL_arena_adopt, tail);
+        list->arena.dead += tail->arena.used;
+    }
+    if (list->journal) {
+        _CL_journal_remove(list, standard_pos, len);
+        _CL_journal_end(list);
+    }
+    if (list->feed) {
+        CListElementType only = len - standard_pos == 1 ? tail->ops->nth(tail, 0) : NULL;
+        _CL_feed_remove(list, standard_pos, len - standard_pos, only);
+    }
+    if (list->filter) _CL_filter_removed(list, len - standard_pos);
+    return tail;
+}
+
+// Documented in .h file
+bool CL_splice(CList dest, int dest_pos, CList src, int start, int end) {
+    assert(dest);
+    assert(src);
+    const int dest_len = CL_length(dest);
+    const int src_len = CL_length(src);
+
+    if (dest == src) {
+        return false;
+    }
+    if (dest_pos < -(dest_len + 1) || dest_pos > dest_len) {
+        return false;
+    }
+    if (start < -src_len || start > src_len || end < -src_len || end > src_len) {
+        return false;
+    }
+    const int standard_dest_pos = (dest_pos < 0) ? dest_pos + dest_len + 1 : dest_pos;
+    const int standard_start = (start < 0) ? start + src_len : start;
+    const int standard_end = (end < 0) ? end + src_len : end;
+    if (standard_start > standard_end) {
+        return false;
+    }
+    _CL_view_invalidate(dest);
+    _CL_view_invalidate(src);
+
+    // Readers of a concurrent src still in a relinked range would walk
+    // on into dest, so concurrent lists take the path below, which
+    // retires each node and links a new one
+    if (_CL_same_storage(dest, src) && src->ops != &_CL_rcu_ops) {
+        if (dest->filter) _CL_filter_invalidate(dest);
+        if (src->filter) _CL_filter_removed(src, standard_end - standard_start);
+        dest->ops->splice(dest, standard_dest_pos, src, standard_start, standard_end);
+        return true;
+    }
+
+    // Lists that cannot share nodes move element by element
+    for (int i = 0; i < standard_end - standard_start; i++) {
+        CListElementType element = _CL_disown(src, src->ops->remove(src, standard_start));
+        if (src->feed) _CL_feed_remove(src, standard_start, 1, element);
+        if (src->filter) _CL_filter_removed(src, 1);
+        element = _CL_own(dest, element);
+        dest->ops->insert(dest, element, standard_dest_pos + i);
+        if (dest->journal) _CL_journal_insert(dest, standard_dest_pos + i, element);
+        if (dest->feed) _CL_feed_insert(dest, standard_dest_pos + i, element);
+        if (dest->filter) _CL_filter_add(dest, element);
+    }
+    if (dest->journal) _CL_journal_end(dest);
+    if (src->journal) {
+        _CL_journal_remove(src, standard_start, standard_end);
+        _CL_journal_end(src);
+    }
+    return true;
+}
+
+// Documented in .h file
+int CL_find(CList list, CListElementType key) {
+    assert(list);
+    assert(key);
+    return list->ops->find(list, key, false);
+}
+
+// Documented in .h file
+int CL_count(CList list, CListElementType key) {
+    assert(list);
+    assert(key);
+    return list->ops->find(list, key, true);
+}
+
+// Accesses counted by CL_find_adaptive with CL_FIND_COUNT, per string:
+// an open-addressing table of string hashes. Two strings whose hashes
+// collide share a count, which only makes the ordering less exact.
+struct _cl_counts {
+    uint64_t *hashes;  // 0 marks an empty slot
+    unsigned *counts;
+    int cap;  // a power of two
+    int used;
+};
+
+/*
+ * Hash a string for the counts table, never returning 0
+ */
+static inline uint64_t _CL_counts_hash(const char *s) {
+    const uint64_t hash = _CL_hash(s);
+    return hash ? hash : 1;
+}
+
+/*
+ * Return the slot of the counts table that holds hash, or the empty
+ * slot where it would go
+ */
+static int _CL_counts_slot(struct _cl_counts *counts, uint64_t hash) {
+    int i = (int)(hash & (counts->cap - 1));
+    while (counts->hashes[i] && counts->hashes[i] != hash) i = (i + 1) & (counts->cap - 1);
+    return i;
+}
+
+/*
+ * Return how many times CL_FIND_COUNT has found s in list
+ */
+static unsigned _CL_counts_get(CList list, const char *s) {
+    if (list->counts == NULL) return 0;
+    return list->counts->counts[_CL_counts_slot(list->counts, _CL_counts_hash(s))];
+}
+
+/*
+ * Count one more find of s in list, growing the table at half full.
+ * The table comes from the list's allocator.
+ *
+ * Returns: The new count
+ */
+static unsigned _CL_counts_bump(CList list, const char *s) {
+    struct _cl_counts *counts = list->counts;
+    if (counts == NULL) {
+        counts = list->counts = (struct _cl_counts *)_CL_alloc(list, sizeof(struct _cl_counts));
+        memset(counts, 0, sizeof(*counts));
+    }
+    if (2 * (counts->used + 1) > counts->cap) {
+        struct _cl_counts old = *counts;
+        counts->cap = old.cap ? 2 * old.cap : 64;
+        counts->hashes = (uint64_t *)_CL_alloc(list, counts->cap * sizeof(uint64_t));
+        counts->counts = (unsigned *)_CL_alloc(list, counts->cap * sizeof(unsigned));
+        memset(counts->hashes, 0, counts->cap * sizeof(uint64_t));
+        memset(counts->counts, 0, counts->cap * sizeof(unsigned));
+        for (int i = 0; i < old.cap; i++) {
+            if (old.hashes[i] == 0) continue;
+            const int slot = _CL_counts_slot(counts, old.hashes[i]);
+            counts->hashes[slot] = old.hashes[i];
+            counts->counts[slot] = old.counts[i];
+        }
+        if (old.cap) {
+            _CL_dealloc(list, old.hashes, old.cap * sizeof(uint64_t));
+            _CL_dealloc(list, old.counts, old.cap * sizeof(unsigned));
+        }
+    }
+
+    const uint64_t hash = _CL_counts_hash(s);
+    const int slot = _CL_counts_slot(counts, hash);
+    if (counts->hashes[slot] == 0) {
+        counts->hashes[slot] = hash;
+        counts->used++;
+    }
+    return ++counts->counts[slot];
+}
+
+// Documented in clist_impl.h
+void _CL_counts_free(CList list) {
+    struct _cl_counts *counts = list->counts;
+    if (counts == NULL) return;
+    _CL_dealloc(list, counts->hashes, counts->cap * sizeof(uint64_t));
+    _CL_dealloc(list, counts->counts, counts->cap * sizeof(unsigned));
+    _CL_dealloc(list, counts, sizeof(struct _cl_counts));
+    list->counts = NULL;
+}
+
+/*
+ * Find key in a CL_LINKED list that has nodes, and relink its node
+ * where policy says in the same walk
+ *
+ * Returns: The position key was found at, or -1; *to is set to where
+ *   it is now
+ */
+static int _CL_linked_find_move(CList list, CListElementType key, CListFindPolicy policy,
+                                int *to) {
+    const struct _cl_key k = list->keyed ? _CL_key_make(key) : (struct _cl_key){0, 0};
+    struct _cl_node **prev_link = NULL;
+    struct _cl_node **link = &list->head;
+    int pos = 0;
+    struct _cl_node *scout = _CL_scout_start(list->head);
+    for (; *link; prev_link = link, link = &(*link)->next, pos++) {
+        struct _cl_node *iter = *link;
+        scout = _CL_scout_step(scout, !list->keyed);
+        const int cmp = list->keyed
+                            ? _CL_key_cmp(&((struct _cl_knode *)iter)->key, iter->element, &k, key)
+                            : strcmp(iter->element, key);
+        if (cmp == 0) break;
+    }
+    if (*link == NULL) return -1;
+
+    struct _cl_node *node = *link;
+    struct _cl_node **target = &list->head;
+    _CL_finger_drop(list);
+    *to = 0;
+    if (policy == CL_FIND_TRANSPOSE) {
+        target = prev_link ? prev_link : link;
+        *to = pos ? pos - 1 : 0;
+    } else if (policy == CL_FIND_COUNT) {
+        // Ahead of every element found fewer times
+        const unsigned count = _CL_counts_bump(list, key);
+        while (*target != node && _CL_counts_get(list, (*target)->element) >= count) {
+            target = &(*target)->next;
+            (*to)++;
+        }
+    }
+
+    if (target != link) {
+        *link = node->next;
+        node->next = *target;
+        *target = node;
+    }
+    return pos;
+}
+
+// Documented in .h file
+int CL_find_adaptive(CList list, CListElementType key, CListFindPolicy policy) {
+    assert(list);
+    assert(key);
+    // The positions of a priority queue are ranks
+    if (list->backend == CL_PRIORITY) return list->ops->find(list, key, false);
+
+    int pos, to = 0;
+    if (list->ops == &_CL_linked_ops && list->head) {
+        pos = _CL_linked_find_move(list, key, policy, &to);
+        if (pos < 0) return -1;
+    } else {
+        pos = list->ops->find(list, key, false);
+        if (pos < 0) return -1;
+        if (policy == CL_FIND_TRANSPOSE) {
+            to = pos ? pos - 1 : 0;
+        } else if (policy == CL_FIND_COUNT) {
+            // Counts do not increase along the list, so the first
+            // element found fewer times is found by bisection
+            const unsigned count = _CL_counts_bump(list, key);
+            int hi = pos;
+            while (to < hi) {
+                const int mid = to + (hi - to) / 2;
+                if (_CL_counts_get(list, list->ops->nth(list, mid)) >= count) {
+                    to = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+        }
+        if (to != pos) list->ops->move(list, pos, to);
+    }
+
+    if (to != pos) {
+        _CL_view_invalidate(list);
+        if (list->journal) {
+            _CL_journal_move(list, pos, to);
+            _CL_journal_end(list);
+        }
+        if (list->feed) {
+            CListElementType element = list->ops->nth(list, to);
+            _CL_feed_remove(list, pos, 1, element);
+            _CL_feed_insert(list, to, element);
+        }
+    }
+    return to;
+}
+
+// Documented in .h file
+void CL_compact(CList list) {
+    assert(list);
+    // Cached nodes are scattered too, and may come from an older block
+    CL_trim(list);
+    list->ops->compact(list);
+    // Strings stored in nodes have moved
+    _CL_view_invalidate(list);
+}
+
+// Documented in .h file
+void CL_set_auto_compact(CList list, double threshold) {
+    assert(list);
+    assert(threshold >= 0 && threshold <= 1);
+    list->compact_threshold = threshold;
+}
+
+// Documented in .h file
+double CL_fragmentation(CList list) {
+    assert(list);
+    if (list->backend != CL_LINKED || list->head == NULL || list->length < 2) return 0;
+
+    int scattered = 0;
+    for (struct _cl_node *iter = list->head; iter->next != NULL; iter = iter->next) {
+        if (_CL_scattered(iter, iter->next)) scattered++;
+    }
+    return (double)scattered / (list->length - 1);
+}
+
+// Documented in .h file
+void CL_reverse(CList list) {
+    assert(list);
+    _CL_view_invalidate(list);
+    list->ops->reverse(list);
+    if (list->journal) {
+        _CL_journal_reverse(list);
+        _CL_journal_end(list);
+    }
+    if (list->feed) _CL_feed_reverse(list);
+}
+
+// Documented in .h file
+void CL_foreach(CList list, CL_foreach_callback callback, void *cb_data) {
+    assert(list);
+    list->ops->foreach(list, callback, cb_data);
+}
+
+/*
+ * Return the position of a node of a CL_DLINKED list if it is cheap to
+ * know, at either end, or if a journal or subscribers need it; -1
+ * otherwise
+ */
+static int _CL_handle_pos(CList list, const struct _cl_dnode *node) {
+    if (node == list->dhead) return 0;
+    if (node == list->dtail) return list->length - 1;
+    return list->journal || list->feed ? _CL_dlist_pos(node) : -1;
+}
+
+/*
+ * Report a node just linked into a CL_DLINKED list to the list's view,
+ * journal and subscribers. pos is its position, or -1 if unknown.
+ *
+ * Returns: node
+ */
+static CListHandle _CL_handle_inserted(CList list, struct _cl_dnode *node, int pos) {
+    if (pos < 0) pos = _CL_handle_pos(list, node);
+    if (pos >= 0) {
+        _CL_view_inserted(list, node->element, pos);
+    } else {
+        _CL_view_invalidate(list);
+    }
+    if (list->journal) {
+        _CL_journal_insert(list, pos, node->element);
+        _CL_journal_end(list);
+    }
+    if (list->feed) _CL_feed_insert(list, pos, node->element);
+    if (list->filter) _CL_filter_add(list, node->element);
+    return node;
+}
+
+// Documented in .h file
+CListHandle CL_push_h(CList list, CListElementType element) {
+    assert(list);
+    assert(list->backend == CL_DLINKED);
+    struct _cl_dnode *node = _CL_dlist_new(list, _CL_own(list, element), list->dhead);
+    return _CL_handle_inserted(list, node, 0);
+}
+
+// Documented in .h file
+CListHandle CL_append_h(CList list, CListElementType element) {
+    assert(list);
+    assert(list->backend == CL_DLINKED);
+    struct _cl_dnode *node = _CL_dlist_new(list, _CL_own(list, element), NULL);
+    return _CL_handle_inserted(list, node, list->length - 1);
+}
+
+// Documented in .h file
+CListHandle CL_insert_h(CList list, CListElementType element, int pos) {
+    assert(list);
+    assert(list->backend == CL_DLINKED);
+    const int len = list->length;
+
+    if (pos < -(len + 1) || pos > len) {
+        return NULL;
+    }
+    const int standard_pos = (pos < 0) ? pos + len + 1 : pos;
+    struct _cl_dnode *node =
+        _CL_dlist_new(list, _CL_own(list, element), _CL_dlist_at(list, standard_pos));
+    return _CL_handle_inserted(list, node, standard_pos);
+}
+
+// Documented in .h file
+CListHandle CL_insert_after_h(CList list, CListHandle handle, CListElementType element) {
+    assert(list);
+    assert(handle);
+    assert(list->backend == CL_DLINKED);
+    struct _cl_dnode *node = _CL_dlist_new(list, _CL_own(list, element), handle->next);
+    return _CL_handle_inserted(list, node, -1);
+}
+
+// Documented in .h file
+CListElementType CL_remove_h(CList list, CListHandle handle) {
+    assert(list);
+    assert(handle);
+    assert(list->backend == CL_DLINKED);
+    const int pos = _CL_handle_pos(list, handle);
+    _CL_dlist_unlink(list, handle);
+    CListElementType element = _CL_disown(list, handle->element);
+    _CL_node_recycle(list, handle);
+
+    if (pos >= 0) {
+        _CL_view_removed(list, pos);
+    } else {
+        _CL_view_invalidate(list);
+    }
+    if (list->journal) {
+        _CL_journal_remove(list, pos, pos + 1);
+        _CL_journal_end(list);
+    }
+    if (list->feed) _CL_feed_remove(list, pos, 1, element);
+    if (list->filter) _CL_filter_removed(list, 1);
+    return element;
+}
+
+// Documented in .h file
+void CL_move_to_front_h(CList list, CListHandle handle) {
+    assert(list);
+    assert(handle);
+    assert(list->backend == CL_DLINKED);
+    if (handle == list->dhead) return;
+
+    const int pos = _CL_handle_pos(list, handle);
+    _CL_dlist_unlink(list, handle);
+    _CL_dlist_link(list, handle, list->dhead);
+    _CL_view_invalidate(list);
+    if (list->journal) {
+        _CL_journal_move(list, pos, 0);
+        _CL_journal_end(list);
+    }
+    if (list->feed) {
+        _CL_feed_remove(list, pos, 1, handle->element);
+        _CL_feed_insert(list, 0, handle->element);
+    }
+}
+
+// Documented in .h file
+CListElementType CL_element_h(CListHandle handle) {
+    assert(handle);
+    return handle->element;
 }
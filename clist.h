@@ -9,6 +9,7 @@
 #define _CLIST_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 
 // struct _clist is defined in .c file
 typedef struct _clist *CList;
@@ -21,6 +22,35 @@ typedef const char *CListElementType;
 // Used to indicate an error on some functions
 #define INVALID_RETURN NULL
 
+// The storage a CList is built on. Every backend serves the complete
+// CList API; apart from CL_PRIORITY, described below, they have the
+// same semantics and only differ in the cost of each operation.
+typedef enum {
+    CL_LINKED,    // singly linked list: O(1) push/pop, O(n) positional access
+    CL_TREE,      // implicit-key treap: O(log n) nth/insert/remove/join, O(1) reverse
+    CL_DEQUE,     // circular array: O(1) push/pop at both ends and nth, contiguous storage
+    CL_PRIORITY,  // pairing heap priority queue
+    CL_COMPACT,   // 8-byte slab nodes with 32-bit links; copies elements, see below
+    CL_DLINKED,   // doubly linked list: O(1) at both ends, and handles; see CL_push_h
+} CListBackend;
+
+// A CL_COMPACT list has the costs of CL_LINKED but half its per-node
+// footprint. It copies every inserted string into an arena it owns,
+// so callers need not keep their strings alive; pointers it returns,
+// including from CL_pop and CL_remove, stay valid until CL_free or
+// CL_compact_strings.
+// Nodes cannot move between compact lists, so CL_join, CL_split and
+// CL_splice copy the moved strings.
+
+// A CL_PRIORITY list is a priority queue of strings. It is always kept
+// in ascending strcmp order, whatever function inserted the element:
+// CL_push, CL_append, CL_insert and CL_insert_sorted all ignore any
+// position and cost O(1). The head is read by CL_nth in O(1) and
+// removed by CL_pop in O(log n) amortized; other positions count in
+// ascending order and cost O(pos log n). CL_foreach and CL_print visit
+// elements in an unspecified order, CL_reverse has no effect, and
+// CL_join melds the two queues in O(1).
+
 /*
  * Create a new CList
  *
@@ -30,6 +60,221 @@ typedef const char *CListElementType;
  */
 CList CL_new();
 
+/*
+ * Create a new CList on a specific backend. CL_new() is equivalent to
+ * CL_new_backend(CL_LINKED).
+ *
+ * Parameters:
+ *   backend  The storage backend to use for the list
+ *
+ * Returns: The new list
+ */
+CList CL_new_backend(CListBackend backend);
+
+// Allocator hooks for CL_new_with_allocator. ctx is the value passed
+// to CL_new_with_allocator; size is the size originally requested.
+typedef void *(*CL_alloc_fn)(void *ctx, size_t size);
+typedef void (*CL_free_fn)(void *ctx, void *ptr, size_t size);
+
+/*
+ * Create a new CL_LINKED CList whose storage comes from a caller
+ * supplied allocator. The list itself and every one of its nodes are
+ * allocated with alloc_fn and released with free_fn; lists derived
+ * from it by CL_copy and CL_split use the same allocator.
+ *
+ * If free_fn is NULL, the allocator is taken to free its memory in
+ * bulk (an arena, for instance): nodes are still reused through the
+ * list's cache, but CL_free and CL_trim do not walk the list to free
+ * nodes individually, and the memory is reclaimed whenever the
+ * allocator itself is reset.
+ *
+ * Parameters:
+ *   alloc_fn   Function returning size bytes of suitably aligned memory
+ *   free_fn    Function releasing memory from alloc_fn, or NULL
+ *   ctx        Caller data passed to both functions
+ *
+ * Returns: The new list
+ */
+CList CL_new_with_allocator(CL_alloc_fn alloc_fn, CL_free_fn free_fn, void *ctx);
+
+/*
+ * Create a new CL_LINKED CList for use with CL_insert_sorted. Each of
+ * its nodes caches the first 8 bytes and the length of its element, so
+ * CL_insert_sorted decides most comparisons with one integer compare
+ * and only reads the strings themselves when those bytes are equal.
+ * Nodes are 16 bytes larger than those of CL_new(). Every other
+ * function behaves as for any CL_LINKED list; in particular the list
+ * is only sorted if the caller keeps it so.
+ *
+ * Parameters: None
+ *
+ * Returns: The new list
+ */
+CList CL_new_keyed();
+
+/*
+ * Create a new CL_LINKED CList that stores short strings inside its
+ * nodes. A string of fewer than 16 bytes is copied into the node that
+ * holds it, so walking and comparing such elements stays within the
+ * node's cache line, and the caller's copy can be reused at once.
+ * Longer strings are referenced, as in any other CList. Nodes are 16
+ * bytes larger than those of CL_new().
+ *
+ * Elements returned by CL_nth and CL_foreach point into the node and
+ * are valid while the element stays in the list. A short element
+ * returned by CL_pop or CL_remove is copied out of its node first, and
+ * stays valid until the list is freed or CL_compact_strings is called.
+ *
+ * Parameters: None
+ *
+ * Returns: The new list
+ */
+CList CL_new_inline();
+
+/*
+ * Create a new CList that owns its strings. CL_push, CL_append,
+ * CL_insert and CL_insert_sorted copy the string into an arena that
+ * belongs to the list, so the caller's copy can be reused at once, and
+ * CL_free releases all the strings together. Lists derived by CL_copy
+ * and CL_split own copies of their own. A CL_COMPACT list always owns
+ * its strings, with or without this function.
+ *
+ * Elements returned by CL_nth, CL_pop, CL_remove and the other
+ * functions point into the arena. They stay valid until the list is
+ * freed or CL_compact_strings is called, including the elements that
+ * have been removed. Elements moved into a list that does not own its
+ * strings stay in the source's arena.
+ *
+ * Parameters:
+ *   backend  The storage backend to use for the list
+ *
+ * Returns: The new list
+ */
+CList CL_new_owning(CListBackend backend);
+
+/*
+ * Create a new CL_LINKED CList that threads can read while another
+ * thread changes it. CL_nth, CL_foreach, CL_find, CL_count and CL_copy
+ * may be called from any number of threads at once, without locks,
+ * concurrently with one thread calling any other function. Writers
+ * must still exclude each other.
+ *
+ * A read sees the list as it was at some point during the read; a
+ * CL_foreach may see an element that is removed while it runs, but
+ * never a freed node. CL_length, and the range check of CL_nth, may
+ * be out of date on a reading thread, in which case CL_nth returns
+ * INVALID_RETURN. Removed nodes are freed once every read that could
+ * have reached them has finished.
+ *
+ * The list always keeps its elements in nodes, and CL_reverse copies
+ * them, costing O(n) allocations. CL_compact has no effect, and the
+ * list cannot be frozen (see CL_freeze). CL_free must only be called
+ * once no thread is reading the list.
+ *
+ * Parameters: None
+ *
+ * Returns: The new list
+ */
+CList CL_new_concurrent();
+
+/*
+ * Wait until every read of a concurrent list that is in progress, on
+ * any thread, has finished, then free the nodes removed from list so
+ * far. Must not be called from within a read, such as a CL_foreach
+ * callback. Has no effect on lists not created by CL_new_concurrent.
+ *
+ * Parameters:
+ *   list     The list
+ *
+ * Returns: None
+ */
+void CL_synchronize(CList list);
+
+/*
+ * Open a list that survives restarts, stored in the file at path and
+ * a journal next to it (path with ".journal" appended). If the files
+ * exist, the list is loaded from them; otherwise it starts out empty.
+ *
+ * Every change to the list is appended to the journal: CL_push,
+ * CL_append, CL_insert, CL_insert_sorted, CL_pop, CL_remove,
+ * CL_reverse, and both sides of CL_join, CL_split and CL_splice.
+ * Changes are written and fsynced in groups (see CL_set_group_commit),
+ * so after a crash the list comes back as of its last commit. Once the
+ * journal has grown past 1 MiB and past twice the size of the list's
+ * file, the list checkpoints itself (see CL_checkpoint), which bounds
+ * the time opening it takes.
+ *
+ * The list owns its strings, as if created by CL_new_owning(backend).
+ * CL_free commits any pending changes; lists derived from it, such as
+ * by CL_copy or CL_split, are not durable. At most one process may
+ * have the list open at a time.
+ *
+ * Parameters:
+ *   path     Where the list is stored
+ *   backend  The storage backend to use for the list in memory
+ *
+ * Returns: The list, or NULL if the files could not be read or
+ *   created (errno may say why) or are not a valid list
+ */
+CList CL_open_durable(const char *path, CListBackend backend);
+
+/*
+ * Write and fsync the changes a durable list has not yet committed.
+ * Has no effect on other lists.
+ *
+ * Parameters:
+ *   list     The list
+ *
+ * Returns: true if every change so far is on disk, false if a write
+ *   has failed since the list was opened
+ */
+bool CL_sync(CList list);
+
+/*
+ * Set how long a durable list may hold changes before committing them
+ * together. A change is committed by the first change made after the
+ * interval has passed, or by CL_sync, so a list that stops changing
+ * keeps its last changes pending until one of those or CL_free.
+ * Changes are also committed whenever 64 KiB of them are pending.
+ *
+ * Parameters:
+ *   list         The list
+ *   interval_ms  Milliseconds between commits; 0 commits every change
+ *                on its own. The default is 10.
+ *
+ * Returns: None
+ */
+void CL_set_group_commit(CList list, int interval_ms);
+
+/*
+ * Write the contents of a durable list to its file and empty its
+ * journal, so that opening it no longer replays the changes made so
+ * far. The file is replaced atomically: a crash at any point leaves
+ * either the old file and journal or the new file. Costs O(n).
+ *
+ * Parameters:
+ *   list     The list
+ *
+ * Returns: true on success, or if list is not durable
+ */
+bool CL_checkpoint(CList list);
+
+/*
+ * Reclaim the arena space of the strings removed from a list that
+ * owns its strings, by copying the remaining ones into a new arena.
+ * For a CL_new_inline list, reclaims the short strings returned by
+ * CL_pop and CL_remove.
+ * Every pointer previously returned for this list becomes invalid.
+ * Costs O(n) plus the bytes copied; it does nothing if no element has
+ * been removed since the last call.
+ *
+ * Parameters:
+ *   list   The list
+ *
+ * Returns: The number of bytes of removed strings reclaimed
+ */
+size_t CL_compact_strings(CList list);
+
 /*
  * Destroy a list, calling free() on all malloc'd memory.
  *
@@ -40,6 +285,100 @@ CList CL_new();
  */
 void CL_free(CList list);
 
+// Node cache counters reported by CL_cache_stats
+typedef struct {
+    unsigned long hits;    // node allocations served from the cache
+    unsigned long misses;  // node allocations that had to call malloc
+    int cached;            // nodes currently held in the cache
+    int high_water;        // most nodes the cache has held at once
+    int limit;             // maximum nodes the cache will hold
+} CListCacheStats;
+
+/*
+ * Set the maximum number of free nodes the list keeps for reuse.
+ *
+ * Every list keeps the nodes of removed elements in a small cache
+ * and reuses them for later insertions, so that push/pop churn does
+ * not go through malloc and free each time. Nodes removed once the
+ * cache is full are freed immediately. Lowering the limit frees the
+ * excess cached nodes; a limit of 0 disables the cache.
+ *
+ * Parameters:
+ *   list     The list
+ *   limit    The new maximum, >= 0
+ *
+ * Returns: None
+ */
+void CL_set_cache_limit(CList list, int limit);
+
+/*
+ * Free every node held in the list's cache. The list itself and its
+ * elements are not affected.
+ *
+ * Parameters:
+ *   list     The list
+ *
+ * Returns: None
+ */
+void CL_trim(CList list);
+
+/*
+ * Report the node cache counters of a list
+ *
+ * Parameters:
+ *   list     The list
+ *   stats    Filled in with the current counters
+ *
+ * Returns: None
+ */
+void CL_cache_stats(CList list, CListCacheStats *stats);
+
+/*
+ * Turn thread-local node magazines on or off for the whole process.
+ *
+ * When on, nodes that cannot be served from a list's own cache come
+ * from a stack of free nodes private to the calling thread, refilled
+ * from and spilled to a shared depot in batches, so threads building
+ * lists concurrently rarely touch the global heap. A node may be
+ * freed on a different thread than the one that allocated it. Off by
+ * default.
+ *
+ * Parameters:
+ *   enable   Whether to use magazines for subsequent allocations
+ *
+ * Returns: None
+ */
+void CL_set_magazines(bool enable);
+
+/*
+ * Free the nodes held by the calling thread's magazines and by the
+ * shared depot. Magazines of other running threads are not affected.
+ *
+ * Parameters: None
+ *
+ * Returns: None
+ */
+void CL_flush_magazines();
+
+/*
+ * Set how many nodes ahead of a walk over a CL_LINKED list to
+ * prefetch, for the whole process. Walks in CL_nth, CL_foreach,
+ * CL_print, CL_copy, CL_free, CL_insert_sorted and CL_find run a
+ * second pointer this far ahead, which prefetches each node and, where
+ * the walk compares or prints them, the element strings.
+ *
+ * The scout itself still chases one pointer per node, so this only
+ * pays off when the walk does enough work per node to hide a miss;
+ * `make bench` measures plain walks over a scattered list. The
+ * default is 0, which turns prefetching off.
+ *
+ * Parameters:
+ *   distance   The number of nodes to run ahead, >= 0
+ *
+ * Returns: None
+ */
+void CL_set_prefetch_distance(int distance);
+
 /*
  * Compute the length of a list
  *
@@ -51,7 +390,9 @@ void CL_free(CList list);
 int CL_length(CList list);
 
 /*
- * Print the list
+ * Print the list to standard output, one "  [pos]: element" line per
+ * element, as CL_write does with CL_FORMAT_INDEXED. Output already
+ * buffered in stdout is flushed first.
  *
  * Parameters:
  *   list     The list
@@ -60,6 +401,44 @@ int CL_length(CList list);
  */
 void CL_print(CList list);
 
+// Output formats for CL_write and CL_to_string
+typedef enum {
+    CL_FORMAT_INDEXED,  // "  [pos]: element\n", as CL_print
+    CL_FORMAT_LINES,    // "element\n"
+} CListFormat;
+
+/*
+ * Write the elements of a list to a file descriptor. Entries are
+ * formatted into a large buffer without stdio, and long strings are
+ * written from where they are, so the whole list goes out in a few
+ * writev calls. Interrupted and partial writes are retried.
+ *
+ * Parameters:
+ *   list     The list
+ *   fd       The file descriptor to write to
+ *   format   How to format each element
+ *
+ * Returns: true on success, false if a write failed (errno says why;
+ *   part of the list may have been written)
+ */
+bool CL_write(CList list, int fd, CListFormat format);
+
+/*
+ * Format the elements of a list into a string, as CL_write would
+ * write them. Like snprintf, stores at most size - 1 bytes followed by
+ * a terminator, and returns the length of the whole output, so a
+ * return value of size or more means buf was too small.
+ *
+ * Parameters:
+ *   list     The list
+ *   buf      Where to store the string; may be NULL if size is 0
+ *   size     Size of buf in bytes
+ *   format   How to format each element
+ *
+ * Returns: The length of the full output, not counting the terminator
+ */
+size_t CL_to_string(CList list, char *buf, size_t size, CListFormat format);
+
 /*
  * Insert the specified element onto the head of the list.
  *
@@ -116,6 +495,46 @@ void CL_append(CList list, CListElementType element);
  */
 CListElementType CL_nth(CList list, int pos);
 
+/*
+ * Freeze a list for reading: CL_nth is then served from an array of
+ * the list's elements, in O(1) on every backend. The array is built
+ * by the first CL_nth after freezing, in O(n), and kept up to date by
+ * CL_push, CL_pop, CL_append and by inserts and removals at either
+ * end. Any other change to the list leaves it to be rebuilt by the
+ * next CL_nth, so a frozen list that is modified in the middle pays
+ * O(n) per read. The list is otherwise unchanged.
+ *
+ * Parameters:
+ *   list     The list
+ *
+ * Returns: None
+ */
+void CL_freeze(CList list);
+
+/*
+ * Undo CL_freeze, freeing the list's array of elements.
+ *
+ * Parameters:
+ *   list     The list
+ *
+ * Returns: None
+ */
+void CL_thaw(CList list);
+
+/*
+ * Return the elements of a list as an array, freezing the list (see
+ * CL_freeze). Element i of the array is the one CL_nth would return
+ * for position i. The array belongs to the list and is not copied: it
+ * is valid until the list is next modified or thawed, and must not be
+ * written to or freed.
+ *
+ * Parameters:
+ *   list     The list
+ *
+ * Returns: An array of CL_length(list) elements
+ */
+const CListElementType *CL_to_array(CList list);
+
 /*
  * Insert the specified element onto the list at a given position.
  *
@@ -186,14 +605,36 @@ CList CL_copy(CList list);
  *
  * Sorting is done following the rules for the strcmp function.
  *
+ * Each search starts from where the last insertion went, so elements
+ * inserted in ascending order take O(1) each on CL_LINKED and
+ * CL_DLINKED lists, and O(log d) on CL_DEQUE for an element landing d
+ * positions from the last one. Other changes to a CL_LINKED or
+ * CL_DLINKED list make the next search start from the head.
+ *
  * Parameters:
  *   list     The list
  *   element  The element to insert
  *
- * Returns: The position the element was inserted into
+ * Returns: The position the element was inserted into. On a
+ *   CL_PRIORITY list, which does not track positions, returns 0 if
+ *   the element is now the head and -1 otherwise.
  */
 int CL_insert_sorted(CList list, CListElementType element);
 
+/*
+ * Insert many elements into their proper positions within a sorted
+ * list, as CL_insert_sorted does for each of them. Elements in
+ * ascending order are merged into the list in one pass; others are
+ * sorted first, so the cost is O(length + count log count) on a
+ * CL_LINKED list.
+ *
+ * Parameters:
+ *   list      The list
+ *   elements  The elements to insert
+ *   count     The number of elements
+ */
+void CL_insert_sorted_stream(CList list, const CListElementType *elements, int count);
+
 /*
  * Join (concatenate) two lists. The contents of list2 are appended
  * to list1. After this operation, list2 will still exist, but it will
@@ -210,6 +651,235 @@ int CL_insert_sorted(CList list, CListElementType element);
  */
 void CL_join(CList list1, CList list2);
 
+/*
+ * Meld two CL_PRIORITY lists: every element of list2 is moved into
+ * list1 in O(1), leaving list2 empty. This is CL_join restricted to
+ * priority queues.
+ *
+ * Parameters:
+ *   list1     The queue receiving the elements
+ *   list2     The queue to empty; must not be list1
+ *
+ * Returns: true on success, false if either list is not CL_PRIORITY
+ */
+bool CL_meld(CList list1, CList list2);
+
+/*
+ * Split a list in two. The elements from pos onward are moved, in
+ * order, to a new list; the original list keeps the elements before
+ * pos. Nodes are relinked rather than copied.
+ *
+ * Example: If list = A B C D E, after CL_split(list, 2) returns, list
+ * will contain A B and the returned list will contain C D E.
+ *
+ * Parameters:
+ *   list     The list to split
+ *   pos      Position of the first element of the new list
+ *
+ * If pos <= -1, it counts from the end of the list, so pos == -1
+ * moves just the tail element. pos == length moves nothing.
+ *
+ * pos must be in the range [-length, length] inclusive. If pos is
+ * outside this range, returns NULL and list is unchanged.
+ *
+ * Returns: A new list, on the same backend, which must be destroyed
+ *   by the caller; or NULL on error
+ */
+CList CL_split(CList list, int pos);
+
+/*
+ * Move the elements at positions [start, end) of src into dest, so
+ * that the first moved element ends up at position dest_pos of
+ * dest. The moved elements keep their order. Nodes are relinked
+ * rather than copied.
+ *
+ * Example: If dest = A B C and src = V W X Y Z, after
+ * CL_splice(dest, 1, src, 1, 3) returns, dest will contain
+ * A W X B C and src will contain V Y Z.
+ *
+ * Parameters:
+ *   dest       The list receiving the elements
+ *   dest_pos   Position in dest, following the rules of CL_insert
+ *   src        The list the elements are taken from; must not be dest
+ *   start      First position of src to move
+ *   end        Position of src one past the last element to move
+ *
+ * start and end follow the rules of CL_split's pos, and after
+ * counting negative values from the end, start must be <= end.
+ *
+ * Returns: true if the operation was successful, false otherwise (in
+ *   which case neither list is changed)
+ */
+bool CL_splice(CList dest, int dest_pos, CList src, int start, int end);
+
+/*
+ * Find the first element of a list equal to key under strcmp. A
+ * CL_DEQUE list is searched with vector instructions over a cache of
+ * element prefixes, which is rebuilt on the first search after the
+ * list changes; a CL_new_keyed list uses the prefixes in its nodes.
+ *
+ * Parameters:
+ *   list     The list
+ *   key      The string to look for
+ *
+ * Returns: The position of the element, or -1 if there is none. For a
+ *   CL_PRIORITY list, the position counts in ascending order.
+ */
+int CL_find(CList list, CListElementType key);
+
+/*
+ * Count the elements of a list equal to key under strcmp, searching
+ * as CL_find does
+ *
+ * Parameters:
+ *   list     The list
+ *   key      The string to look for
+ *
+ * Returns: The number of equal elements
+ */
+int CL_count(CList list, CListElementType key);
+
+// How CL_find_adaptive rearranges a list after finding an element
+typedef enum {
+    CL_FIND_MOVE_TO_FRONT,  // move the element to the head
+    CL_FIND_TRANSPOSE,      // swap the element with the one before it
+    CL_FIND_COUNT,          // keep elements in order of how often they were found
+} CListFindPolicy;
+
+/*
+ * Find key as CL_find does, then move the element found toward the
+ * head, so that keys that are looked up often are found sooner: with
+ * skewed lookups the cost follows how popular the key is rather than
+ * the length of the list. Move-to-front adapts fastest; transpose
+ * moves one step per find and holds a steady ranking better; count
+ * orders elements by the number of times each string was found, and
+ * keeps those counts, which cost memory per string, until CL_free.
+ *
+ * On CL_LINKED the element is relinked in the same walk that finds
+ * it, and on CL_DLINKED handles stay valid. A CL_PRIORITY list is not
+ * rearranged. A durable list logs the move as one record;
+ * subscribers see a removal and an insertion.
+ *
+ * Parameters:
+ *   list     The list
+ *   key      The string to look for
+ *   policy   Where to move the element found
+ *
+ * Returns: The position of the element after moving it, or -1 if key
+ *   is not in the list
+ */
+int CL_find_adaptive(CList list, CListElementType key, CListFindPolicy policy);
+
+/*
+ * Return whether key is in the list, by strcmp. Without a filter (see
+ * CL_set_filter) this is a search as CL_find does; with one, most keys
+ * that are absent are turned away in O(1) without a search.
+ *
+ * Parameters:
+ *   list     The list
+ *   key      The string to look for
+ *
+ * Returns: true if an element equal to key is in the list
+ */
+bool CL_contains(CList list, CListElementType key);
+
+/*
+ * Keep a Bloom filter of the list's elements for CL_contains, or drop
+ * it when bits_per_element is 0. The filter is sized for twice the
+ * list's length at bits_per_element bits each; with ten, it lets
+ * through at most about one absent key in a hundred. It is built from
+ * the list at once and costs O(1) per insertion after that. Removed
+ * elements are not taken out; the filter is built again, at O(n),
+ * when half of what it holds has been removed, when the list has
+ * doubled, or after a CL_join or CL_splice. Not for concurrent lists,
+ * and not copied by CL_copy.
+ *
+ * Parameters:
+ *   list              The list
+ *   bits_per_element  Size of the filter, >= 0; 0 turns it off
+ *
+ * Returns: None
+ */
+void CL_set_filter(CList list, int bits_per_element);
+
+// Membership filter counters reported by CL_filter_stats; all zero
+// when the list has no filter
+typedef struct {
+    size_t bits;                    // size of the filter
+    int elements;                   // elements added since it was built
+    int stale;                      // of those, how many were removed since
+    unsigned long lookups;          // calls to CL_contains that used it
+    unsigned long rejected;         // lookups it answered without a search
+    unsigned long false_positives;  // lookups it let through for absent keys
+    unsigned long rebuilds;         // times it was built again as it filled up
+    double false_positive_rate;     // share of the absent keys it let through
+    double expected_rate;           // share it should let through, from the bits set
+} CListFilterStats;
+
+/*
+ * Report the membership filter counters of a list
+ *
+ * Parameters:
+ *   list     The list
+ *   stats    Filled in with the current counters
+ *
+ * Returns: None
+ */
+void CL_filter_stats(CList list, CListFilterStats *stats);
+
+/*
+ * Move the nodes of a list into one contiguous block of memory, in
+ * list order, so that walking the list reads memory sequentially. The
+ * list's cache of free nodes is emptied first. Costs O(n).
+ *
+ * On CL_TREE, nodes are laid out in order ignoring any reversal still
+ * pending in the tree; CL_DEQUE unwraps its array; CL_COMPACT
+ * renumbers its slab; CL_PRIORITY, and CL_DLINKED so that handles
+ * stay valid, are left as they are. Elements of a
+ * CL_new_inline list that are stored in nodes move with them, so
+ * pointers to them become invalid.
+ *
+ * Nodes removed from the block are reused by the list, and the block
+ * is freed once none of its nodes is left. Nodes of a compacted list
+ * only move by relinking to lists that share its block (its CL_split
+ * tails); CL_join and CL_splice into other lists copy elements over.
+ *
+ * Parameters:
+ *   list     The list
+ *
+ * Returns: None
+ */
+void CL_compact(CList list);
+
+/*
+ * Measure how scattered the nodes of a CL_LINKED list are: the
+ * fraction of links from one node to the next that jump more than a
+ * few cache lines in memory. Costs O(n).
+ *
+ * Parameters:
+ *   list     The list
+ *
+ * Returns: A value from 0 (every link is local) to 1; always 0 for
+ *   other backends and for lists without nodes
+ */
+double CL_fragmentation(CList list);
+
+/*
+ * Make a CL_LINKED list compact itself when it becomes fragmented.
+ * Each CL_foreach or CL_print over the list measures, as it walks,
+ * what CL_fragmentation would return, and calls CL_compact afterwards
+ * if that exceeds threshold. Lists of fewer than 64 elements are left
+ * alone. Has no effect on other backends.
+ *
+ * Parameters:
+ *   list        The list
+ *   threshold   Fragmentation from 0 to 1 above which to compact, or
+ *               0 to turn auto compaction off (the default)
+ *
+ * Returns: None
+ */
+void CL_set_auto_compact(CList list, double threshold);
+
 /*
  * Reverse a list.  Specifically, if the original list contained
  * A B C D (in that order), after a call to CL_reverse, the list
@@ -239,4 +909,284 @@ typedef void (*CL_foreach_callback)(int pos, CListElementType element, void *cb_
  */
 void CL_foreach(CList list, CL_foreach_callback callback, void *cb_data);
 
+/*
+ * A handle refers to one element of a CL_DLINKED list, so that it can
+ * be removed, moved or inserted next to in O(1) instead of by
+ * position. A handle stays valid until its element is removed, by any
+ * function, or its list is freed. CL_join, CL_split and CL_splice move
+ * handles along with their elements, except where they copy elements
+ * (see CL_new_owning).
+ *
+ * On a durable list, or one with subscribers, handle functions also
+ * work out the element's position, which costs O(position) unless it
+ * is at either end.
+ */
+typedef struct _cl_dnode *CListHandle;
+
+/*
+ * Insert an element at the head of a CL_DLINKED list, as CL_push
+ *
+ * Parameters:
+ *   list     The list
+ *   element  The element to insert
+ *
+ * Returns: A handle to the element
+ */
+CListHandle CL_push_h(CList list, CListElementType element);
+
+/*
+ * Append an element to a CL_DLINKED list, as CL_append. Costs O(1).
+ *
+ * Parameters:
+ *   list     The list
+ *   element  The element to append
+ *
+ * Returns: A handle to the element
+ */
+CListHandle CL_append_h(CList list, CListElementType element);
+
+/*
+ * Insert an element into a CL_DLINKED list at a position, as
+ * CL_insert. Costs O(distance from the nearer end).
+ *
+ * Parameters:
+ *   list     The list
+ *   element  The element to insert
+ *   pos      The position, as for CL_insert
+ *
+ * Returns: A handle to the element, or NULL if pos is out of range
+ */
+CListHandle CL_insert_h(CList list, CListElementType element, int pos);
+
+/*
+ * Insert an element into a CL_DLINKED list right after the element a
+ * handle refers to. Costs O(1).
+ *
+ * Parameters:
+ *   list     The list the handle's element is in
+ *   handle   The element to insert after
+ *   element  The element to insert
+ *
+ * Returns: A handle to the new element
+ */
+CListHandle CL_insert_after_h(CList list, CListHandle handle, CListElementType element);
+
+/*
+ * Remove the element a handle refers to from a CL_DLINKED list. The
+ * handle is invalid afterwards. Costs O(1).
+ *
+ * Parameters:
+ *   list     The list the handle's element is in
+ *   handle   The element to remove
+ *
+ * Returns: The removed element, as CL_remove
+ */
+CListElementType CL_remove_h(CList list, CListHandle handle);
+
+/*
+ * Move the element a handle refers to to the head of its CL_DLINKED
+ * list. The handle stays valid. Costs O(1).
+ *
+ * Parameters:
+ *   list     The list the handle's element is in
+ *   handle   The element to move
+ *
+ * Returns: None
+ */
+void CL_move_to_front_h(CList list, CListHandle handle);
+
+/*
+ * Return the element a handle refers to
+ *
+ * Parameters:
+ *   handle   A valid handle
+ *
+ * Returns: The element
+ */
+CListElementType CL_element_h(CListHandle handle);
+
+/*
+ * A subscription delivers the changes made to a list, in order, so
+ * that a copy of the list kept elsewhere can follow it. Subscribers
+ * read at their own pace from a ring the list writes into, and never
+ * make the list's writer wait; one that falls more than the ring
+ * (1 MiB of changes) behind loses changes and is told so.
+ *
+ * A list sends nothing until its first subscriber, so lists without
+ * subscribers pay only a NULL check per change.
+ */
+typedef struct _cl_subscription *CListSubscription;
+
+// What a change delivered by CL_next_change did to the list
+typedef enum {
+    CL_CHANGE_INSERT,   // element was inserted at pos
+    CL_CHANGE_REMOVE,   // count elements were removed from pos
+    CL_CHANGE_REVERSE,  // the list was reversed
+    CL_CHANGE_LOST,     // changes were missed; copy the list again to catch up
+} CListChangeKind;
+
+typedef struct {
+    CListChangeKind kind;
+    int pos;     // -1 for an insert into a CL_PRIORITY list, which orders
+                 // its elements itself
+    int count;   // elements inserted or removed
+    // The inserted or removed element, or NULL if a removal took more
+    // than one. Valid until the next CL_next_change.
+    CListElementType element;
+} CListChange;
+
+/*
+ * Subscribe to the changes made to a list from now on. Must be called
+ * by the thread that changes the list, or while it is not changing; a
+ * CL_copy taken at the same time is the state the changes apply to.
+ * The subscription may then be read from any one thread at a time.
+ * A subscription outlives its list: it still delivers the changes
+ * made before CL_free.
+ *
+ * Parameters:
+ *   list     The list
+ *
+ * Returns: The subscription, to be ended with CL_unsubscribe
+ */
+CListSubscription CL_subscribe(CList list);
+
+/*
+ * Take the next change from a subscription, without waiting. Never
+ * slows down the list's writer.
+ *
+ * Parameters:
+ *   subscription  The subscription
+ *   change        Filled in with the change, if there is one
+ *
+ * Returns: true if a change was taken, false if there is none yet
+ */
+bool CL_next_change(CListSubscription subscription, CListChange *change);
+
+/*
+ * End a subscription. May be called from any thread. Once a list has
+ * no subscribers, changes to it are no longer sent.
+ *
+ * Parameters:
+ *   subscription  The subscription
+ *
+ * Returns: None
+ */
+void CL_unsubscribe(CListSubscription subscription);
+
+/*
+ * A sharded list is one collection of elements spread over several
+ * CLists, its shards, for many threads adding elements at once. Each
+ * shard has its own lock and its own cache line, and CLS_push and
+ * CLS_append touch only one shard, so threads adding to different
+ * shards do not contend. Every function may be called from any
+ * thread.
+ *
+ * The collection has no single order: CLS_foreach and CLS_copy visit
+ * the shards one after the other, each in its own order, and CLS_merge
+ * produces one sorted sequence.
+ */
+typedef struct _clist_sharded *CListSharded;
+
+// How a sharded list chooses the shard for a new element
+typedef enum {
+    CL_SHARD_BY_THREAD,  // each thread adds to one shard, spreading threads evenly
+    CL_SHARD_BY_HASH,    // by a hash of the string, so equal strings share a shard
+} CLShardPolicy;
+
+/*
+ * Create a new, empty sharded list
+ *
+ * Parameters:
+ *   nshards  Number of shards, at least 1; about one per adding thread
+ *   backend  Backend of the shards. CL_DEQUE appends in O(1);
+ *            appending to CL_LINKED costs O(length of the shard).
+ *   policy   How elements are assigned to shards
+ *
+ * Returns: The new sharded list
+ */
+CListSharded CLS_new(int nshards, CListBackend backend, CLShardPolicy policy);
+
+/*
+ * Free a sharded list and all of its shards. No other thread may be
+ * using it.
+ *
+ * Parameters:
+ *   sharded  The sharded list
+ *
+ * Returns: None
+ */
+void CLS_free(CListSharded sharded);
+
+/*
+ * Add an element to the head of its shard, locking only that shard
+ *
+ * Parameters:
+ *   sharded  The sharded list
+ *   element  The element to add
+ *
+ * Returns: None
+ */
+void CLS_push(CListSharded sharded, CListElementType element);
+
+/*
+ * Add an element to the tail of its shard, locking only that shard
+ *
+ * Parameters:
+ *   sharded  The sharded list
+ *   element  The element to add
+ *
+ * Returns: None
+ */
+void CLS_append(CListSharded sharded, CListElementType element);
+
+/*
+ * Count the elements of every shard. Shards are counted one at a
+ * time, so elements added meanwhile may or may not be included.
+ *
+ * Parameters:
+ *   sharded  The sharded list
+ *
+ * Returns: The number of elements
+ */
+int CLS_length(CListSharded sharded);
+
+/*
+ * Call callback for each element of each shard, shard by shard, with
+ * positions counting on from one shard to the next. Each shard is
+ * locked while it is visited, so callback must not add to the
+ * sharded list.
+ *
+ * Parameters:
+ *   sharded    The sharded list
+ *   callback   The function to call
+ *   cb_data    Caller data to pass to the function
+ *
+ * Returns: None
+ */
+void CLS_foreach(CListSharded sharded, CL_foreach_callback callback, void *cb_data);
+
+/*
+ * Copy the elements of every shard, shard by shard, into one new list
+ * on the shards' backend
+ *
+ * Parameters:
+ *   sharded  The sharded list
+ *
+ * Returns: The new list, which the caller must free with CL_free
+ */
+CList CLS_copy(CListSharded sharded);
+
+/*
+ * Merge the elements of every shard into one new list in ascending
+ * strcmp order, on the shards' backend. Each shard's elements are
+ * sorted on their own, then the shards are merged k ways. Costs
+ * O(n log n).
+ *
+ * Parameters:
+ *   sharded  The sharded list
+ *
+ * Returns: The new list, which the caller must free with CL_free
+ */
+CList CLS_merge(CListSharded sharded);
+
 #endif /* _CLIST_H_ */
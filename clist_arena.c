@@ -0,0 +1,143 @@
+/*
+ * clist_arena.c
+ *
+ * String arena owned by a list. Strings are copied into large chunks
+ * with a bump pointer and are never freed individually; the whole
+ * arena is released at once. CL_compact_strings reclaims the strings
+ * of removed elements by copying the live ones into a new arena.
+ *
+ * Every byte in the arena has a 32-bit offset. Offsets are divided
+ * into slots of CL_ARENA_SLOT bytes, and slots[i] points at the memory
+ * backing slot i, so an offset is turned into a pointer with a shift,
+ * a mask and one load. A chunk covers a run of consecutive slots and
+ * never moves, so pointers handed out stay valid until the arena is
+ * freed.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "clist_impl.h"
+
+// Chunks start at one slot and double up to this size
+#define CL_ARENA_MAX_CHUNK ((size_t)1 << 20)
+
+/*
+ * Add a chunk of at least need bytes to the arena and move the bump
+ * pointer to its start
+ */
+static void _CL_arena_grow(CList list, struct _cl_arena *arena, size_t need) {
+    size_t size = arena->nchunks ? arena->chunks[arena->nchunks - 1].size * 2 : CL_ARENA_SLOT;
+    if (size > CL_ARENA_MAX_CHUNK) size = CL_ARENA_MAX_CHUNK;
+    if (size < need) size = (need + CL_ARENA_SLOT - 1) & ~(CL_ARENA_SLOT - 1);
+
+    const size_t nslots = size >> CL_ARENA_SLOT_SHIFT;
+    assert(((size_t)arena->nslots + nslots) << CL_ARENA_SLOT_SHIFT <= UINT32_MAX);
+
+    // Grow the chunk and slot tables, which are small, by copying
+    if (arena->nchunks == arena->chunks_cap) {
+        const uint32_t cap = arena->chunks_cap ? arena->chunks_cap * 2 : 8;
+        struct _cl_arena_chunk *chunks = _CL_alloc(list, cap * sizeof(*chunks));
+        if (arena->chunks) {
+            memcpy(chunks, arena->chunks, arena->nchunks * sizeof(*chunks));
+            _CL_dealloc(list, arena->chunks, arena->chunks_cap * sizeof(*chunks));
+        }
+        arena->chunks = chunks;
+        arena->chunks_cap = cap;
+    }
+    if (arena->nslots + nslots > arena->slots_cap) {
+        uint32_t cap = arena->slots_cap ? arena->slots_cap : 64;
+        while (cap < arena->nslots + nslots) cap *= 2;
+        char **slots = _CL_alloc(list, cap * sizeof(*slots));
+        if (arena->slots) {
+            memcpy(slots, arena->slots, arena->nslots * sizeof(*slots));
+            _CL_dealloc(list, arena->slots, arena->slots_cap * sizeof(*slots));
+        }
+        arena->slots = slots;
+        arena->slots_cap = cap;
+    }
+
+    char *base = _CL_alloc(list, size);
+    arena->chunks[arena->nchunks].base = base;
+    arena->chunks[arena->nchunks].size = size;
+    arena->nchunks++;
+
+    arena->top = arena->nslots << CL_ARENA_SLOT_SHIFT;
+    for (size_t i = 0; i < nslots; i++) {
+        arena->slots[arena->nslots++] = base + (i << CL_ARENA_SLOT_SHIFT);
+    }
+    arena->end = arena->top + size;
+}
+
+// Documented in clist_impl.h
+uint32_t _CL_arena_store(CList list, struct _cl_arena *arena, const char *s) {
+    const size_t n = strlen(s) + 1;
+    if (arena->end - arena->top < n) _CL_arena_grow(list, arena, n);
+
+    const uint32_t offset = arena->top;
+    memcpy(_CL_arena_ptr(arena, offset), s, n);
+    arena->top += n;
+    arena->used += n;
+    return offset;
+}
+
+// Documented in clist_impl.h
+void _CL_arena_free(CList list, struct _cl_arena *arena) {
+    for (uint32_t i = 0; i < arena->nchunks; i++) {
+        _CL_dealloc(list, arena->chunks[i].base, arena->chunks[i].size);
+    }
+    if (arena->chunks) {
+        _CL_dealloc(list, arena->chunks, arena->chunks_cap * sizeof(*arena->chunks));
+    }
+    if (arena->slots) {
+        _CL_dealloc(list, arena->slots, arena->slots_cap * sizeof(*arena->slots));
+    }
+    memset(arena, 0, sizeof(*arena));
+}
+
+// Documented in clist_impl.h
+CListElementType _CL_arena_adopt(CListElementType element, void *data) {
+    CList list = (CList)data;
+    return _CL_arena_ptr(&list->arena, _CL_arena_store(list, &list->arena, element));
+}
+
+// Arena being filled by CL_compact_strings
+struct _cl_restore {
+    CList list;
+    struct _cl_arena arena;
+};
+
+/*
+ * map function used by CL_compact_strings to copy each live string
+ * into the new arena
+ */
+static CListElementType _CL_arena_restore(CListElementType element, void *data) {
+    struct _cl_restore *restore = data;
+    return _CL_arena_ptr(&restore->arena, _CL_arena_store(restore->list, &restore->arena, element));
+}
+
+// Documented in .h file
+size_t CL_compact_strings(CList list) {
+    assert(list);
+
+    const size_t dead = list->arena.dead;
+    if (dead == 0) return 0;
+    _CL_view_invalidate(list);
+
+    if (list->backend == CL_COMPACT) {
+        _CL_compact_restore(list);
+        return dead;
+    }
+    if (!list->owning) {
+        // Only removed elements were put in the arena
+        _CL_arena_free(list, &list->arena);
+        return dead;
+    }
+
+    struct _cl_restore restore = {.list = list};
+    list->ops->map(list, _CL_arena_restore, &restore);
+    _CL_arena_free(list, &list->arena);
+    list->arena = restore.arena;
+    return dead;
+}
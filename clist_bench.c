@@ -0,0 +1,760 @@
+/*
+ * clist_bench.c
+ *
+ * Benchmarks for CLists. Build with `make bench`, which compiles
+ * without the sanitizer and with NDEBUG so the numbers reflect
+ * production builds.
+ */
+
+#include <malloc.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "clist.h"
+
+/*
+ * Return a monotonic timestamp in seconds
+ */
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Work done by each thread of the allocation benchmark
+#define ALLOC_ROUNDS 200
+#define ALLOC_BATCH 5000
+
+/*
+ * Thread body for bench_alloc_scaling: repeatedly fill a private list
+ * and drain it again. The list's own node cache is disabled so every
+ * node goes through the allocator under test.
+ */
+static void *alloc_worker(void *unused) {
+    (void)unused;
+    CList list = CL_new();
+    CL_set_cache_limit(list, 0);
+
+    for (int round = 0; round < ALLOC_ROUNDS; round++) {
+        for (int i = 0; i < ALLOC_BATCH; i++) CL_push(list, "x");
+        for (int i = 0; i < ALLOC_BATCH; i++) CL_pop(list);
+    }
+
+    CL_free(list);
+    return NULL;
+}
+
+/*
+ * Measure node allocation throughput as the number of threads
+ * building their own lists grows, with and without magazines
+ */
+static void bench_alloc_scaling(int max_threads) {
+    pthread_t threads[max_threads];
+
+    printf("Node allocation throughput (push+pop pairs, millions/s)\n");
+    printf("  %-8s %12s %12s\n", "threads", "malloc", "magazines");
+    for (int nthreads = 1; nthreads <= max_threads; nthreads *= 2) {
+        double rate[2];
+        for (int mag = 0; mag < 2; mag++) {
+            CL_set_magazines(mag);
+            double start = now();
+            for (int t = 0; t < nthreads; t++)
+                pthread_create(&threads[t], NULL, alloc_worker, NULL);
+            for (int t = 0; t < nthreads; t++) pthread_join(threads[t], NULL);
+            double elapsed = now() - start;
+            rate[mag] = (double)nthreads * ALLOC_ROUNDS * ALLOC_BATCH / elapsed / 1e6;
+            CL_flush_magazines();
+        }
+        printf("  %-8d %12.2f %12.2f\n", nthreads, rate[0], rate[1]);
+    }
+    CL_set_magazines(false);
+}
+
+// Number of elements held by the memory benchmark
+#define MEMORY_ELEMENTS 1000000
+
+/*
+ * Return the number of bytes currently allocated from the heap
+ */
+static size_t heap_in_use() {
+    return mallinfo2().uordblks;
+}
+
+/*
+ * Compare the heap footprint of a million short ids held by a linked
+ * list, with and without a private copy of each string, and by a
+ * compact list, which always holds a copy
+ */
+static void bench_memory() {
+    char (*ids)[16] = malloc(MEMORY_ELEMENTS * sizeof(*ids));
+    for (int i = 0; i < MEMORY_ELEMENTS; i++) snprintf(ids[i], sizeof(ids[i]), "id%07d", i);
+
+    printf("Heap bytes per element (%d ids of %zu bytes)\n", MEMORY_ELEMENTS, strlen(ids[0]) + 1);
+
+    size_t base = heap_in_use();
+    CList list = CL_new();
+    for (int i = 0; i < MEMORY_ELEMENTS; i++) CL_push(list, ids[i]);
+    printf("  %-24s %8.1f\n", "linked, borrowed", (double)(heap_in_use() - base) / MEMORY_ELEMENTS);
+    CL_free(list);
+
+    base = heap_in_use();
+    list = CL_new();
+    for (int i = 0; i < MEMORY_ELEMENTS; i++) CL_push(list, strdup(ids[i]));
+    printf("  %-24s %8.1f\n", "linked + strdup", (double)(heap_in_use() - base) / MEMORY_ELEMENTS);
+    while (CL_length(list)) free((char *)CL_pop(list));
+    CL_free(list);
+
+    base = heap_in_use();
+    list = CL_new_backend(CL_COMPACT);
+    for (int i = 0; i < MEMORY_ELEMENTS; i++) CL_push(list, ids[i]);
+    printf("  %-24s %8.1f\n", "compact (owns copies)", (double)(heap_in_use() - base) / MEMORY_ELEMENTS);
+    CL_free(list);
+
+    free(ids);
+}
+
+// Number of elements inserted by the sorted insertion benchmark
+#define SORTED_ELEMENTS 20000
+
+/*
+ * Time building a sorted list of random ids with CL_insert_sorted,
+ * on a plain linked list, a keyed one and an inline one
+ */
+static void bench_sorted_insert() {
+    char **ids = malloc(SORTED_ELEMENTS * sizeof(*ids));
+    srand(36);
+    for (int i = 0; i < SORTED_ELEMENTS; i++) {
+        char id[32];
+        snprintf(id, sizeof(id), "user:%08x", (unsigned)rand());
+        ids[i] = strdup(id);
+    }
+
+    printf("Sorted insertion of %d ids (ms)\n", SORTED_ELEMENTS);
+    const char *names[] = {"plain", "keyed", "inline"};
+    for (int kind = 0; kind < 3; kind++) {
+        CList list = kind == 0 ? CL_new() : kind == 1 ? CL_new_keyed() : CL_new_inline();
+        double start = now();
+        for (int i = 0; i < SORTED_ELEMENTS; i++) CL_insert_sorted(list, ids[i]);
+        printf("  %-24s %8.1f\n", names[kind], (now() - start) * 1e3);
+        CL_free(list);
+    }
+
+    for (int i = 0; i < SORTED_ELEMENTS; i++) free(ids[i]);
+    free(ids);
+}
+
+/*
+ * Time CL_insert_sorted on ids that arrive in order, or nearly so (one
+ * in a hundred swapped with a random other), and CL_insert_sorted_stream
+ * on ids in random order, on each backend that remembers where it last
+ * inserted
+ */
+static void bench_sorted_ingest() {
+    char (*ids)[16] = malloc(SORTED_ELEMENTS * sizeof(*ids));
+    for (int i = 0; i < SORTED_ELEMENTS; i++) snprintf(ids[i], sizeof(ids[i]), "user:%08d", i);
+    const char **nearly = malloc(SORTED_ELEMENTS * sizeof(*nearly));
+    const char **shuffled = malloc(SORTED_ELEMENTS * sizeof(*shuffled));
+    for (int i = 0; i < SORTED_ELEMENTS; i++) nearly[i] = shuffled[i] = ids[i];
+    srand(49);
+    for (int i = 0; i < SORTED_ELEMENTS; i++) {
+        const int j = rand() % SORTED_ELEMENTS;
+        const char *temp = shuffled[i];
+        shuffled[i] = shuffled[j];
+        shuffled[j] = temp;
+        if (i % 100 == 0) {
+            temp = nearly[i];
+            nearly[i] = nearly[j];
+            nearly[j] = temp;
+        }
+    }
+
+    printf("Sorted ingest of %d ids (ms)\n", SORTED_ELEMENTS);
+    const CListBackend backends[] = {CL_LINKED, CL_DLINKED, CL_DEQUE};
+    const char *names[] = {"linked", "dlinked", "deque"};
+    for (int b = 0; b < 3; b++) {
+        for (int mode = 0; mode < 3; mode++) {
+            CList list = CL_new_backend(backends[b]);
+            double start = now();
+            if (mode == 2) {
+                CL_insert_sorted_stream(list, shuffled, SORTED_ELEMENTS);
+            } else {
+                for (int i = 0; i < SORTED_ELEMENTS; i++) {
+                    CL_insert_sorted(list, mode == 0 ? ids[i] : nearly[i]);
+                }
+            }
+            char label[32];
+            snprintf(label, sizeof(label), "%s, %s", names[b],
+                     mode == 0 ? "in order" : mode == 1 ? "nearly" : "stream");
+            printf("  %-24s %8.1f\n", label, (now() - start) * 1e3);
+            CL_free(list);
+        }
+    }
+
+    free(shuffled);
+    free(nearly);
+    free(ids);
+}
+
+// Number of elements searched and searches made by the find benchmark
+#define FIND_ELEMENTS 1000000
+#define FIND_ROUNDS 20
+
+/*
+ * Time CL_count over a million ids on a linked list, which compares
+ * every string, and on a deque, which compares cached prefixes with
+ * vector instructions
+ */
+static void bench_find() {
+    char (*ids)[16] = malloc(FIND_ELEMENTS * sizeof(*ids));
+    for (int i = 0; i < FIND_ELEMENTS; i++) snprintf(ids[i], sizeof(ids[i]), "id%07d", i);
+
+    printf("CL_count over %d ids (ms per search)\n", FIND_ELEMENTS);
+    const CListBackend backends[] = {CL_LINKED, CL_DEQUE};
+    const char *names[] = {"linked", "deque"};
+    for (int b = 0; b < 2; b++) {
+        CList list = CL_new_backend(backends[b]);
+        for (int i = FIND_ELEMENTS - 1; i >= 0; i--) CL_push(list, ids[i]);
+        // The first search on the deque builds its prefix cache
+        double start = now();
+        CL_count(list, "id0000000");
+        double first = now() - start;
+        start = now();
+        for (int i = 0; i < FIND_ROUNDS; i++) CL_count(list, ids[i * 997]);
+        printf("  %-24s %8.2f (first %.2f)\n", names[b], (now() - start) * 1e3 / FIND_ROUNDS,
+               first * 1e3);
+        CL_free(list);
+    }
+
+    free(ids);
+}
+
+// Size of the scattered list walked by the prefetch benchmark, and the
+// number of lists it is spread over while being built
+#define SCATTER_ELEMENTS 1000000
+#define SCATTER_LISTS 4096
+
+/*
+ * CL_foreach callback for bench_prefetch that reads each string
+ */
+static void sum_first_bytes(int pos, CListElementType element, void *cb_data) {
+    (void)pos;
+    *(unsigned long *)cb_data += (unsigned char)element[0];
+}
+
+/*
+ * Build a linked list of SCATTER_ELEMENTS ids whose nodes, and strings,
+ * are scattered across the heap: push onto randomly chosen lists, so
+ * that neighbouring nodes of any one list were allocated far apart,
+ * then chain the lists together
+ *
+ * Returns: The list
+ */
+static CList scattered_list(char (*ids)[16]) {
+    static CList lists[SCATTER_LISTS];
+    srand(39);
+    for (int i = 0; i < SCATTER_LISTS; i++) lists[i] = CL_new();
+    for (int i = 0; i < SCATTER_ELEMENTS; i++) {
+        CL_push(lists[rand() % SCATTER_LISTS], ids[rand() % SCATTER_ELEMENTS]);
+    }
+    CList list = lists[SCATTER_LISTS - 1];
+    for (int i = SCATTER_LISTS - 2; i >= 0; i--) {
+        CL_join(lists[i], list);
+        CL_free(list);
+        list = lists[i];
+    }
+    return list;
+}
+
+/*
+ * Time walks over a scattered linked list at several prefetch
+ * distances, then after CL_compact
+ */
+static void bench_prefetch() {
+    char (*ids)[16] = malloc(SCATTER_ELEMENTS * sizeof(*ids));
+    for (int i = 0; i < SCATTER_ELEMENTS; i++) snprintf(ids[i], sizeof(ids[i]), "id%07d", i);
+    CList list = scattered_list(ids);
+
+    printf("Walks over %d scattered nodes (ms)\n", SCATTER_ELEMENTS);
+    printf("  %-12s %10s %10s %10s\n", "distance", "foreach", "nth(-1)", "copy+free");
+    const int distances[] = {0, 1, 2, 4, 8, 16, -1};
+    for (int d = 0; d < 7; d++) {
+        char label[16];
+        if (distances[d] < 0) {
+            // Last row: the same walks once the list is compacted
+            CL_set_prefetch_distance(0);
+            printf("  fragmentation %.2f", CL_fragmentation(list));
+            CL_compact(list);
+            printf(" -> %.2f after CL_compact\n", CL_fragmentation(list));
+            snprintf(label, sizeof(label), "compacted");
+        } else {
+            CL_set_prefetch_distance(distances[d]);
+            snprintf(label, sizeof(label), "%d", distances[d]);
+        }
+        unsigned long sum = 0;
+        double start = now();
+        CL_foreach(list, sum_first_bytes, &sum);
+        double foreach = now() - start;
+        start = now();
+        CL_nth(list, -1);
+        double nth = now() - start;
+        start = now();
+        CL_free(CL_copy(list));
+        double copy = now() - start;
+        printf("  %-12s %10.2f %10.2f %10.2f\n", label, foreach * 1e3, nth * 1e3, copy * 1e3);
+    }
+
+    CL_free(list);
+    free(ids);
+}
+
+// Size of the lists read by the freeze benchmark, and reads made
+#define FREEZE_ELEMENTS 100000
+#define FREEZE_READS 2000
+
+/*
+ * Time random CL_nth reads on each backend, as it is and frozen; the
+ * frozen time includes building the array
+ */
+static void bench_freeze() {
+    char (*ids)[16] = malloc(FREEZE_ELEMENTS * sizeof(*ids));
+    for (int i = 0; i < FREEZE_ELEMENTS; i++) snprintf(ids[i], sizeof(ids[i]), "id%07d", i);
+
+    printf("%d random CL_nth over %d elements (ms)\n", FREEZE_READS, FREEZE_ELEMENTS);
+    printf("  %-12s %10s %10s\n", "backend", "plain", "frozen");
+    const CListBackend backends[] = {CL_LINKED, CL_TREE, CL_DEQUE, CL_COMPACT};
+    const char *names[] = {"linked", "tree", "deque", "compact"};
+    for (int b = 0; b < 4; b++) {
+        CList list = CL_new_backend(backends[b]);
+        for (int i = FREEZE_ELEMENTS - 1; i >= 0; i--) CL_push(list, ids[i]);
+        double times[2];
+        for (int frozen = 0; frozen < 2; frozen++) {
+            if (frozen) CL_freeze(list);
+            srand(41);
+            const double start = now();
+            for (int i = 0; i < FREEZE_READS; i++) CL_nth(list, rand() % FREEZE_ELEMENTS);
+            times[frozen] = now() - start;
+        }
+        printf("  %-12s %10.2f %10.2f\n", names[b], times[0] * 1e3, times[1] * 1e3);
+        CL_free(list);
+    }
+
+    free(ids);
+}
+
+// Shape of the concurrent read benchmark: list length, reads made by
+// each reader, and the pause between the writer's changes
+#define CONCURRENT_ELEMENTS 64
+#define CONCURRENT_READS 2000000
+#define CONCURRENT_WRITE_PAUSE_NS 20000
+
+// State shared by the threads of bench_concurrent
+struct concurrent_bench {
+    CList list;
+    pthread_rwlock_t lock;
+    bool use_lock;  // plain list behind lock, or a CL_new_concurrent list
+    volatile bool done;
+};
+
+/*
+ * Reader thread for bench_concurrent
+ */
+static void *concurrent_bench_reader(void *arg) {
+    struct concurrent_bench *b = arg;
+    for (int i = 0; i < CONCURRENT_READS; i++) {
+        if (b->use_lock) pthread_rwlock_rdlock(&b->lock);
+        CL_nth(b->list, i % (CONCURRENT_ELEMENTS / 2));
+        if (b->use_lock) pthread_rwlock_unlock(&b->lock);
+    }
+    return NULL;
+}
+
+/*
+ * Writer thread for bench_concurrent: replace an element now and then
+ * until the readers are done
+ */
+static void *concurrent_bench_writer(void *arg) {
+    struct concurrent_bench *b = arg;
+    const struct timespec pause = {0, CONCURRENT_WRITE_PAUSE_NS};
+    for (int i = 0; !b->done; i++) {
+        if (b->use_lock) pthread_rwlock_wrlock(&b->lock);
+        CL_remove(b->list, i % CONCURRENT_ELEMENTS);
+        CL_insert(b->list, "y", i % CONCURRENT_ELEMENTS);
+        if (b->use_lock) pthread_rwlock_unlock(&b->lock);
+        nanosleep(&pause, NULL);
+    }
+    return NULL;
+}
+
+/*
+ * Measure CL_nth throughput on a short list as readers are added,
+ * while one writer changes it, for a plain list behind a reader-writer
+ * lock and for a CL_new_concurrent list
+ */
+static void bench_concurrent(int max_threads) {
+    pthread_t threads[max_threads];
+    pthread_t writer;
+
+    printf("Reads alongside a writer (millions of CL_nth/s)\n");
+    printf("  %-8s %12s %12s\n", "readers", "rwlock", "concurrent");
+    for (int nthreads = 1; nthreads <= max_threads; nthreads *= 2) {
+        double rate[2];
+        for (int mode = 0; mode < 2; mode++) {
+            struct concurrent_bench b = {.use_lock = mode == 0, .done = false};
+            b.list = mode == 0 ? CL_new() : CL_new_concurrent();
+            pthread_rwlock_init(&b.lock, NULL);
+            for (int i = 0; i < CONCURRENT_ELEMENTS; i++) CL_push(b.list, "x");
+
+            pthread_create(&writer, NULL, concurrent_bench_writer, &b);
+            const double start = now();
+            for (int t = 0; t < nthreads; t++) {
+                pthread_create(&threads[t], NULL, concurrent_bench_reader, &b);
+            }
+            for (int t = 0; t < nthreads; t++) pthread_join(threads[t], NULL);
+            rate[mode] = (double)nthreads * CONCURRENT_READS / (now() - start) / 1e6;
+            b.done = true;
+            pthread_join(writer, NULL);
+
+            pthread_rwlock_destroy(&b.lock);
+            CL_free(b.list);
+        }
+        printf("  %-8d %12.1f %12.1f\n", nthreads, rate[0], rate[1]);
+    }
+}
+
+// Appends made by each thread of the sharded benchmark
+#define SHARDED_APPENDS 500000
+
+// State shared by the threads of bench_sharded
+struct sharded_bench {
+    CList list;  // with lock, when sharded is NULL
+    pthread_mutex_t lock;
+    CListSharded sharded;
+};
+
+/*
+ * Thread body for bench_sharded
+ */
+static void *sharded_bench_worker(void *arg) {
+    struct sharded_bench *b = arg;
+    for (int i = 0; i < SHARDED_APPENDS; i++) {
+        if (b->sharded) {
+            CLS_append(b->sharded, "x");
+        } else {
+            pthread_mutex_lock(&b->lock);
+            CL_append(b->list, "x");
+            pthread_mutex_unlock(&b->lock);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Measure append throughput as threads are added, for one deque
+ * behind a mutex and for a sharded list with a deque per thread
+ */
+static void bench_sharded(int max_threads) {
+    pthread_t threads[max_threads];
+
+    printf("Parallel appends (millions/s)\n");
+    printf("  %-8s %12s %12s\n", "threads", "one list", "sharded");
+    for (int nthreads = 1; nthreads <= max_threads; nthreads *= 2) {
+        double rate[2];
+        for (int mode = 0; mode < 2; mode++) {
+            struct sharded_bench b = {NULL, PTHREAD_MUTEX_INITIALIZER, NULL};
+            if (mode == 0) {
+                b.list = CL_new_backend(CL_DEQUE);
+            } else {
+                b.sharded = CLS_new(nthreads, CL_DEQUE, CL_SHARD_BY_THREAD);
+            }
+            const double start = now();
+            for (int t = 0; t < nthreads; t++) {
+                pthread_create(&threads[t], NULL, sharded_bench_worker, &b);
+            }
+            for (int t = 0; t < nthreads; t++) pthread_join(threads[t], NULL);
+            rate[mode] = (double)nthreads * SHARDED_APPENDS / (now() - start) / 1e6;
+            if (b.list) CL_free(b.list);
+            if (b.sharded) CLS_free(b.sharded);
+        }
+        printf("  %-8d %12.1f %12.1f\n", nthreads, rate[0], rate[1]);
+    }
+}
+
+// Elements written by the serialization benchmark
+#define WRITE_ELEMENTS 1000000
+
+/*
+ * CL_foreach callback for bench_write: print one entry the way
+ * CL_print used to
+ */
+static void fprintf_element(int pos, CListElementType element, void *cb_data) {
+    fprintf((FILE *)cb_data, "  [%d]: %s\n", pos, element);
+}
+
+/*
+ * Time writing a million entries to a temporary file with one fprintf
+ * per element and with CL_write, and formatting them with CL_to_string
+ */
+static void bench_write() {
+    char (*ids)[16] = malloc(WRITE_ELEMENTS * sizeof(*ids));
+    for (int i = 0; i < WRITE_ELEMENTS; i++) snprintf(ids[i], sizeof(ids[i]), "id%07d", i);
+    CList list = CL_new_backend(CL_DEQUE);
+    for (int i = 0; i < WRITE_ELEMENTS; i++) CL_append(list, ids[i]);
+
+    printf("Writing %d entries (ms)\n", WRITE_ELEMENTS);
+    FILE *file = tmpfile();
+    double start = now();
+    CL_foreach(list, fprintf_element, file);
+    fflush(file);
+    printf("  %-24s %8.1f\n", "fprintf per element", (now() - start) * 1e3);
+    fclose(file);
+
+    file = tmpfile();
+    start = now();
+    CL_write(list, fileno(file), CL_FORMAT_INDEXED);
+    printf("  %-24s %8.1f\n", "CL_write", (now() - start) * 1e3);
+    fclose(file);
+
+    const size_t size = CL_to_string(list, NULL, 0, CL_FORMAT_INDEXED) + 1;
+    char *buf = malloc(size);
+    start = now();
+    CL_to_string(list, buf, size, CL_FORMAT_INDEXED);
+    printf("  %-24s %8.1f\n", "CL_to_string", (now() - start) * 1e3);
+    free(buf);
+
+    CL_free(list);
+    free(ids);
+}
+
+// Changes made to a durable list by its benchmark
+#define DURABLE_CHANGES 200000
+
+/*
+ * Time appending to and popping from a durable list with every change
+ * committed on its own and with the default group commit, against the
+ * same changes to a list in memory
+ */
+static void bench_durable() {
+    char dir[] = "/tmp/clist_bench_XXXXXX";
+    if (!mkdtemp(dir)) return;
+    char path[64], journal[64];
+    snprintf(path, sizeof(path), "%s/list", dir);
+    snprintf(journal, sizeof(journal), "%s/list.journal", dir);
+
+    printf("Making %d changes to a durable list (ms)\n", DURABLE_CHANGES);
+    const char *labels[] = {"in memory", "group commit 10 ms", "commit every change"};
+    for (int mode = 0; mode < 3; mode++) {
+        // Committing every change is slow enough that fewer are timed
+        const int changes = mode == 2 ? DURABLE_CHANGES / 100 : DURABLE_CHANGES;
+        CList list = mode == 0 ? CL_new_owning(CL_DEQUE) : CL_open_durable(path, CL_DEQUE);
+        if (mode == 2) CL_set_group_commit(list, 0);
+        double start = now();
+        for (int i = 0; i < changes; i++) {
+            CL_append(list, "change");
+            if (i % 2) CL_pop(list);
+        }
+        if (mode) CL_sync(list);
+        const double elapsed = (now() - start) * 1e3 * DURABLE_CHANGES / changes;
+        printf("  %-24s %8.1f%s\n", labels[mode], elapsed, mode == 2 ? " (scaled)" : "");
+        CL_free(list);
+        unlink(path);
+        unlink(journal);
+    }
+    rmdir(dir);
+}
+
+// Changes made by the change feed benchmark
+#define FEED_CHANGES 2000000
+
+/*
+ * Time appending to and popping from a list with no subscribers, and
+ * with one that reads every change
+ */
+static void bench_feed() {
+    printf("Making %d changes to a list (ms)\n", FEED_CHANGES);
+    const char *labels[] = {"no subscribers", "one subscriber"};
+    for (int mode = 0; mode < 2; mode++) {
+        CList list = CL_new_backend(CL_DEQUE);
+        CListSubscription subscription = mode ? CL_subscribe(list) : NULL;
+        CListChange change;
+        double start = now();
+        for (int i = 0; i < FEED_CHANGES; i++) {
+            CL_append(list, "change");
+            if (i % 2) CL_pop(list);
+            // Read often enough not to be lapped
+            if (subscription && i % 1024 == 0) {
+                while (CL_next_change(subscription, &change)) continue;
+            }
+        }
+        if (subscription) {
+            while (CL_next_change(subscription, &change)) continue;
+        }
+        printf("  %-24s %8.1f\n", labels[mode], (now() - start) * 1e3);
+        if (subscription) CL_unsubscribe(subscription);
+        CL_free(list);
+    }
+}
+
+// Keys, capacity and accesses of the LRU cache benchmark
+#define LRU_KEYS 4000
+#define LRU_CAP 2000
+#define LRU_ACCESSES 50000
+
+/*
+ * Time an LRU cache kept in a list, with a handle per cached key (the
+ * array standing in for a hash map) and by searching for the key
+ */
+static void bench_lru() {
+    char (*ids)[16] = malloc(LRU_KEYS * sizeof(*ids));
+    for (int i = 0; i < LRU_KEYS; i++) snprintf(ids[i], sizeof(ids[i]), "key%05d", i);
+    int *keys = malloc(LRU_ACCESSES * sizeof(int));
+    srand(47);
+    for (int i = 0; i < LRU_ACCESSES; i++) keys[i] = rand() % LRU_KEYS;
+
+    printf("LRU cache of %d keys, %d accesses (ms)\n", LRU_CAP, LRU_ACCESSES);
+    CList list = CL_new();
+    double start = now();
+    for (int i = 0; i < LRU_ACCESSES; i++) {
+        const int pos = CL_find(list, ids[keys[i]]);
+        CL_push(list, pos >= 0 ? CL_remove(list, pos) : ids[keys[i]]);
+        if (CL_length(list) > LRU_CAP) CL_remove(list, -1);
+    }
+    printf("  %-24s %8.1f\n", "CL_LINKED by position", (now() - start) * 1e3);
+    CL_free(list);
+
+    CListHandle *handles = calloc(LRU_KEYS, sizeof(CListHandle));
+    list = CL_new_backend(CL_DLINKED);
+    start = now();
+    for (int i = 0; i < LRU_ACCESSES; i++) {
+        const int key = keys[i];
+        if (handles[key]) {
+            CL_move_to_front_h(list, handles[key]);
+            continue;
+        }
+        handles[key] = CL_push_h(list, ids[key]);
+        if (CL_length(list) > LRU_CAP) {
+            // The evicted key is recovered from its string
+            const int victim = atoi(CL_nth(list, -1) + 3);
+            CL_remove_h(list, handles[victim]);
+            handles[victim] = NULL;
+        }
+    }
+    printf("  %-24s %8.1f\n", "CL_DLINKED with handles", (now() - start) * 1e3);
+    CL_free(list);
+
+    free(handles);
+    free(keys);
+    free(ids);
+}
+
+// Elements and lookups of the adaptive find benchmark
+#define ADAPTIVE_KEYS 5000
+#define ADAPTIVE_LOOKUPS 200000
+
+/*
+ * Time lookups skewed towards a few keys, as most real lookups are,
+ * with CL_find and with each CL_find_adaptive policy
+ */
+static void bench_find_adaptive() {
+    char (*ids)[16] = malloc(ADAPTIVE_KEYS * sizeof(*ids));
+    for (int i = 0; i < ADAPTIVE_KEYS; i++) snprintf(ids[i], sizeof(ids[i]), "key%05d", i);
+    // Skewed towards low keys: half of the lookups are of the lowest
+    // sixteenth of them
+    int *keys = malloc(ADAPTIVE_LOOKUPS * sizeof(int));
+    srand(48);
+    for (int i = 0; i < ADAPTIVE_LOOKUPS; i++) {
+        const double u = (double)rand() / ((double)RAND_MAX + 1);
+        keys[i] = (int)(ADAPTIVE_KEYS * u * u * u * u);
+    }
+
+    printf("Skewed lookups of %d keys, %d lookups (ms)\n", ADAPTIVE_KEYS, ADAPTIVE_LOOKUPS);
+    const char *labels[] = {"CL_find", "move to front", "transpose", "count"};
+    for (int mode = 0; mode < 4; mode++) {
+        // The most looked up keys start at the back
+        CList list = CL_new();
+        for (int i = 0; i < ADAPTIVE_KEYS; i++) CL_push(list, ids[i]);
+        double start = now();
+        for (int i = 0; i < ADAPTIVE_LOOKUPS; i++) {
+            if (mode == 0) {
+                CL_find(list, ids[keys[i]]);
+            } else {
+                CL_find_adaptive(list, ids[keys[i]], (CListFindPolicy)(mode - 1));
+            }
+        }
+        printf("  %-24s %8.1f\n", labels[mode], (now() - start) * 1e3);
+        CL_free(list);
+    }
+
+    free(keys);
+    free(ids);
+}
+
+// Elements and probes of the membership filter benchmark
+#define FILTER_ELEMENTS 200000
+#define FILTER_PROBES 2000
+
+/*
+ * Time CL_contains probes, nearly all misses, on a large list with and
+ * without a membership filter, and report the filter's counters
+ */
+static void bench_filter() {
+    char (*ids)[16] = malloc((FILTER_ELEMENTS + FILTER_PROBES) * sizeof(*ids));
+    for (int i = 0; i < FILTER_ELEMENTS + FILTER_PROBES; i++) {
+        snprintf(ids[i], sizeof(ids[i]), "id%07d", i);
+    }
+    CList list = CL_new();
+    for (int i = FILTER_ELEMENTS - 1; i >= 0; i--) CL_push(list, ids[i]);
+
+    printf("CL_contains, %d probes of %d ids, 1%% present (ms)\n", FILTER_PROBES,
+           FILTER_ELEMENTS);
+    for (int bits = 0; bits <= 10; bits += 10) {
+        double start = now();
+        CL_set_filter(list, bits);
+        const double build = now() - start;
+        start = now();
+        for (int i = 0; i < FILTER_PROBES; i++) {
+            // One probe in a hundred is of an element in the list
+            CL_contains(list, ids[i % 100 == 0 ? i : FILTER_ELEMENTS + i]);
+        }
+        const double probes = now() - start;
+        if (bits == 0) {
+            printf("  %-24s %8.1f\n", "no filter", probes * 1e3);
+            continue;
+        }
+        CListFilterStats stats;
+        CL_filter_stats(list, &stats);
+        printf("  %-24s %8.1f (%.1f ms to build, %.2f%% false positives, %.2f%% expected)\n",
+               "10 bits per element", probes * 1e3, build * 1e3,
+               stats.false_positive_rate * 100, stats.expected_rate * 100);
+    }
+    CL_free(list);
+    free(ids);
+}
+
+int main(int argc, char *argv[]) {
+    (void)argc;
+    (void)argv;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads = (ncpu > 4) ? (int)ncpu : 4;
+
+    bench_alloc_scaling(max_threads);
+    bench_memory();
+    bench_sorted_insert();
+    bench_sorted_ingest();
+    bench_find();
+    bench_prefetch();
+    bench_freeze();
+    bench_concurrent(max_threads);
+    bench_sharded(max_threads);
+    bench_write();
+    bench_durable();
+    bench_feed();
+    bench_lru();
+    bench_find_adaptive();
+    bench_filter();
+
+    return 0;
+}
@@ -0,0 +1,214 @@
+/*
+ * clist_bloom.c
+ *
+ * Membership filters (see CL_set_filter): a blocked Bloom filter kept
+ * next to a list so that CL_contains can answer most misses without
+ * scanning it.
+ *
+ * The filter is an array of 512-bit blocks, one cache line each. An
+ * element's hash picks one block and sets one bit in each of its eight
+ * words, so adding or testing an element touches a single line.
+ *
+ * Every insertion adds the element's hash. A Bloom filter cannot take
+ * one out again, so removals are only counted; once half of what the
+ * filter holds has been removed, or more has been added than it was
+ * sized for, the next CL_contains builds it again from the list.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "clist_impl.h"
+
+// Words in a block, and so bits set per element; a block is 512 bits
+#define CL_FILTER_WORDS 8
+
+// The fewest elements a filter is sized for
+#define CL_FILTER_MIN 64
+
+struct _cl_filter {
+    uint64_t *blocks;  // nblocks blocks of CL_FILTER_WORDS words
+    uint32_t nblocks;
+    int bits_per_element;
+    int capacity;  // elements the filter was sized for
+    int added;     // elements added since it was built
+    int stale;     // of those, how many have been removed since
+    bool invalid;  // must be built again before it is used
+    unsigned long lookups;
+    unsigned long rejected;
+    unsigned long false_positives;
+    unsigned long rebuilds;
+};
+
+/*
+ * Return the hash of a string run through the finalizer of splitmix64,
+ * so that every bit depends on every byte
+ */
+static inline uint64_t _CL_filter_hash(const char *s) {
+    uint64_t hash = _CL_hash(s);
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+    return hash ^ (hash >> 31);
+}
+
+/*
+ * Return the block a hash falls in. The top 32 bits choose it, and the
+ * bottom 48 choose its bits, six for each word.
+ */
+static inline uint64_t *_CL_filter_block(const struct _cl_filter *filter, uint64_t hash) {
+    return &filter->blocks[((hash >> 32) * filter->nblocks >> 32) * CL_FILTER_WORDS];
+}
+
+/*
+ * Set the bits of hash in the filter
+ */
+static inline void _CL_filter_set(struct _cl_filter *filter, uint64_t hash) {
+    uint64_t *block = _CL_filter_block(filter, hash);
+    for (int w = 0; w < CL_FILTER_WORDS; w++) block[w] |= 1ull << ((hash >> (6 * w)) & 63);
+}
+
+/*
+ * Return whether every bit of hash is set in the filter
+ */
+static inline bool _CL_filter_test(const struct _cl_filter *filter, uint64_t hash) {
+    const uint64_t *block = _CL_filter_block(filter, hash);
+    uint64_t missing = 0;
+    for (int w = 0; w < CL_FILTER_WORDS; w++) {
+        missing |= ~block[w] & (1ull << ((hash >> (6 * w)) & 63));
+    }
+    return missing == 0;
+}
+
+/*
+ * CL_foreach callback that adds one element to a filter being built
+ */
+static void _CL_filter_build_element(int pos, CListElementType element, void *cb_data) {
+    (void)pos;
+    _CL_filter_set(cb_data, _CL_filter_hash(element));
+}
+
+/*
+ * Size the filter of list for twice the list's length and fill it with
+ * the list's elements
+ */
+static void _CL_filter_build(CList list) {
+    struct _cl_filter *filter = list->filter;
+    const int capacity = list->length < CL_FILTER_MIN / 2 ? CL_FILTER_MIN : 2 * list->length;
+    const uint64_t bits = (uint64_t)capacity * filter->bits_per_element;
+    const uint32_t nblocks = (uint32_t)((bits + 64 * CL_FILTER_WORDS - 1) / (64 * CL_FILTER_WORDS));
+    const size_t block_size = CL_FILTER_WORDS * sizeof(uint64_t);
+
+    if (nblocks != filter->nblocks) {
+        if (filter->blocks) _CL_dealloc(list, filter->blocks, filter->nblocks * block_size);
+        filter->blocks = (uint64_t *)_CL_alloc(list, nblocks * block_size);
+        filter->nblocks = nblocks;
+    }
+    memset(filter->blocks, 0, nblocks * block_size);
+    filter->capacity = capacity;
+    list->ops->foreach(list, _CL_filter_build_element, filter);
+    filter->added = list->length;
+    filter->stale = 0;
+    filter->invalid = false;
+}
+
+// Documented in clist_impl.h
+void _CL_filter_add(CList list, CListElementType element) {
+    struct _cl_filter *filter = list->filter;
+    if (filter->invalid) return;
+    _CL_filter_set(filter, _CL_filter_hash(element));
+    filter->added++;
+}
+
+// Documented in clist_impl.h
+void _CL_filter_removed(CList list, int count) {
+    list->filter->stale += count;
+}
+
+// Documented in clist_impl.h
+void _CL_filter_invalidate(CList list) {
+    list->filter->invalid = true;
+}
+
+// Documented in .h file
+void CL_set_filter(CList list, int bits_per_element) {
+    assert(list);
+    assert(bits_per_element >= 0);
+
+    struct _cl_filter *filter = list->filter;
+    if (bits_per_element == 0) {
+        if (filter == NULL) return;
+        if (filter->blocks) {
+            _CL_dealloc(list, filter->blocks,
+                        filter->nblocks * CL_FILTER_WORDS * sizeof(uint64_t));
+        }
+        _CL_dealloc(list, filter, sizeof(struct _cl_filter));
+        list->filter = NULL;
+        return;
+    }
+
+    // Concurrent readers would race with the rebuilds
+    assert(list->ops != &_CL_rcu_ops);
+    if (filter == NULL) {
+        filter = list->filter = (struct _cl_filter *)_CL_alloc(list, sizeof(struct _cl_filter));
+        memset(filter, 0, sizeof(*filter));
+    }
+    filter->bits_per_element = bits_per_element;
+    _CL_filter_build(list);
+}
+
+// Documented in .h file
+bool CL_contains(CList list, CListElementType key) {
+    assert(list);
+    assert(key);
+
+    struct _cl_filter *filter = list->filter;
+    if (filter == NULL) return list->ops->find(list, key, false) >= 0;
+
+    if (filter->invalid || filter->added > filter->capacity || 2 * filter->stale > filter->added) {
+        _CL_filter_build(list);
+        filter->rebuilds++;
+    }
+    filter->lookups++;
+    if (!_CL_filter_test(filter, _CL_filter_hash(key))) {
+        filter->rejected++;
+        return false;
+    }
+
+    const bool found = list->ops->find(list, key, false) >= 0;
+    if (!found) filter->false_positives++;
+    return found;
+}
+
+// Documented in .h file
+void CL_filter_stats(CList list, CListFilterStats *stats) {
+    assert(list);
+    assert(stats);
+    memset(stats, 0, sizeof(*stats));
+
+    const struct _cl_filter *filter = list->filter;
+    if (filter == NULL) return;
+    stats->bits = (size_t)filter->nblocks * CL_FILTER_WORDS * 64;
+    stats->elements = filter->added;
+    stats->stale = filter->stale;
+    stats->lookups = filter->lookups;
+    stats->rejected = filter->rejected;
+    stats->false_positives = filter->false_positives;
+    stats->rebuilds = filter->rebuilds;
+    if (filter->rejected + filter->false_positives) {
+        stats->false_positive_rate =
+            (double)filter->false_positives / (filter->rejected + filter->false_positives);
+    }
+
+    // An absent key passes if each of its eight bits is set, which in
+    // a given word happens as often as that word's bits are set
+    double expected = 0;
+    for (uint32_t b = 0; b < filter->nblocks; b++) {
+        double pass = 1;
+        for (int w = 0; w < CL_FILTER_WORDS; w++) {
+            pass *= __builtin_popcountll(filter->blocks[b * CL_FILTER_WORDS + w]) / 64.0;
+        }
+        expected += pass;
+    }
+    stats->expected_rate = expected / filter->nblocks;
+}
@@ -0,0 +1,303 @@
+/*
+ * clist_compact.c
+ *
+ * CL_COMPACT backend: a singly linked list whose nodes are 8 bytes. All
+ * nodes of a list live in one slab and link to each other by 32-bit
+ * slab index, and elements are stored as 32-bit offsets into a string
+ * arena owned by the list (see clist_arena.c). Every inserted string
+ * is copied into the arena, so the list owns its elements; pointers
+ * returned by CL_nth, CL_pop and CL_remove stay valid until the list
+ * is freed.
+ *
+ * Because indices are only meaningful within one slab, nodes cannot
+ * be relinked into another list: join, split and splice copy the
+ * moved strings into the receiving list's arena.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "clist_impl.h"
+
+// Number of nodes in a slab's first allocation; it doubles from there
+#define CL_SLAB_MIN_CAP 16
+
+/*
+ * Take a free slab slot for a node holding a copy of element, growing
+ * the slab if needed. Growing moves the slab, so pointers into it do
+ * not survive this call; indices do.
+ *
+ * Returns: The slab index of the new node, whose next is unset
+ */
+static uint32_t _CL_cnode_new(CList list, CListElementType element) {
+    uint32_t index = list->slab_free;
+    if (index != CL_NIL) {
+        list->slab_free = list->slab[index].next;
+    } else {
+        if (list->slab_used == list->slab_cap) {
+            assert(list->slab_cap < CL_NIL / 2);
+            const uint32_t cap = list->slab_cap ? list->slab_cap * 2 : CL_SLAB_MIN_CAP;
+            struct _cl_cnode *slab = _CL_alloc(list, cap * sizeof(struct _cl_cnode));
+            if (list->slab) {
+                memcpy(slab, list->slab, list->slab_used * sizeof(struct _cl_cnode));
+                _CL_dealloc(list, list->slab, list->slab_cap * sizeof(struct _cl_cnode));
+            }
+            list->slab = slab;
+            list->slab_cap = cap;
+        }
+        index = list->slab_used++;
+    }
+
+    list->slab[index].offset = _CL_arena_store(list, &list->arena, element);
+    return index;
+}
+
+/*
+ * Return a slot to the slab's free chain. The string stays in the arena.
+ */
+static inline void _CL_cnode_release(CList list, uint32_t index) {
+    list->slab[index].next = list->slab_free;
+    list->slab_free = index;
+}
+
+/*
+ * Return the element stored in the node at index
+ */
+static inline CListElementType _CL_celement(CList list, uint32_t index) {
+    return _CL_arena_ptr(&list->arena, list->slab[index].offset);
+}
+
+/*
+ * Return the index of the node before position pos, or CL_NIL if pos
+ * is 0
+ */
+static uint32_t _CL_cprev(CList list, int pos) {
+    uint32_t prev = CL_NIL;
+    uint32_t iter = list->chead;
+    for (int current_position = 0; current_position < pos; current_position++) {
+        prev = iter;
+        iter = list->slab[iter].next;
+    }
+    return prev;
+}
+
+/*
+ * Return a pointer to the link following prev: the next field of node
+ * prev, or the list head if prev is CL_NIL. Only valid until the slab
+ * next grows.
+ */
+static inline uint32_t *_CL_clink(CList list, uint32_t prev) {
+    return prev == CL_NIL ? &list->chead : &list->slab[prev].next;
+}
+
+static void _CL_compact_destroy(CList list) {
+    if (list->slab) _CL_dealloc(list, list->slab, list->slab_cap * sizeof(struct _cl_cnode));
+    list->slab = NULL;
+    list->slab_cap = list->slab_used = 0;
+    list->slab_free = list->chead = CL_NIL;
+    _CL_arena_free(list, &list->arena);
+}
+
+static int _CL_compact_count(CList list) {
+    int len = 0;
+    for (uint32_t i = list->chead; i != CL_NIL; i = list->slab[i].next) len++;
+    return len;
+}
+
+static CListElementType _CL_compact_nth(CList list, int pos) {
+    uint32_t iter = list->chead;
+    for (int current_position = 0; current_position < pos; current_position++) {
+        iter = list->slab[iter].next;
+    }
+    return _CL_celement(list, iter);
+}
+
+static void _CL_compact_insert(CList list, CListElementType element, int pos) {
+    // Allocate first: it may move the slab
+    const uint32_t new_node = _CL_cnode_new(list, element);
+    uint32_t *link = _CL_clink(list, _CL_cprev(list, pos));
+    list->slab[new_node].next = *link;
+    *link = new_node;
+    list->length++;
+}
+
+static CListElementType _CL_compact_remove(CList list, int pos) {
+    uint32_t *link = _CL_clink(list, _CL_cprev(list, pos));
+    const uint32_t index = *link;
+    *link = list->slab[index].next;
+
+    CListElementType to_return = _CL_celement(list, index);
+    list->arena.dead += strlen(to_return) + 1;
+    _CL_cnode_release(list, index);
+    list->length--;
+    return to_return;
+}
+
+static void _CL_compact_splice(CList dest, int dest_pos, CList src, int start, int end) {
+    uint32_t dest_prev = _CL_cprev(dest, dest_pos);
+    uint32_t *src_link = _CL_clink(src, _CL_cprev(src, start));
+
+    for (int i = start; i < end; i++) {
+        const uint32_t index = *src_link;
+        *src_link = src->slab[index].next;
+
+        CListElementType element = _CL_celement(src, index);
+        src->arena.dead += strlen(element) + 1;
+        const uint32_t new_node = _CL_cnode_new(dest, element);
+        uint32_t *dest_link = _CL_clink(dest, dest_prev);
+        dest->slab[new_node].next = *dest_link;
+        *dest_link = new_node;
+        dest_prev = new_node;
+
+        _CL_cnode_release(src, index);
+    }
+
+    src->length -= end - start;
+    dest->length += end - start;
+}
+
+static CList _CL_compact_copy(CList list) {
+    CList list_copy = _CL_new_like(list);
+
+    uint32_t prev = CL_NIL;
+    for (uint32_t i = list->chead; i != CL_NIL; i = list->slab[i].next) {
+        const uint32_t new_node = _CL_cnode_new(list_copy, _CL_celement(list, i));
+        list_copy->slab[new_node].next = CL_NIL;
+        *_CL_clink(list_copy, prev) = new_node;
+        prev = new_node;
+    }
+    list_copy->length = list->length;
+
+    return list_copy;
+}
+
+static int _CL_compact_insert_sorted(CList list, CListElementType element) {
+    const uint32_t new_node = _CL_cnode_new(list, element);
+
+    uint32_t prev = CL_NIL;
+    uint32_t iter = list->chead;
+    int index = 0;
+    while (iter != CL_NIL && strcmp(_CL_celement(list, iter), element) < 0) {
+        prev = iter;
+        iter = list->slab[iter].next;
+        index++;
+    }
+
+    list->slab[new_node].next = iter;
+    *_CL_clink(list, prev) = new_node;
+    list->length++;
+    return index;
+}
+
+static void _CL_compact_join(CList list1, CList list2) {
+    _CL_compact_splice(list1, list1->length, list2, 0, list2->length);
+}
+
+static CList _CL_compact_split(CList list, int pos) {
+    CList tail = _CL_new_like(list);
+    _CL_compact_splice(tail, 0, list, pos, list->length);
+    return tail;
+}
+
+static void _CL_compact_reverse(CList list) {
+    uint32_t current = list->chead;
+    uint32_t prev = CL_NIL;
+
+    while (current != CL_NIL) {
+        const uint32_t next = list->slab[current].next;
+        list->slab[current].next = prev;
+        prev = current;
+        current = next;
+    }
+    list->chead = prev;
+}
+
+static void _CL_compact_foreach(CList list, CL_foreach_callback callback, void *cb_data) {
+    int pos = 0;
+    for (uint32_t i = list->chead; i != CL_NIL; i = list->slab[i].next) {
+        callback(pos++, _CL_celement(list, i), cb_data);
+    }
+}
+
+static void _CL_compact_map(CList list, _CL_map_fn fn, void *data) {
+    // Elements are offsets, so each result is stored into the arena
+    for (uint32_t i = list->chead; i != CL_NIL; i = list->slab[i].next) {
+        CListElementType element = _CL_celement(list, i);
+        list->arena.dead += strlen(element) + 1;
+        list->slab[i].offset = _CL_arena_store(list, &list->arena, fn(element, data));
+    }
+}
+
+static int _CL_compact_find(CList list, CListElementType key, bool count) {
+    int matches = 0;
+    int pos = 0;
+    for (uint32_t i = list->chead; i != CL_NIL; i = list->slab[i].next, pos++) {
+        if (strcmp(_CL_celement(list, i), key) == 0) {
+            if (!count) return pos;
+            matches++;
+        }
+    }
+    return count ? matches : -1;
+}
+
+static void _CL_compact_compact(CList list) {
+    if (list->slab == NULL) return;
+
+    // Renumber the nodes in list order into a fresh slab
+    struct _cl_cnode *slab = _CL_alloc(list, list->slab_cap * sizeof(struct _cl_cnode));
+    uint32_t n = 0;
+    for (uint32_t i = list->chead; i != CL_NIL; i = list->slab[i].next, n++) {
+        slab[n].offset = list->slab[i].offset;
+        slab[n].next = n + 1;
+    }
+    if (n) slab[n - 1].next = CL_NIL;
+
+    _CL_dealloc(list, list->slab, list->slab_cap * sizeof(struct _cl_cnode));
+    list->slab = slab;
+    list->slab_used = n;
+    list->slab_free = CL_NIL;
+    list->chead = n ? 0 : CL_NIL;
+}
+
+static void _CL_compact_move(CList list, int from, int to) {
+    // Relink the node, so the string is not stored again
+    uint32_t *link = _CL_clink(list, _CL_cprev(list, from));
+    const uint32_t index = *link;
+    *link = list->slab[index].next;
+
+    link = _CL_clink(list, _CL_cprev(list, to));
+    list->slab[index].next = *link;
+    *link = index;
+}
+
+const struct _cl_ops _CL_compact_ops = {
+    .destroy = _CL_compact_destroy,
+    .count = _CL_compact_count,
+    .nth = _CL_compact_nth,
+    .insert = _CL_compact_insert,
+    .remove = _CL_compact_remove,
+    .copy = _CL_compact_copy,
+    .insert_sorted = _CL_compact_insert_sorted,
+    .join = _CL_compact_join,
+    .split = _CL_compact_split,
+    .splice = _CL_compact_splice,
+    .reverse = _CL_compact_reverse,
+    .foreach = _CL_compact_foreach,
+    .map = _CL_compact_map,
+    .find = _CL_compact_find,
+    .compact = _CL_compact_compact,
+    .move = _CL_compact_move,
+};
+
+// Documented in clist_impl.h
+void _CL_compact_restore(CList list) {
+    struct _cl_arena fresh;
+    memset(&fresh, 0, sizeof(fresh));
+
+    for (uint32_t i = list->chead; i != CL_NIL; i = list->slab[i].next) {
+        list->slab[i].offset = _CL_arena_store(list, &fresh, _CL_celement(list, i));
+    }
+
+    _CL_arena_free(list, &list->arena);
+    list->arena = fresh;
+}
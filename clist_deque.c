@@ -0,0 +1,326 @@
+/*
+ * clist_deque.c
+ *
+ * CL_DEQUE backend: the elements are stored in a growable circular
+ * array. Position i lives at ring[(ring_start + i) & (ring_cap - 1)],
+ * and ring_cap is always a power of two. Pushing or popping at either
+ * end is O(1), CL_nth is O(1), and insertions or removals in the
+ * middle shift whichever side of the array is shorter.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "clist_impl.h"
+
+// Capacity of a deque's first array; it doubles from there
+#define CL_DEQUE_MIN_CAP 8
+
+/*
+ * Return a pointer to the slot holding position pos
+ */
+static inline CListElementType *_CL_dq_at(CList list, int pos) {
+    return &list->ring[(list->ring_start + pos) & (list->ring_cap - 1)];
+}
+
+/*
+ * Move the elements to a new array of cap slots, which must be large
+ * enough to hold them, so that position 0 is at index 0.
+ */
+static void _CL_dq_resize(CList list, int cap) {
+    assert(cap >= list->length);
+    CListElementType *ring =
+        (CListElementType *)_CL_alloc(list, (size_t)cap * sizeof(CListElementType));
+
+    // The old contents are at most two contiguous runs
+    if (list->length) {
+        const int first_run = list->ring_cap - list->ring_start;
+        if (list->length <= first_run) {
+            memcpy(ring, &list->ring[list->ring_start], list->length * sizeof(CListElementType));
+        } else {
+            memcpy(ring, &list->ring[list->ring_start], first_run * sizeof(CListElementType));
+            memcpy(ring + first_run, list->ring,
+                   (list->length - first_run) * sizeof(CListElementType));
+        }
+    }
+
+    if (list->ring) {
+        _CL_dealloc(list, list->ring, (size_t)list->ring_cap * sizeof(CListElementType));
+    }
+    if (list->ring_keys) {
+        _CL_dealloc(list, list->ring_keys, (size_t)list->ring_cap * sizeof(uint64_t));
+        list->ring_keys = NULL;
+        list->ring_keys_valid = false;
+    }
+    list->ring = ring;
+    list->ring_cap = cap;
+    list->ring_start = 0;
+}
+
+/*
+ * Make sure the array can hold at least n elements
+ */
+static void _CL_dq_reserve(CList list, int n) {
+    if (n <= list->ring_cap) return;
+    int cap = list->ring_cap ? list->ring_cap : CL_DEQUE_MIN_CAP;
+    while (cap < n) cap *= 2;
+    _CL_dq_resize(list, cap);
+}
+
+/*
+ * Open a gap of k empty slots before position pos, moving the
+ * elements on whichever side of pos is shorter. Capacity for k more
+ * elements must already be reserved. Updates length.
+ */
+static void _CL_dq_open_gap(CList list, int pos, int k) {
+    if (pos < list->length - pos) {
+        list->ring_start = (list->ring_start - k) & (list->ring_cap - 1);
+        for (int i = 0; i < pos; i++) *_CL_dq_at(list, i) = *_CL_dq_at(list, i + k);
+    } else {
+        for (int i = list->length - 1; i >= pos; i--) *_CL_dq_at(list, i + k) = *_CL_dq_at(list, i);
+    }
+    list->length += k;
+    list->ring_keys_valid = false;
+}
+
+/*
+ * Close the k slots starting at position pos, moving the elements on
+ * whichever side is shorter, and shrink the array once it is mostly
+ * empty. Updates length.
+ */
+static void _CL_dq_close_gap(CList list, int pos, int k) {
+    if (pos < list->length - pos - k) {
+        for (int i = pos - 1; i >= 0; i--) *_CL_dq_at(list, i + k) = *_CL_dq_at(list, i);
+        list->ring_start = (list->ring_start + k) & (list->ring_cap - 1);
+    } else {
+        for (int i = pos; i < list->length - k; i++) *_CL_dq_at(list, i) = *_CL_dq_at(list, i + k);
+    }
+    list->length -= k;
+    list->ring_keys_valid = false;
+
+    if (list->ring_cap > CL_DEQUE_MIN_CAP && list->length < list->ring_cap / 4) {
+        _CL_dq_resize(list, list->ring_cap / 2);
+    }
+}
+
+/*
+ * Bring ring_keys up to date with the elements, after any mutation
+ * since the last find. The list must not be empty.
+ */
+static void _CL_dq_build_keys(CList list) {
+    if (list->ring_keys_valid) return;
+    if (list->ring_keys == NULL) {
+        list->ring_keys = (uint64_t *)_CL_alloc(list, (size_t)list->ring_cap * sizeof(uint64_t));
+    }
+    for (int i = 0; i < list->length; i++) {
+        const int index = (list->ring_start + i) & (list->ring_cap - 1);
+        list->ring_keys[index] = _CL_key_prefix(list->ring[index]);
+    }
+    list->ring_keys_valid = true;
+}
+
+static void _CL_deque_destroy(CList list) {
+    if (list->ring) {
+        _CL_dealloc(list, list->ring, (size_t)list->ring_cap * sizeof(CListElementType));
+    }
+    if (list->ring_keys) {
+        _CL_dealloc(list, list->ring_keys, (size_t)list->ring_cap * sizeof(uint64_t));
+    }
+    list->ring_keys = NULL;
+    list->ring_keys_valid = false;
+    list->ring = NULL;
+    list->ring_cap = 0;
+}
+
+static int _CL_deque_count(CList list) {
+    // The array has no independent count; check what can be checked
+    assert(list->length <= list->ring_cap);
+    assert((list->ring_cap & (list->ring_cap - 1)) == 0);
+    return list->length;
+}
+
+static CListElementType _CL_deque_nth(CList list, int pos) {
+    return *_CL_dq_at(list, pos);
+}
+
+static void _CL_deque_insert(CList list, CListElementType element, int pos) {
+    _CL_dq_reserve(list, list->length + 1);
+    _CL_dq_open_gap(list, pos, 1);
+    *_CL_dq_at(list, pos) = element;
+}
+
+static CListElementType _CL_deque_remove(CList list, int pos) {
+    CListElementType to_return = *_CL_dq_at(list, pos);
+    _CL_dq_close_gap(list, pos, 1);
+    return to_return;
+}
+
+static CList _CL_deque_copy(CList list) {
+    CList list_copy = _CL_new_like(list);
+    _CL_dq_reserve(list_copy, list->length);
+    for (int i = 0; i < list->length; i++) list_copy->ring[i] = *_CL_dq_at(list, i);
+    list_copy->length = list->length;
+    return list_copy;
+}
+
+static int _CL_deque_insert_sorted(CList list, CListElementType element) {
+    // The element's place is bracketed by galloping from where the last
+    // insertion went, probing 1, 2, 4, ... slots away, so input that is
+    // nearly in order takes O(log d) compares for a distance d
+    int lo = 0;
+    int hi = list->length;
+    const int finger = list->finger_pos;
+    if (finger < list->length) {
+        int probe;
+        if (strcmp(*_CL_dq_at(list, finger), element) < 0) {
+            lo = finger + 1;
+            for (int step = 1; (probe = finger + step) < list->length; step *= 2) {
+                if (strcmp(*_CL_dq_at(list, probe), element) >= 0) {
+                    hi = probe;
+                    break;
+                }
+                lo = probe + 1;
+            }
+        } else {
+            hi = finger;
+            for (int step = 1; (probe = finger - step) >= 0; step *= 2) {
+                if (strcmp(*_CL_dq_at(list, probe), element) < 0) {
+                    lo = probe + 1;
+                    break;
+                }
+                hi = probe;
+            }
+        }
+    }
+
+    // then binary searched for the first element not less than element
+    while (lo < hi) {
+        const int mid = lo + (hi - lo) / 2;
+        if (strcmp(*_CL_dq_at(list, mid), element) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    _CL_deque_insert(list, element, lo);
+    list->finger_pos = lo;
+    return lo;
+}
+
+static void _CL_deque_splice(CList dest, int dest_pos, CList src, int start, int end) {
+    const int k = end - start;
+    if (k == 0) return;
+
+    _CL_dq_reserve(dest, dest->length + k);
+    _CL_dq_open_gap(dest, dest_pos, k);
+    for (int i = 0; i < k; i++) *_CL_dq_at(dest, dest_pos + i) = *_CL_dq_at(src, start + i);
+    _CL_dq_close_gap(src, start, k);
+}
+
+static void _CL_deque_join(CList list1, CList list2) {
+    _CL_deque_splice(list1, list1->length, list2, 0, list2->length);
+}
+
+static CList _CL_deque_split(CList list, int pos) {
+    CList tail = _CL_new_like(list);
+    _CL_deque_splice(tail, 0, list, pos, list->length);
+    return tail;
+}
+
+static void _CL_deque_reverse(CList list) {
+    list->ring_keys_valid = false;
+    for (int i = 0, j = list->length - 1; i < j; i++, j--) {
+        CListElementType temp = *_CL_dq_at(list, i);
+        *_CL_dq_at(list, i) = *_CL_dq_at(list, j);
+        *_CL_dq_at(list, j) = temp;
+    }
+}
+
+static void _CL_deque_foreach(CList list, CL_foreach_callback callback, void *cb_data) {
+    // Walk the (at most two) contiguous runs directly
+    int pos = 0;
+    int index = list->ring_start;
+    while (pos < list->length) {
+        int run = list->ring_cap - index;
+        if (run > list->length - pos) run = list->length - pos;
+        for (const CListElementType *p = &list->ring[index]; run > 0; run--, p++) {
+            callback(pos++, *p, cb_data);
+        }
+        index = 0;
+    }
+}
+
+static void _CL_deque_map(CList list, _CL_map_fn fn, void *data) {
+    for (int i = 0; i < list->length; i++) *_CL_dq_at(list, i) = fn(*_CL_dq_at(list, i), data);
+}
+
+static int _CL_deque_find(CList list, CListElementType key, bool count) {
+    if (list->length == 0) return count ? 0 : -1;
+    _CL_dq_build_keys(list);
+
+    // Vector-compare the prefixes of each of the (at most two)
+    // contiguous runs, and check the rest of the string on a match
+    const struct _cl_key k = _CL_key_make(key);
+    int matches = 0;
+    int pos = 0;
+    int index = list->ring_start;
+    while (pos < list->length) {
+        int run = list->ring_cap - index;
+        if (run > list->length - pos) run = list->length - pos;
+        const uint64_t *keys = &list->ring_keys[index];
+        for (int i = _CL_prefix_scan(keys, run, k.prefix); i < run;
+             i += 1 + _CL_prefix_scan(keys + i + 1, run - i - 1, k.prefix)) {
+            // A key shorter than 8 bytes is decided by its prefix
+            if (k.len < 8 || strcmp(list->ring[index + i] + 8, key + 8) == 0) {
+                if (!count) return pos + i;
+                matches++;
+            }
+        }
+        pos += run;
+        index = 0;
+    }
+    return count ? matches : -1;
+}
+
+static void _CL_deque_compact(CList list) {
+    // The array is contiguous already; unwrap it so that position 0
+    // comes first
+    if (list->ring) _CL_dq_resize(list, list->ring_cap);
+}
+
+static void _CL_deque_move(CList list, int from, int to) {
+    // Shift the slots in between by one, keeping their keys if built
+    const int step = from < to ? 1 : -1;
+    const int mask = list->ring_cap - 1;
+    const CListElementType element = *_CL_dq_at(list, from);
+    const int from_index = (list->ring_start + from) & mask;
+    const uint64_t key = list->ring_keys_valid ? list->ring_keys[from_index] : 0;
+    for (int i = from; i != to; i += step) {
+        const int index = (list->ring_start + i) & mask;
+        const int source = (list->ring_start + i + step) & mask;
+        list->ring[index] = list->ring[source];
+        if (list->ring_keys_valid) list->ring_keys[index] = list->ring_keys[source];
+    }
+    *_CL_dq_at(list, to) = element;
+    if (list->ring_keys_valid) list->ring_keys[(list->ring_start + to) & mask] = key;
+}
+
+const struct _cl_ops _CL_deque_ops = {
+    .destroy = _CL_deque_destroy,
+    .count = _CL_deque_count,
+    .nth = _CL_deque_nth,
+    .insert = _CL_deque_insert,
+    .remove = _CL_deque_remove,
+    .copy = _CL_deque_copy,
+    .insert_sorted = _CL_deque_insert_sorted,
+    .join = _CL_deque_join,
+    .split = _CL_deque_split,
+    .splice = _CL_deque_splice,
+    .reverse = _CL_deque_reverse,
+    .foreach = _CL_deque_foreach,
+    .map = _CL_deque_map,
+    .find = _CL_deque_find,
+    .compact = _CL_deque_compact,
+    .move = _CL_deque_move,
+};
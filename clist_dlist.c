@@ -0,0 +1,294 @@
+/*
+ * clist_dlist.c
+ *
+ * CL_DLINKED backend: a doubly linked list with pointers to both ends.
+ * Positional operations walk from whichever end is nearer, so both
+ * ends are O(1), and a node is unlinked or linked next to another in
+ * O(1), which is what the handle API (see CL_push_h) is built on.
+ *
+ * Nodes never move while their element is in a list: CL_compact does
+ * not touch a CL_DLINKED list, so handles stay valid.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "clist_impl.h"
+
+// Documented in clist_impl.h
+struct _cl_dnode *_CL_dlist_at(CList list, int pos) {
+    if (pos == list->length) return NULL;
+
+    struct _cl_dnode *node;
+    if (pos < list->length / 2) {
+        node = list->dhead;
+        for (int i = 0; i < pos; i++) node = node->next;
+    } else {
+        node = list->dtail;
+        for (int i = list->length - 1; i > pos; i--) node = node->prev;
+    }
+    return node;
+}
+
+// Documented in clist_impl.h
+int _CL_dlist_pos(const struct _cl_dnode *node) {
+    int pos = 0;
+    for (node = node->prev; node; node = node->prev) pos++;
+    return pos;
+}
+
+// Documented in clist_impl.h
+void _CL_dlist_link(CList list, struct _cl_dnode *node, struct _cl_dnode *next) {
+    node->next = next;
+    node->prev = next ? next->prev : list->dtail;
+    if (node->prev) {
+        node->prev->next = node;
+    } else {
+        list->dhead = node;
+    }
+    if (next) {
+        next->prev = node;
+    } else {
+        list->dtail = node;
+    }
+    list->length++;
+    _CL_finger_drop(list);
+}
+
+// Documented in clist_impl.h
+struct _cl_dnode *_CL_dlist_new(CList list, CListElementType element, struct _cl_dnode *next) {
+    struct _cl_dnode *node = (struct _cl_dnode *)_CL_node_alloc(list);
+    node->element = element;
+    _CL_dlist_link(list, node, next);
+    return node;
+}
+
+// Documented in clist_impl.h
+void _CL_dlist_unlink(CList list, struct _cl_dnode *node) {
+    if (node->prev) {
+        node->prev->next = node->next;
+    } else {
+        list->dhead = node->next;
+    }
+    if (node->next) {
+        node->next->prev = node->prev;
+    } else {
+        list->dtail = node->prev;
+    }
+    list->length--;
+    _CL_finger_drop(list);
+}
+
+static void _CL_dlist_destroy(CList list) {
+    struct _cl_dnode *iter = list->dhead;
+    while (iter) {
+        struct _cl_dnode *temp = iter;
+        iter = iter->next;
+        _CL_node_release(list, temp);
+    }
+    list->dhead = list->dtail = NULL;
+    _CL_finger_drop(list);
+}
+
+static int _CL_dlist_count(CList list) {
+    int len = 0;
+    for (struct _cl_dnode *iter = list->dhead; iter; iter = iter->next) {
+        // The links must agree in both directions
+        assert(iter->next ? iter->next->prev == iter : list->dtail == iter);
+        len++;
+    }
+    return len;
+}
+
+static CListElementType _CL_dlist_nth(CList list, int pos) {
+    return _CL_dlist_at(list, pos)->element;
+}
+
+static void _CL_dlist_insert(CList list, CListElementType element, int pos) {
+    _CL_dlist_new(list, element, _CL_dlist_at(list, pos));
+}
+
+static CListElementType _CL_dlist_remove(CList list, int pos) {
+    struct _cl_dnode *node = _CL_dlist_at(list, pos);
+    CListElementType element = node->element;
+    _CL_dlist_unlink(list, node);
+    _CL_node_recycle(list, node);
+    return element;
+}
+
+static CList _CL_dlist_copy(CList list) {
+    CList list_copy = _CL_new_like(list);
+    for (struct _cl_dnode *iter = list->dhead; iter; iter = iter->next) {
+        _CL_dlist_new(list_copy, iter->element, NULL);
+    }
+    return list_copy;
+}
+
+static int _CL_dlist_insert_sorted(CList list, CListElementType element) {
+    // Start after the node the last insertion went after if it is
+    // still before element, so that input arriving in order is O(1)
+    struct _cl_dnode *prev = list->finger;
+    int index = 0;
+    if (prev && strcmp(prev->element, element) < 0) {
+        index = list->finger_pos + 1;
+    } else {
+        prev = NULL;
+    }
+    struct _cl_dnode *iter = prev ? prev->next : list->dhead;
+    while (iter && strcmp(iter->element, element) < 0) {
+        prev = iter;
+        iter = iter->next;
+        index++;
+    }
+    _CL_dlist_new(list, element, iter);
+    list->finger = prev;
+    list->finger_pos = index - 1;
+    return index;
+}
+
+static void _CL_dlist_join(CList list1, CList list2) {
+    if (list2->dhead == NULL) return;
+    _CL_finger_drop(list1);
+    _CL_finger_drop(list2);
+
+    if (list1->dtail) {
+        list1->dtail->next = list2->dhead;
+        list2->dhead->prev = list1->dtail;
+    } else {
+        list1->dhead = list2->dhead;
+    }
+    list1->dtail = list2->dtail;
+    list1->length += list2->length;
+
+    list2->dhead = list2->dtail = NULL;
+    list2->length = 0;
+}
+
+static CList _CL_dlist_split(CList list, int pos) {
+    CList tail = _CL_new_like(list);
+    struct _cl_dnode *first = _CL_dlist_at(list, pos);
+    if (first == NULL) return tail;
+    _CL_finger_drop(list);
+
+    tail->dhead = first;
+    tail->dtail = list->dtail;
+    tail->length = list->length - pos;
+
+    list->dtail = first->prev;
+    if (list->dtail) {
+        list->dtail->next = NULL;
+    } else {
+        list->dhead = NULL;
+    }
+    first->prev = NULL;
+    list->length = pos;
+    return tail;
+}
+
+static void _CL_dlist_splice(CList dest, int dest_pos, CList src, int start, int end) {
+    if (start == end) return;
+    _CL_finger_drop(dest);
+    _CL_finger_drop(src);
+
+    // Cut [first, last] out of src
+    struct _cl_dnode *first = _CL_dlist_at(src, start);
+    struct _cl_dnode *last = first;
+    for (int i = start + 1; i < end; i++) last = last->next;
+    if (first->prev) {
+        first->prev->next = last->next;
+    } else {
+        src->dhead = last->next;
+    }
+    if (last->next) {
+        last->next->prev = first->prev;
+    } else {
+        src->dtail = first->prev;
+    }
+    src->length -= end - start;
+
+    // and link it in before next
+    struct _cl_dnode *next = _CL_dlist_at(dest, dest_pos);
+    first->prev = next ? next->prev : dest->dtail;
+    last->next = next;
+    if (first->prev) {
+        first->prev->next = first;
+    } else {
+        dest->dhead = first;
+    }
+    if (next) {
+        next->prev = last;
+    } else {
+        dest->dtail = last;
+    }
+    dest->length += end - start;
+}
+
+static void _CL_dlist_reverse(CList list) {
+    _CL_finger_drop(list);
+    struct _cl_dnode *iter = list->dhead;
+    while (iter) {
+        struct _cl_dnode *next = iter->next;
+        iter->next = iter->prev;
+        iter->prev = next;
+        iter = next;
+    }
+    struct _cl_dnode *temp = list->dhead;
+    list->dhead = list->dtail;
+    list->dtail = temp;
+}
+
+static void _CL_dlist_foreach(CList list, CL_foreach_callback callback, void *cb_data) {
+    int pos = 0;
+    for (struct _cl_dnode *iter = list->dhead; iter; iter = iter->next) {
+        callback(pos++, iter->element, cb_data);
+    }
+}
+
+static void _CL_dlist_map(CList list, _CL_map_fn fn, void *data) {
+    for (struct _cl_dnode *iter = list->dhead; iter; iter = iter->next) {
+        iter->element = fn(iter->element, data);
+    }
+}
+
+static int _CL_dlist_find(CList list, CListElementType key, bool count) {
+    int matches = 0;
+    int pos = 0;
+    for (struct _cl_dnode *iter = list->dhead; iter; iter = iter->next, pos++) {
+        if (strcmp(iter->element, key) == 0) {
+            if (!count) return pos;
+            matches++;
+        }
+    }
+    return count ? matches : -1;
+}
+
+static void _CL_dlist_compact(CList list) {
+    // Moving the nodes would invalidate the handles to them
+    (void)list;
+}
+
+static void _CL_dlist_move(CList list, int from, int to) {
+    // Relink the node, so handles to it stay valid
+    struct _cl_dnode *node = _CL_dlist_at(list, from);
+    _CL_dlist_unlink(list, node);
+    _CL_dlist_link(list, node, _CL_dlist_at(list, to));
+}
+
+const struct _cl_ops _CL_dlist_ops = {
+    .destroy = _CL_dlist_destroy,
+    .count = _CL_dlist_count,
+    .nth = _CL_dlist_nth,
+    .insert = _CL_dlist_insert,
+    .remove = _CL_dlist_remove,
+    .copy = _CL_dlist_copy,
+    .insert_sorted = _CL_dlist_insert_sorted,
+    .join = _CL_dlist_join,
+    .split = _CL_dlist_split,
+    .splice = _CL_dlist_splice,
+    .reverse = _CL_dlist_reverse,
+    .foreach = _CL_dlist_foreach,
+    .map = _CL_dlist_map,
+    .find = _CL_dlist_find,
+    .compact = _CL_dlist_compact,
+    .move = _CL_dlist_move,
+};
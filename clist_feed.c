@@ -0,0 +1,235 @@
+/*
+ * clist_feed.c
+ *
+ * Change feeds (see CL_subscribe): every change to a list with
+ * subscribers is written as a record into a ring of bytes that the
+ * subscribers read at their own pace, each with its own cursor.
+ *
+ * The list's writer is the only producer and never waits: it writes
+ * over records whatever their subscribers have read. Subscribers
+ * share nothing they write, so reading does not slow the writer. A
+ * subscriber checks, after copying a record out, that the writer had
+ * not yet started to write over it, as a seqlock reader does; a
+ * subscriber that was lapped gets CL_CHANGE_LOST and carries on from
+ * the newest record.
+ */
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clist_impl.h"
+
+// Bytes in a feed's ring; a power of two
+#define CL_FEED_SIZE ((size_t)1 << 20)
+
+// Longest element a record carries; a change to a longer one is sent
+// as CL_CHANGE_LOST, since one record could fill most of the ring
+#define CL_FEED_MAX_ELEMENT (CL_FEED_SIZE / 8)
+
+// Kind of the record that fills the end of the ring when the next
+// record does not fit there
+#define CL_CHANGE_PAD (-1)
+
+// Records start at multiples of this, which is more than the size of
+// their header, so that whatever room is left at the end of the ring
+// can hold a CL_CHANGE_PAD header
+#define CL_RECORD_ALIGN 32
+
+// A record in the ring: this header, then len bytes of element, then
+// padding to a multiple of CL_RECORD_ALIGN
+struct _cl_record {
+    uint32_t size;  // bytes taken by the whole record
+    int32_t kind;   // a CListChangeKind, or CL_CHANGE_PAD
+    int32_t pos;
+    int32_t count;
+    uint32_t len;   // bytes of element; 0 if there is none
+    uint32_t has_element;
+};
+
+struct _cl_feed {
+    // Written by the list's writer only. Bytes before head are whole
+    // records; bytes before claim may be being written over.
+    _Alignas(64) _Atomic uint64_t head;
+    _Atomic uint64_t claim;
+
+    _Alignas(64) char *ring;
+    atomic_int subscribers;
+    atomic_int refs;  // the list, while it has the feed, and each subscription
+};
+
+struct _cl_subscription {
+    struct _cl_feed *feed;
+    uint64_t tail;  // offset of the next record to read
+    char *element;  // copy of the last record's element
+    size_t element_cap;
+};
+
+/*
+ * Return the size of a record carrying len bytes of element
+ */
+static inline size_t _CL_record_size(size_t len) {
+    return (sizeof(struct _cl_record) + len + CL_RECORD_ALIGN - 1) / CL_RECORD_ALIGN *
+           CL_RECORD_ALIGN;
+}
+
+/*
+ * Drop one reference to a feed, freeing it with the last
+ */
+static void _CL_feed_put(struct _cl_feed *feed) {
+    if (atomic_fetch_sub_explicit(&feed->refs, 1, memory_order_acq_rel) == 1) {
+        free(feed->ring);
+        free(feed);
+    }
+}
+
+/*
+ * Write one record to the feed of list, if anyone is subscribed
+ */
+static void _CL_feed_emit(CList list, CListChangeKind kind, int pos, int count,
+                          CListElementType element) {
+    struct _cl_feed *feed = list->feed;
+    if (atomic_load_explicit(&feed->subscribers, memory_order_relaxed) == 0) return;
+
+    size_t len = element ? strlen(element) : 0;
+    if (len > CL_FEED_MAX_ELEMENT) {
+        kind = CL_CHANGE_LOST;
+        element = NULL;
+        len = 0;
+    }
+    struct _cl_record record = {_CL_record_size(len), kind, pos, count, len, element != NULL};
+
+    // A record does not wrap: the end of the ring is padded instead
+    const uint64_t head = atomic_load_explicit(&feed->head, memory_order_relaxed);
+    const size_t offset = head & (CL_FEED_SIZE - 1);
+    const size_t pad = offset + record.size > CL_FEED_SIZE ? CL_FEED_SIZE - offset : 0;
+
+    // Claim the bytes before writing them, so subscribers reading
+    // them can tell they have changed
+    const uint64_t end = head + pad + record.size;
+    atomic_store_explicit(&feed->claim, end, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    if (pad) {
+        struct _cl_record filler = {pad, CL_CHANGE_PAD, 0, 0, 0, 0};
+        memcpy(feed->ring + offset, &filler, sizeof(filler));
+    }
+    char *out = feed->ring + ((head + pad) & (CL_FEED_SIZE - 1));
+    memcpy(out, &record, sizeof(record));
+    if (len) memcpy(out + sizeof(record), element, len);
+
+    atomic_store_explicit(&feed->head, end, memory_order_release);
+}
+
+// Documented in clist_impl.h
+void _CL_feed_insert(CList list, int pos, CListElementType element) {
+    // A CL_PRIORITY list puts the element where its order says
+    _CL_feed_emit(list, CL_CHANGE_INSERT, list->backend == CL_PRIORITY ? -1 : pos, 1, element);
+}
+
+// Documented in clist_impl.h
+void _CL_feed_remove(CList list, int pos, int count, CListElementType element) {
+    if (count) _CL_feed_emit(list, CL_CHANGE_REMOVE, pos, count, count == 1 ? element : NULL);
+}
+
+// Documented in clist_impl.h
+void _CL_feed_reverse(CList list) {
+    _CL_feed_emit(list, CL_CHANGE_REVERSE, 0, 0, NULL);
+}
+
+// Documented in clist_impl.h
+void _CL_feed_detach(CList list) {
+    _CL_feed_put(list->feed);
+    list->feed = NULL;
+}
+
+// Documented in .h file
+CListSubscription CL_subscribe(CList list) {
+    assert(list);
+    if (list->feed == NULL) {
+        struct _cl_feed *feed = (struct _cl_feed *)aligned_alloc(_Alignof(struct _cl_feed),
+                                                                 sizeof(struct _cl_feed));
+        assert(feed);
+        feed->ring = (char *)malloc(CL_FEED_SIZE);
+        assert(feed->ring);
+        atomic_init(&feed->head, 0);
+        atomic_init(&feed->claim, 0);
+        atomic_init(&feed->subscribers, 0);
+        atomic_init(&feed->refs, 1);
+        list->feed = feed;
+    }
+
+    struct _cl_subscription *subscription = malloc(sizeof(struct _cl_subscription));
+    assert(subscription);
+    subscription->feed = list->feed;
+    subscription->tail = atomic_load_explicit(&list->feed->head, memory_order_relaxed);
+    subscription->element = NULL;
+    subscription->element_cap = 0;
+    atomic_fetch_add_explicit(&list->feed->refs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&list->feed->subscribers, 1, memory_order_relaxed);
+    return subscription;
+}
+
+// Documented in .h file
+void CL_unsubscribe(CListSubscription subscription) {
+    assert(subscription);
+    atomic_fetch_sub_explicit(&subscription->feed->subscribers, 1, memory_order_relaxed);
+    _CL_feed_put(subscription->feed);
+    free(subscription->element);
+    free(subscription);
+}
+
+// Documented in .h file
+bool CL_next_change(CListSubscription subscription, CListChange *change) {
+    assert(subscription);
+    assert(change);
+    struct _cl_feed *feed = subscription->feed;
+
+    for (;;) {
+        const uint64_t head = atomic_load_explicit(&feed->head, memory_order_acquire);
+        const uint64_t tail = subscription->tail;
+        if (tail == head) return false;
+
+        // The record is copied out before it is known to be intact, so
+        // its header is checked enough to keep the copy inside the ring
+        struct _cl_record record;
+        const size_t offset = tail & (CL_FEED_SIZE - 1);
+        bool intact = head - tail <= CL_FEED_SIZE;
+        if (intact) {
+            memcpy(&record, feed->ring + offset, sizeof(record));
+            intact = record.size >= sizeof(record) && record.size <= CL_FEED_SIZE - offset &&
+                     record.len <= record.size - sizeof(record);
+        }
+        if (intact && record.has_element) {
+            if (record.len + 1 > subscription->element_cap) {
+                subscription->element_cap = record.len + 1;
+                subscription->element = realloc(subscription->element, record.len + 1);
+                assert(subscription->element);
+            }
+            memcpy(subscription->element, feed->ring + offset + sizeof(record), record.len);
+            subscription->element[record.len] = '\0';
+        }
+
+        // Had the writer claimed these bytes again, what was copied
+        // may be torn
+        atomic_thread_fence(memory_order_acquire);
+        const uint64_t claim = atomic_load_explicit(&feed->claim, memory_order_relaxed);
+        if (!intact || claim - tail > CL_FEED_SIZE) {
+            subscription->tail = atomic_load_explicit(&feed->head, memory_order_acquire);
+            change->kind = CL_CHANGE_LOST;
+            change->pos = change->count = 0;
+            change->element = NULL;
+            return true;
+        }
+
+        subscription->tail = tail + record.size;
+        if (record.kind == CL_CHANGE_PAD) continue;
+        change->kind = (CListChangeKind)record.kind;
+        change->pos = record.pos;
+        change->count = record.count;
+        change->element = record.has_element ? subscription->element : NULL;
+        return true;
+    }
+}
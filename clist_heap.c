@@ -0,0 +1,361 @@
+/*
+ * clist_heap.c
+ *
+ * CL_PRIORITY backend: the list is a min pairing heap ordered by
+ * strcmp. The list's logical order is ascending, but only its head
+ * (the minimum) is directly reachable, which is all a priority queue
+ * needs: insertion and meld are O(1), and removing the head is
+ * O(log n) amortized. Any other position k is reached by detaching the
+ * k smallest nodes onto a heap of their own and melding them back, at
+ * O(k log n). Nodes only ever move by relinking, so nth, split and
+ * splice neither allocate nor free.
+ *
+ * Every node's children form a chain through their sibling pointers.
+ * Chains and child depth can both grow to O(n), so nothing in this
+ * file recurses, and walks keep no stack either (see _CL_hwalk).
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "clist_impl.h"
+
+/*
+ * Meld two heaps by making the root with the larger element the first
+ * child of the other. Both arguments must be roots (no siblings).
+ *
+ * Returns: The root of the melded heap
+ */
+static struct _cl_hnode *_CL_hmeld(struct _cl_hnode *a, struct _cl_hnode *b) {
+    if (a == NULL) return b;
+    if (b == NULL) return a;
+    if (strcmp(b->element, a->element) < 0) {
+        struct _cl_hnode *temp = a;
+        a = b;
+        b = temp;
+    }
+    b->sibling = a->child;
+    a->child = b;
+    return a;
+}
+
+/*
+ * Combine a chain of sibling heaps into one with the standard
+ * two-pass pairing: meld neighbours left to right, then meld the
+ * results right to left.
+ *
+ * Returns: The root of the combined heap
+ */
+static struct _cl_hnode *_CL_hmerge_pairs(struct _cl_hnode *first) {
+    // First pass; the melded pairs are collected in reverse order
+    struct _cl_hnode *pairs = NULL;
+    while (first) {
+        struct _cl_hnode *a = first;
+        struct _cl_hnode *b = a->sibling;
+        if (b == NULL) {
+            a->sibling = pairs;
+            pairs = a;
+            break;
+        }
+        first = b->sibling;
+        a->sibling = b->sibling = NULL;
+        struct _cl_hnode *melded = _CL_hmeld(a, b);
+        melded->sibling = pairs;
+        pairs = melded;
+    }
+
+    // Second pass, which thanks to the reversal runs right to left
+    struct _cl_hnode *result = NULL;
+    while (pairs) {
+        struct _cl_hnode *next = pairs->sibling;
+        pairs->sibling = NULL;
+        result = _CL_hmeld(result, pairs);
+        pairs = next;
+    }
+    return result;
+}
+
+/*
+ * Unlink the root of the non-empty heap at *heap, whose children
+ * become the heap
+ *
+ * Returns: The unlinked node, now a heap of its own
+ */
+static struct _cl_hnode *_CL_hdetach(struct _cl_hnode **heap) {
+    struct _cl_hnode *root = *heap;
+    *heap = _CL_hmerge_pairs(root->child);
+    root->child = NULL;
+    return root;
+}
+
+/*
+ * Relink the n smallest nodes of the heap at *heap into the heap at
+ * *into
+ */
+static void _CL_htake(struct _cl_hnode **heap, int n, struct _cl_hnode **into) {
+    for (int i = 0; i < n; i++) *into = _CL_hmeld(*into, _CL_hdetach(heap));
+}
+
+// Called by _CL_hwalk on each node; returns whether to walk the node's
+// children
+typedef bool (*_CL_hvisit_fn)(struct _cl_hnode *t, void *data);
+
+/*
+ * Visit the nodes of a heap in preorder without a stack (a Morris
+ * walk). Before walking a node's children, the last of them is linked
+ * back to the node through its sibling pointer, and the walk returns
+ * along that link and removes it. All links are as they were once the
+ * walk ends, and visit never sees a node's own links change.
+ */
+static void _CL_hwalk(struct _cl_hnode *t, _CL_hvisit_fn visit, void *data) {
+    while (t) {
+        if (t->child == NULL) {
+            visit(t, data);
+            t = t->sibling;
+            continue;
+        }
+        struct _cl_hnode *last = t->child;
+        while (last->sibling && last->sibling != t) last = last->sibling;
+        if (last->sibling == t) {
+            // Back from the children
+            last->sibling = NULL;
+            t = t->sibling;
+        } else if (visit(t, data)) {
+            last->sibling = t;
+            t = t->child;
+        } else {
+            t = t->sibling;
+        }
+    }
+}
+
+/*
+ * Remove the minimum from a non-empty heap
+ *
+ * Returns: The removed element
+ */
+static CListElementType _CL_heap_pop(CList list) {
+    struct _cl_hnode *root = _CL_hdetach(&list->heap);
+    CListElementType to_return = root->element;
+    _CL_node_recycle(list, root);
+    list->length--;
+    return to_return;
+}
+
+static void _CL_heap_destroy(CList list) {
+    // Flatten as we go: each node's children are prepended to the work
+    // chain, so every node is visited once without recursion
+    struct _cl_hnode *work = list->heap;
+    while (work) {
+        struct _cl_hnode *t = work;
+        work = t->sibling;
+        if (t->child) {
+            struct _cl_hnode *last = t->child;
+            while (last->sibling) last = last->sibling;
+            last->sibling = work;
+            work = t->child;
+        }
+        _CL_node_release(list, t);
+    }
+    list->heap = NULL;
+}
+
+static int _CL_heap_count(CList list) {
+    // A full recount would make every DEBUG operation O(n); check the
+    // root instead
+    assert((list->heap == NULL) == (list->length == 0));
+    assert(list->heap == NULL || list->heap->sibling == NULL);
+    return list->length;
+}
+
+static CListElementType _CL_heap_nth(CList list, int pos) {
+    struct _cl_hnode *below = NULL;
+    _CL_htake(&list->heap, pos, &below);
+    CListElementType to_return = list->heap->element;
+    list->heap = _CL_hmeld(list->heap, below);
+    return to_return;
+}
+
+static void _CL_heap_insert(CList list, CListElementType element, int pos) {
+    (void)pos;
+    struct _cl_hnode *new = (struct _cl_hnode *)_CL_node_alloc(list);
+    new->element = element;
+    new->child = NULL;
+    new->sibling = NULL;
+
+    list->heap = _CL_hmeld(list->heap, new);
+    list->length++;
+}
+
+static CListElementType _CL_heap_remove(CList list, int pos) {
+    struct _cl_hnode *below = NULL;
+    _CL_htake(&list->heap, pos, &below);
+    CListElementType to_return = _CL_heap_pop(list);
+    list->heap = _CL_hmeld(list->heap, below);
+    return to_return;
+}
+
+// Walk state for _CL_heap_foreach
+struct _cl_heap_foreach {
+    CL_foreach_callback callback;
+    void *cb_data;
+    int pos;
+};
+
+static bool _CL_heap_foreach_node(struct _cl_hnode *t, void *data) {
+    struct _cl_heap_foreach *walk = data;
+    walk->callback(walk->pos++, t->element, walk->cb_data);
+    return true;
+}
+
+static void _CL_heap_foreach(CList list, CL_foreach_callback callback, void *cb_data) {
+    struct _cl_heap_foreach walk = {callback, cb_data, 0};
+    _CL_hwalk(list->heap, _CL_heap_foreach_node, &walk);
+}
+
+// Walk state for _CL_heap_map
+struct _cl_heap_map {
+    _CL_map_fn fn;
+    void *data;
+};
+
+static bool _CL_heap_map_node(struct _cl_hnode *t, void *data) {
+    struct _cl_heap_map *walk = data;
+    t->element = walk->fn(t->element, walk->data);
+    return true;
+}
+
+static void _CL_heap_map(CList list, _CL_map_fn fn, void *data) {
+    struct _cl_heap_map walk = {fn, data};
+    _CL_hwalk(list->heap, _CL_heap_map_node, &walk);
+}
+
+// Walk state for _CL_heap_find
+struct _cl_heap_find {
+    CListElementType key;
+    int less;
+    int equal;
+};
+
+static bool _CL_heap_find_node(struct _cl_hnode *t, void *data) {
+    struct _cl_heap_find *walk = data;
+    const int cmp = strcmp(t->element, walk->key);
+    // A node greater than key has no smaller descendants
+    if (cmp > 0) return false;
+    if (cmp < 0) {
+        walk->less++;
+    } else {
+        walk->equal++;
+    }
+    return true;
+}
+
+static int _CL_heap_find(CList list, CListElementType key, bool count) {
+    // The first equal element's rank is the number of smaller ones
+    struct _cl_heap_find walk = {key, 0, 0};
+    _CL_hwalk(list->heap, _CL_heap_find_node, &walk);
+
+    if (count) return walk.equal;
+    return walk.equal ? walk.less : -1;
+}
+
+/*
+ * CL_foreach callback used to copy one heap into another
+ */
+static void _CL_heap_copy_element(int pos, CListElementType element, void *cb_data) {
+    (void)pos;
+    _CL_heap_insert((CList)cb_data, element, 0);
+}
+
+static CList _CL_heap_copy(CList list) {
+    CList list_copy = _CL_new_like(list);
+    _CL_heap_foreach(list, _CL_heap_copy_element, list_copy);
+    return list_copy;
+}
+
+static int _CL_heap_insert_sorted(CList list, CListElementType element) {
+    _CL_heap_insert(list, element, 0);
+    return list->heap->element == element ? 0 : -1;
+}
+
+static void _CL_heap_join(CList list1, CList list2) {
+    list1->heap = _CL_hmeld(list1->heap, list2->heap);
+    list1->length += list2->length;
+    list2->heap = NULL;
+    list2->length = 0;
+}
+
+static CList _CL_heap_split(CList list, int pos) {
+    // Peel off the pos smallest nodes; what is left is the tail
+    CList tail = _CL_new_like(list);
+    struct _cl_hnode *head = NULL;
+    _CL_htake(&list->heap, pos, &head);
+    tail->heap = list->heap;
+    tail->length = list->length - pos;
+    list->heap = head;
+    list->length = pos;
+    return tail;
+}
+
+static void _CL_heap_splice(CList dest, int dest_pos, CList src, int start, int end) {
+    (void)dest_pos;
+    // Positions in src are ranks in ascending order; dest_pos has no
+    // meaning in a heap
+    struct _cl_hnode *below = NULL;
+    struct _cl_hnode *range = NULL;
+    _CL_htake(&src->heap, start, &below);
+    _CL_htake(&src->heap, end - start, &range);
+    src->heap = _CL_hmeld(src->heap, below);
+    src->length -= end - start;
+    dest->heap = _CL_hmeld(dest->heap, range);
+    dest->length += end - start;
+}
+
+static void _CL_heap_compact(CList list) {
+    // A priority queue is only read at its head, which every pop
+    // replaces, so there is no lasting order to lay the nodes out in
+    (void)list;
+}
+
+static void _CL_heap_move(CList list, int from, int to) {
+    // Positions are ranks, which a priority queue cannot rearrange
+    (void)list;
+    (void)from;
+    (void)to;
+}
+
+static void _CL_heap_reverse(CList list) {
+    // The order of a priority queue is fixed by its elements
+    (void)list;
+}
+
+const struct _cl_ops _CL_heap_ops = {
+    .destroy = _CL_heap_destroy,
+    .count = _CL_heap_count,
+    .nth = _CL_heap_nth,
+    .insert = _CL_heap_insert,
+    .remove = _CL_heap_remove,
+    .copy = _CL_heap_copy,
+    .insert_sorted = _CL_heap_insert_sorted,
+    .join = _CL_heap_join,
+    .split = _CL_heap_split,
+    .splice = _CL_heap_splice,
+    .reverse = _CL_heap_reverse,
+    .foreach = _CL_heap_foreach,
+    .map = _CL_heap_map,
+    .find = _CL_heap_find,
+    .compact = _CL_heap_compact,
+    .move = _CL_heap_move,
+};
+
+// Documented in .h file
+bool CL_meld(CList list1, CList list2) {
+    assert(list1);
+    assert(list2);
+
+    if (list1->backend != CL_PRIORITY || list2->backend != CL_PRIORITY || list1 == list2) {
+        return false;
+    }
+    CL_join(list1, list2);
+    return true;
+}
@@ -0,0 +1,542 @@
+/*
+ * clist_impl.h
+ *
+ * Private definitions shared by the CList backends. Nothing in this
+ * file is part of the public API; callers should only include clist.h.
+ *
+ */
+
+#ifndef _CLIST_IMPL_H_
+#define _CLIST_IMPL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "clist.h"
+
+// Default bound on the number of free nodes a list keeps for reuse
+#define CL_CACHE_DEFAULT_LIMIT 32
+
+// Default for CL_set_prefetch_distance
+#define CL_PREFETCH_DEFAULT_DISTANCE 0
+
+// Number of elements a CL_LINKED list stores in its struct before it
+// needs nodes
+#define CL_SMALL_CAP 8
+
+// Node of the CL_LINKED backend
+struct _cl_node {
+    CListElementType element;
+    struct _cl_node *next;
+};
+
+// Sort key cached by the nodes of a keyed CL_LINKED list: most
+// comparisons are decided by prefix alone, without touching the string
+struct _cl_key {
+    uint64_t prefix;  // first 8 bytes of the string, big-endian, zero padded
+    size_t len;       // strlen of the string
+};
+
+// Node of a CL_LINKED list created by CL_new_keyed; links are the same
+// as for a _cl_node
+struct _cl_knode {
+    struct _cl_node node;
+    struct _cl_key key;
+};
+
+// Size of the string buffer in the nodes of an inline CL_LINKED list;
+// it makes the node 32 bytes
+#define CL_INLINE_CAP 16
+
+// Node of a CL_LINKED list created by CL_new_inline. A string shorter
+// than CL_INLINE_CAP is copied into buf and element points at it;
+// longer ones are referenced as usual.
+struct _cl_snode {
+    struct _cl_node node;
+    char buf[CL_INLINE_CAP];
+};
+
+/*
+ * Return the first 8 bytes of s as a big-endian integer, zero padded
+ * if s is shorter. Prefixes order as the strings do under strcmp.
+ */
+static inline uint64_t _CL_key_prefix(const char *s) {
+    uint64_t prefix = 0;
+    int i = 0;
+    while (i < 8 && s[i]) prefix = prefix << 8 | (unsigned char)s[i++];
+    return i ? prefix << (8 * (8 - i)) : 0;
+}
+
+/*
+ * Compute the sort key of s
+ */
+static inline struct _cl_key _CL_key_make(const char *s) {
+    struct _cl_key key = {_CL_key_prefix(s), strlen(s)};
+    return key;
+}
+
+/*
+ * Compare two strings with their keys, in the same order as strcmp
+ *
+ * Returns: A value less than, equal to or greater than 0, as strcmp
+ */
+static inline int _CL_key_cmp(const struct _cl_key *a, const char *as, const struct _cl_key *b,
+                              const char *bs) {
+    if (a->prefix != b->prefix) return a->prefix < b->prefix ? -1 : 1;
+    // Equal prefixes with a terminator inside them are equal strings
+    if (a->len < 8 || b->len < 8) return 0;
+    return strcmp(as + 8, bs + 8);
+}
+
+/*
+ * Return the 64-bit FNV-1a hash of a string
+ */
+static inline uint64_t _CL_hash(const char *s) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (; *s; s++) hash = (hash ^ (unsigned char)*s) * 0x100000001b3ull;
+    return hash;
+}
+
+/*
+ * qsort comparator for an array of elements
+ */
+static inline int _CL_element_cmp(const void *a, const void *b) {
+    return strcmp(*(const CListElementType *)a, *(const CListElementType *)b);
+}
+
+// Node of the CL_TREE backend. The tree is an implicit-key treap: a
+// node's position is the size of its left subtree plus the positions
+// to its left, so no keys are stored.
+struct _cl_tnode {
+    CListElementType element;
+    struct _cl_tnode *left;
+    struct _cl_tnode *right;
+    unsigned priority;  // heap-ordered: a parent's priority is >= its children's
+    int size;           // number of nodes in this subtree
+    bool rev;           // children of this subtree are pending a reversal
+};
+
+// Node of the CL_DLINKED backend, and what a CListHandle points to
+struct _cl_dnode {
+    CListElementType element;
+    struct _cl_dnode *next;
+    struct _cl_dnode *prev;
+};
+
+// Node of the CL_PRIORITY backend, a pairing heap. A node's children
+// are chained through their sibling pointers.
+struct _cl_hnode {
+    CListElementType element;
+    struct _cl_hnode *child;
+    struct _cl_hnode *sibling;
+};
+
+// Node of the CL_COMPACT backend. Nodes live in a per-list slab and
+// link to each other by slab index; the element is stored as an offset
+// into the list's string arena.
+struct _cl_cnode {
+    uint32_t next;    // slab index of the next node, or CL_NIL
+    uint32_t offset;  // arena offset of the element's string
+};
+
+// End-of-chain marker for slab indices
+#define CL_NIL UINT32_MAX
+
+// String arena, see clist_arena.c
+#define CL_ARENA_SLOT_SHIFT 12
+#define CL_ARENA_SLOT ((size_t)1 << CL_ARENA_SLOT_SHIFT)
+
+struct _cl_arena_chunk {
+    char *base;
+    size_t size;
+};
+
+struct _cl_arena {
+    char **slots;  // memory backing each CL_ARENA_SLOT bytes of offsets
+    uint32_t nslots;
+    uint32_t slots_cap;
+    struct _cl_arena_chunk *chunks;
+    uint32_t nchunks;
+    uint32_t chunks_cap;
+    uint32_t top;  // offset of the next free byte
+    uint32_t end;  // offset one past the end of the current chunk
+    size_t used;   // bytes of strings stored so far
+    size_t dead;   // bytes of those strings whose elements were removed
+};
+
+/*
+ * Per-backend operations. The public functions in clist.c check and
+ * normalize their arguments, then call through this table, so every
+ * pos handed to a backend is already in range:
+ *
+ *   nth, remove    0 <= pos < length
+ *   insert, split  0 <= pos <= length
+ *   splice         0 <= dest_pos <= dest length, 0 <= start <= end <= src length
+ *
+ * join and splice are only called when both lists share the same
+ * backend, and never with the same list twice.
+ */
+// Function applied to each element by the map operation
+typedef CListElementType (*_CL_map_fn)(CListElementType element, void *data);
+
+struct _cl_ops {
+    void (*destroy)(CList list);  // release all storage except the struct itself
+    int (*count)(CList list);     // DEBUG: recount the elements independently of length
+    CListElementType (*nth)(CList list, int pos);
+    void (*insert)(CList list, CListElementType element, int pos);
+    CListElementType (*remove)(CList list, int pos);
+    CList (*copy)(CList list);
+    int (*insert_sorted)(CList list, CListElementType element);
+    void (*join)(CList list1, CList list2);
+    CList (*split)(CList list, int pos);
+    void (*splice)(CList dest, int dest_pos, CList src, int start, int end);
+    void (*reverse)(CList list);
+    void (*foreach)(CList list, CL_foreach_callback callback, void *cb_data);
+    // replace each element, in any order, with fn's result, which must
+    // be an equal string so that the list's order is unchanged
+    void (*map)(CList list, _CL_map_fn fn, void *data);
+    // position of the first element equal to key, or -1; if count is
+    // set, the number of elements equal to key instead
+    int (*find)(CList list, CListElementType key, bool count);
+    // move the nodes to a block from _CL_block_new, in list order
+    void (*compact)(CList list);
+    // move the element at from so that it ends up at position to;
+    // both are < length
+    void (*move)(CList list, int from, int to);
+};
+
+// Contiguous run of nodes laid out by CL_compact. Lists that split
+// off from the compacted list share it, so it is reference counted;
+// the memory itself goes back once none of its nodes are in use.
+struct _cl_block {
+    char *base;
+    size_t size;  // bytes at base
+    size_t live;  // nodes still in use by some list, including cached ones
+    int refs;     // lists whose block pointer is this block
+};
+
+// A node sitting in a list's cache; the link overlays the node's first word
+struct _cl_free_node {
+    struct _cl_free_node *next;
+};
+
+struct _clist {
+    // Fields used by every operation on a short list come first, so
+    // that they share the first two cache lines
+    const struct _cl_ops *ops;
+    CListBackend backend;
+    int length;
+    struct _cl_node *head;  // CL_LINKED; NULL while the elements are in small
+
+    // CL_LINKED: a list starts out with its elements in small[0..length),
+    // and only moves them to nodes once it outgrows the array. It goes
+    // back to this array whenever it becomes empty.
+    CListElementType small[CL_SMALL_CAP];
+
+    struct _cl_tnode *root;  // CL_TREE
+    unsigned seed;           // CL_TREE: state for node priorities
+    struct _cl_hnode *heap;  // CL_PRIORITY
+    CListElementType *ring;  // CL_DEQUE: circular array of ring_cap slots
+    int ring_cap;            // CL_DEQUE: 0 or a power of two
+    int ring_start;          // CL_DEQUE: index of position 0
+    uint64_t *ring_keys;     // CL_DEQUE: key prefix of each ring slot, for find
+    bool ring_keys_valid;    // CL_DEQUE: ring_keys matches ring
+    struct _cl_cnode *slab;  // CL_COMPACT: slab_cap nodes
+    uint32_t slab_cap;       // CL_COMPACT
+    uint32_t slab_used;      // CL_COMPACT: slots below this have been handed out
+    uint32_t slab_free;      // CL_COMPACT: chain of released slots
+    uint32_t chead;          // CL_COMPACT: index of the first node
+    struct _cl_arena arena;  // CL_COMPACT, or owning: storage for the strings
+    bool owning;             // copy inserted strings into arena; see CL_new_owning
+    bool keyed;              // CL_LINKED: nodes are _cl_knodes; see CL_new_keyed
+    bool sso;                // CL_LINKED: nodes are _cl_snodes; see CL_new_inline
+
+    // CL_DLINKED: the ends of the list; NULL when it is empty
+    struct _cl_dnode *dhead;
+    struct _cl_dnode *dtail;
+
+    // Concurrent CL_LINKED (see clist_rcu.c): removed nodes that
+    // readers may still be on, oldest first
+    struct _cl_retired *retired;
+    int retired_count;
+    int retired_cap;
+
+    // Durable lists (see clist_journal.c): where changes are logged
+    struct _cl_journal *journal;
+
+    // Where changes are sent once the list has subscribers (see
+    // clist_feed.c); NULL until the first CL_subscribe
+    struct _cl_feed *feed;
+
+    // Finds per string counted by CL_find_adaptive; NULL until needed
+    struct _cl_counts *counts;
+
+    // Where CL_insert_sorted starts its next search. CL_LINKED and
+    // CL_DLINKED: finger is the node the last insertion went after, at
+    // finger_pos, or NULL to start from the head; any other change to
+    // the nodes drops it. CL_DEQUE: finger_pos alone, the position of
+    // the last insertion, is only a hint and may be out of range.
+    void *finger;
+    int finger_pos;
+
+    // Blocked Bloom filter that answers most CL_contains misses (see
+    // clist_bloom.c); NULL unless CL_set_filter turned it on
+    struct _cl_filter *filter;
+
+    // Nodes laid out by CL_compact, and the measured fragmentation at
+    // which CL_foreach compacts a CL_LINKED list by itself (0: never)
+    struct _cl_block *block;
+    double compact_threshold;
+
+    // Array of the elements kept by a frozen list (see CL_freeze):
+    // while view_valid, position i is at view[view_start + i]
+    CListElementType *view;
+    int view_cap;
+    int view_start;
+    bool frozen;
+    bool view_valid;
+
+    // Storage for the list and its nodes; alloc_fn == NULL means malloc
+    CL_alloc_fn alloc_fn;
+    CL_free_fn free_fn;
+    void *alloc_ctx;
+
+    // Node cache: removed nodes are kept here, up to cache_limit, and
+    // handed out again before going back to malloc
+    size_t node_size;
+    struct _cl_free_node *cache;
+    int cache_count;
+    int cache_limit;
+    int cache_high_water;
+    unsigned long cache_hits;
+    unsigned long cache_misses;
+};
+
+/*
+ * Mark the array view of a frozen list out of date, after a change it
+ * cannot follow
+ */
+static inline void _CL_view_invalidate(CList list) {
+    list->view_valid = false;
+}
+
+/*
+ * Forget where CL_insert_sorted last inserted, after a change that may
+ * have moved or freed the node it remembers
+ */
+static inline void _CL_finger_drop(CList list) {
+    list->finger = NULL;
+}
+
+/*
+ * Allocate size bytes through the list's allocator.
+ *
+ * Returns: The memory; never NULL
+ */
+void *_CL_alloc(CList list, size_t size);
+
+/*
+ * Release memory obtained from _CL_alloc on the same list
+ */
+void _CL_dealloc(CList list, void *ptr, size_t size);
+
+/*
+ * Create an empty list with the same backend, allocator and cache
+ * limit as list, for operations that derive one list from another.
+ *
+ * Returns: The new list
+ */
+CList _CL_new_like(CList list);
+
+/*
+ * Check whether nodes can be moved directly between two lists: they
+ * must be distinct, on the same backend, and use the same allocator,
+ * and list2's nodes must be freeable by list1.
+ */
+bool _CL_same_storage(CList list1, CList list2);
+
+/*
+ * Allocate a block for count nodes of list, for a backend's compact
+ * operation to copy its nodes into. The block takes effect, replacing
+ * the list's previous one, with _CL_block_install; release the old
+ * nodes before that.
+ *
+ * Returns: The block, with all count nodes live
+ */
+struct _cl_block *_CL_block_new(CList list, size_t count);
+
+/*
+ * Make block the list's node block, dropping the list's reference to
+ * its previous block
+ */
+void _CL_block_install(CList list, struct _cl_block *block);
+
+/*
+ * Allocate storage for one node of list->node_size bytes, from the
+ * list's cache if it has one available.
+ *
+ * Returns: The uninitialized node; never NULL
+ */
+void *_CL_node_alloc(CList list);
+
+/*
+ * Give back a node that was removed from the list, keeping it in the
+ * cache for reuse if there is room.
+ */
+void _CL_node_recycle(CList list, void *node);
+
+/*
+ * Free a node immediately, bypassing the cache. Used when the whole
+ * list is being torn down. A node from the list's block is not freed
+ * on its own; the block is, once its last node is released.
+ */
+void _CL_node_release(CList list, void *node);
+
+/*
+ * Take a block of size bytes from the calling thread's magazine.
+ *
+ * Returns: The block, or NULL if magazines are disabled, do not serve
+ *   this size, or are empty (in which case the caller should malloc)
+ */
+void *_CL_mag_alloc(size_t size);
+
+/*
+ * Put a malloc'd block of size bytes into the calling thread's
+ * magazine.
+ *
+ * Returns: true if the magazine took the block, false if the caller
+ *   should free it
+ */
+bool _CL_mag_free(void *node, size_t size);
+
+/*
+ * Find the first of n key prefixes equal to prefix, using the widest
+ * vector instructions the CPU supports
+ *
+ * Returns: The index of the match, or n if there is none
+ */
+int _CL_prefix_scan(const uint64_t *keys, int n, uint64_t prefix);
+
+/*
+ * Copy s, including its terminator, into the arena.
+ *
+ * Returns: The offset of the copy
+ */
+uint32_t _CL_arena_store(CList list, struct _cl_arena *arena, const char *s);
+
+/*
+ * Return a pointer to the byte at offset in the arena
+ */
+static inline char *_CL_arena_ptr(struct _cl_arena *arena, uint32_t offset) {
+    return arena->slots[offset >> CL_ARENA_SLOT_SHIFT] + (offset & (CL_ARENA_SLOT - 1));
+}
+
+/*
+ * Release every chunk of the arena, leaving it empty
+ */
+void _CL_arena_free(CList list, struct _cl_arena *arena);
+
+/*
+ * _CL_map_fn that copies element into the arena of the list passed as
+ * data.
+ *
+ * Returns: The copy
+ */
+CListElementType _CL_arena_adopt(CListElementType element, void *data);
+
+/*
+ * Copy every string of list into another arena and drop the old one,
+ * for CL_COMPACT lists, whose elements are arena offsets
+ */
+void _CL_compact_restore(CList list);
+
+/*
+ * Return the node at pos of a CL_DLINKED list, walking from the nearer
+ * end, or NULL if pos is the length
+ */
+struct _cl_dnode *_CL_dlist_at(CList list, int pos);
+
+/*
+ * Return the position of a CL_DLINKED node by walking back to the head
+ */
+int _CL_dlist_pos(const struct _cl_dnode *node);
+
+/*
+ * Link node into a CL_DLINKED list before next, or at the end if next
+ * is NULL
+ */
+void _CL_dlist_link(CList list, struct _cl_dnode *node, struct _cl_dnode *next);
+
+/*
+ * Link a new node holding element into a CL_DLINKED list before next,
+ * or at the end if next is NULL
+ *
+ * Returns: The new node
+ */
+struct _cl_dnode *_CL_dlist_new(CList list, CListElementType element, struct _cl_dnode *next);
+
+/*
+ * Unlink node from a CL_DLINKED list without freeing it
+ */
+void _CL_dlist_unlink(CList list, struct _cl_dnode *node);
+
+/*
+ * Free the counts kept for CL_find_adaptive's CL_FIND_COUNT policy
+ */
+void _CL_counts_free(CList list);
+
+/*
+ * Log changes to a durable list, after making them: an insert at pos,
+ * the removal of positions [start, end), the move of the element at
+ * from to position to, or a reversal
+ */
+void _CL_journal_insert(CList list, int pos, CListElementType element);
+void _CL_journal_remove(CList list, int start, int end);
+void _CL_journal_move(CList list, int from, int to);
+void _CL_journal_reverse(CList list);
+
+/*
+ * Finish logging one public operation on a durable list, checkpointing
+ * if its records made the journal due for it. Operations that log more
+ * than one record call this once, after the last.
+ */
+void _CL_journal_end(CList list);
+
+/*
+ * Commit what a durable list has logged and close its journal
+ */
+void _CL_journal_close(CList list);
+
+/*
+ * Send changes to the subscribers of a list, after making them: an
+ * insert at pos, the removal of count elements from pos (element is
+ * the removed one when count is 1), or a reversal
+ */
+void _CL_feed_insert(CList list, int pos, CListElementType element);
+void _CL_feed_remove(CList list, int pos, int count, CListElementType element);
+void _CL_feed_reverse(CList list);
+
+/*
+ * Let go of a list's feed as the list is freed; subscribers can still
+ * read what was sent
+ */
+void _CL_feed_detach(CList list);
+
+/*
+ * Keep the membership filter of a list up to date, after changing the
+ * list: an element was inserted, count elements were removed, or so
+ * many changed at once that the filter is built again when next used
+ */
+void _CL_filter_add(CList list, CListElementType element);
+void _CL_filter_removed(CList list, int count);
+void _CL_filter_invalidate(CList list);
+
+extern const struct _cl_ops _CL_tree_ops;
+extern const struct _cl_ops _CL_deque_ops;
+extern const struct _cl_ops _CL_heap_ops;
+extern const struct _cl_ops _CL_compact_ops;
+extern const struct _cl_ops _CL_dlist_ops;
+extern const struct _cl_ops _CL_rcu_ops;
+
+#endif /* _CLIST_IMPL_H_ */
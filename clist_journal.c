@@ -0,0 +1,605 @@
+/*
+ * clist_journal.c
+ *
+ * Durable lists (see CL_open_durable). A durable list lives in two
+ * files: a snapshot of its elements at some point, and a journal of
+ * the changes made since. Opening the list loads the snapshot and
+ * replays the journal; CL_checkpoint writes a new snapshot and empties
+ * the journal.
+ *
+ * Both files start with a generation number. A checkpoint writes the
+ * snapshot for the next generation under a temporary name, renames it
+ * into place, and only then starts a journal of that generation, so a
+ * journal older than the snapshot is already contained in it and is
+ * ignored.
+ *
+ * Journal records are framed as
+ *
+ *   u32 payload length | u32 FNV-1a hash of payload | payload
+ *
+ * where the payload is one op byte followed by the op's fields, all in
+ * host byte order. Replay stops at the first record that is cut short
+ * or fails its hash, which is where a crash interrupted a write, and
+ * the journal is truncated there.
+ *
+ * Records are buffered, and written and fsynced together (group
+ * commit) when the buffer fills, when the commit interval has passed
+ * since the last commit, or on CL_sync.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "clist_impl.h"
+
+// Default for CL_set_group_commit
+#define CL_JOURNAL_DEFAULT_INTERVAL_MS 10
+
+// Buffered record bytes that force a commit
+#define CL_JOURNAL_BATCH ((size_t)1 << 16)
+
+// The journal is checkpointed once it is larger than this and than
+// twice the snapshot
+#define CL_CHECKPOINT_MIN ((size_t)1 << 20)
+
+#define CL_SNAPSHOT_MAGIC "CLSNAP1"
+#define CL_JOURNAL_MAGIC "CLJRNL1"
+
+// File header: 8 magic bytes (7 characters and a terminator), then the generation
+#define CL_HEADER_SIZE (8 + sizeof(uint64_t))
+
+// Size of a record's length and hash
+#define CL_RECORD_FRAME (2 * sizeof(uint32_t))
+
+// Journal ops
+enum {
+    CL_JOP_INSERT = 1,  // i32 pos, then the string's bytes
+    CL_JOP_REMOVE,      // i32 start, i32 end: remove positions [start, end)
+    CL_JOP_REVERSE,     // no fields
+    CL_JOP_MOVE,        // i32 from, i32 to: move the element at from to position to
+};
+
+struct _cl_journal {
+    char *path;  // the snapshot; the journal and temporary files add a suffix
+    int fd;      // the journal
+    uint64_t generation;
+    char *buf;  // records not yet written
+    size_t used;
+    size_t cap;
+    size_t log_size;       // bytes in the journal, including buf
+    size_t snapshot_size;  // bytes in the snapshot
+    int interval_ms;
+    struct timespec last_commit;
+    bool failed;  // a write or fsync failed; changes since may be lost
+    bool checkpoint_due;  // checkpoint once the operation being logged is done
+};
+
+/*
+ * Hash bytes with 32-bit FNV-1a, continuing from hash
+ */
+static uint32_t _CL_fnv32(uint32_t hash, const void *bytes, size_t n) {
+    const unsigned char *p = bytes;
+    for (size_t i = 0; i < n; i++) hash = (hash ^ p[i]) * 16777619u;
+    return hash;
+}
+
+#define CL_FNV32_INIT 2166136261u
+
+/*
+ * Return path with suffix appended, in memory the caller must free
+ */
+static char *_CL_path_with(const char *path, const char *suffix) {
+    char *s = malloc(strlen(path) + strlen(suffix) + 1);
+    assert(s);
+    strcpy(s, path);
+    strcat(s, suffix);
+    return s;
+}
+
+/*
+ * Write all n bytes, retrying interrupted and partial writes
+ *
+ * Returns: true on success
+ */
+static bool _CL_write_all(int fd, const void *bytes, size_t n) {
+    const char *p = bytes;
+    while (n) {
+        const ssize_t written = write(fd, p, n);
+        if (written <= 0) {
+            if (written < 0 && errno == EINTR) continue;
+            return false;
+        }
+        p += written;
+        n -= written;
+    }
+    return true;
+}
+
+/*
+ * Read a whole file into memory
+ *
+ * Returns: The contents, which the caller must free, or NULL with
+ *   errno set; *size is set to the length
+ */
+static char *_CL_read_file(int fd, size_t *size) {
+    struct stat st;
+    if (fstat(fd, &st) < 0) return NULL;
+    char *data = malloc(st.st_size ? st.st_size : 1);
+    assert(data);
+    size_t got = 0;
+    while (got < (size_t)st.st_size) {
+        const ssize_t n = pread(fd, data + got, st.st_size - got, got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            free(data);
+            return NULL;
+        }
+        got += n;
+    }
+    *size = got;
+    return data;
+}
+
+/*
+ * fsync the directory holding path, so that a rename in it is durable
+ */
+static bool _CL_sync_dir(const char *path) {
+    char *dir = strdup(path);
+    assert(dir);
+    char *slash = strrchr(dir, '/');
+    if (slash == NULL) {
+        strcpy(dir, ".");
+    } else if (slash == dir) {
+        dir[1] = '\0';
+    } else {
+        *slash = '\0';
+    }
+    const int fd = open(dir, O_RDONLY);
+    free(dir);
+    if (fd < 0) return false;
+    const bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+/*
+ * Fill in a file header for generation
+ */
+static void _CL_header(char *header, const char *magic, uint64_t generation) {
+    memcpy(header, magic, 8);
+    memcpy(header + 8, &generation, sizeof(generation));
+}
+
+/*
+ * Check a file header
+ *
+ * Returns: true, setting *generation, if data starts with a header
+ *   with the given magic
+ */
+static bool _CL_parse_header(const char *data, size_t size, const char *magic,
+                             uint64_t *generation) {
+    if (size < CL_HEADER_SIZE || memcmp(data, magic, 8) != 0) return false;
+    memcpy(generation, data + 8, sizeof(*generation));
+    return true;
+}
+
+/*
+ * Return milliseconds from a to b
+ */
+static double _CL_elapsed_ms(const struct timespec *a, const struct timespec *b) {
+    return (b->tv_sec - a->tv_sec) * 1e3 + (b->tv_nsec - a->tv_nsec) / 1e6;
+}
+
+/*
+ * Write out the buffered records and fsync the journal
+ *
+ * Returns: true on success
+ */
+static bool _CL_journal_commit(struct _cl_journal *journal) {
+    if (journal->used) {
+        if (!_CL_write_all(journal->fd, journal->buf, journal->used) || fsync(journal->fd) != 0) {
+            journal->failed = true;
+        }
+        journal->used = 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &journal->last_commit);
+    return !journal->failed;
+}
+
+/*
+ * Make room for n more bytes in the record buffer
+ */
+static void _CL_journal_reserve(struct _cl_journal *journal, size_t n) {
+    if (journal->used + n <= journal->cap) return;
+    size_t cap = journal->cap ? journal->cap : 4096;
+    while (cap < journal->used + n) cap *= 2;
+    journal->buf = realloc(journal->buf, cap);
+    assert(journal->buf);
+    journal->cap = cap;
+}
+
+/*
+ * Add a record to the journal of list, committing if it is time to.
+ * A checkpoint that is due waits for _CL_journal_end: taken between
+ * two records of one operation, its snapshot would already hold the
+ * whole operation, and the records after it would be replayed on top.
+ */
+static void _CL_journal_record(CList list, char op, const void *fields, size_t fields_size,
+                               const char *string, size_t string_size) {
+    struct _cl_journal *journal = list->journal;
+
+    const uint32_t length = 1 + fields_size + string_size;
+    uint32_t hash = _CL_fnv32(CL_FNV32_INIT, &op, 1);
+    hash = _CL_fnv32(hash, fields, fields_size);
+    hash = _CL_fnv32(hash, string, string_size);
+
+    _CL_journal_reserve(journal, CL_RECORD_FRAME + length);
+    char *p = journal->buf + journal->used;
+    memcpy(p, &length, sizeof(length));
+    memcpy(p + sizeof(length), &hash, sizeof(hash));
+    p += CL_RECORD_FRAME;
+    *p++ = op;
+    if (fields_size) memcpy(p, fields, fields_size);
+    if (string_size) memcpy(p + fields_size, string, string_size);
+    journal->used += CL_RECORD_FRAME + length;
+    journal->log_size += CL_RECORD_FRAME + length;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (journal->used >= CL_JOURNAL_BATCH ||
+        _CL_elapsed_ms(&journal->last_commit, &now) >= journal->interval_ms) {
+        _CL_journal_commit(journal);
+    }
+
+    if (journal->log_size > CL_CHECKPOINT_MIN && journal->log_size > 2 * journal->snapshot_size) {
+        journal->checkpoint_due = true;
+    }
+}
+
+// Documented in clist_impl.h
+void _CL_journal_end(CList list) {
+    if (list->journal->checkpoint_due) CL_checkpoint(list);
+}
+
+// Documented in clist_impl.h
+void _CL_journal_insert(CList list, int pos, CListElementType element) {
+    const int32_t fields[1] = {pos};
+    _CL_journal_record(list, CL_JOP_INSERT, fields, sizeof(fields), element, strlen(element));
+}
+
+// Documented in clist_impl.h
+void _CL_journal_remove(CList list, int start, int end) {
+    if (start == end) return;
+    const int32_t fields[2] = {start, end};
+    _CL_journal_record(list, CL_JOP_REMOVE, fields, sizeof(fields), NULL, 0);
+}
+
+// Documented in clist_impl.h
+void _CL_journal_move(CList list, int from, int to) {
+    const int32_t fields[2] = {from, to};
+    _CL_journal_record(list, CL_JOP_MOVE, fields, sizeof(fields), NULL, 0);
+}
+
+// Documented in clist_impl.h
+void _CL_journal_reverse(CList list) {
+    _CL_journal_record(list, CL_JOP_REVERSE, NULL, 0, NULL, 0);
+}
+
+// Documented in clist_impl.h
+void _CL_journal_close(CList list) {
+    struct _cl_journal *journal = list->journal;
+    _CL_journal_commit(journal);
+    close(journal->fd);
+    free(journal->buf);
+    free(journal->path);
+    free(journal);
+    list->journal = NULL;
+}
+
+/*
+ * Remove positions [start, end) from a list that is not journaled
+ */
+static void _CL_remove_range(CList list, int start, int end) {
+    if (end == list->length) {
+        CL_free(CL_split(list, start));
+        return;
+    }
+    for (int i = start; i < end; i++) CL_remove(list, start);
+}
+
+/*
+ * Apply the valid records of a journal to list
+ *
+ * Returns: The length of the valid part of the journal
+ */
+static size_t _CL_journal_replay(CList list, const char *data, size_t size) {
+    size_t offset = CL_HEADER_SIZE;
+    while (size - offset >= CL_RECORD_FRAME) {
+        uint32_t length, hash;
+        memcpy(&length, data + offset, sizeof(length));
+        memcpy(&hash, data + offset + sizeof(length), sizeof(hash));
+        const char *payload = data + offset + CL_RECORD_FRAME;
+        if (length == 0 || length > size - offset - CL_RECORD_FRAME) break;
+        if (_CL_fnv32(CL_FNV32_INIT, payload, length) != hash) break;
+
+        int32_t fields[2];
+        const size_t fields_size = payload[0] == CL_JOP_INSERT ? sizeof(int32_t)
+                                   : payload[0] == CL_JOP_REMOVE || payload[0] == CL_JOP_MOVE
+                                       ? 2 * sizeof(int32_t)
+                                       : 0;
+        if (length < 1 + fields_size) break;
+        memcpy(fields, payload + 1, fields_size);
+
+        if (payload[0] == CL_JOP_INSERT) {
+            // The string is not terminated in the journal
+            const size_t string_size = length - 1 - fields_size;
+            char *element = malloc(string_size + 1);
+            assert(element);
+            memcpy(element, payload + 1 + fields_size, string_size);
+            element[string_size] = '\0';
+            const bool ok = fields[0] >= 0 && CL_insert(list, element, fields[0]);
+            free(element);
+            if (!ok) break;
+        } else if (payload[0] == CL_JOP_REMOVE) {
+            if (fields[0] < 0 || fields[0] > fields[1] || fields[1] > list->length) break;
+            _CL_remove_range(list, fields[0], fields[1]);
+        } else if (payload[0] == CL_JOP_REVERSE) {
+            CL_reverse(list);
+        } else if (payload[0] == CL_JOP_MOVE) {
+            if (fields[0] < 0 || fields[0] >= list->length || fields[1] < 0 ||
+                fields[1] >= list->length) {
+                break;
+            }
+            list->ops->move(list, fields[0], fields[1]);
+            _CL_view_invalidate(list);
+        } else {
+            break;
+        }
+        offset += CL_RECORD_FRAME + length;
+    }
+    return offset;
+}
+
+/*
+ * Load a snapshot into an empty list
+ *
+ * Returns: true if the snapshot was well formed
+ */
+static bool _CL_snapshot_load(CList list, const char *data, size_t size) {
+    size_t offset = CL_HEADER_SIZE;
+    uint32_t count;
+    if (size - offset < sizeof(count)) return false;
+    memcpy(&count, data + offset, sizeof(count));
+    offset += sizeof(count);
+
+    // Find every string first, so that they can be pushed from the back
+    const char **strings = malloc((count ? count : 1) * sizeof(*strings));
+    uint32_t *lengths = malloc((count ? count : 1) * sizeof(*lengths));
+    assert(strings && lengths);
+    uint32_t hash = CL_FNV32_INIT;
+    bool ok = true;
+    for (uint32_t i = 0; ok && i < count; i++) {
+        if (size - offset < sizeof(uint32_t)) {
+            ok = false;
+            break;
+        }
+        memcpy(&lengths[i], data + offset, sizeof(uint32_t));
+        offset += sizeof(uint32_t);
+        if (size - offset < lengths[i]) {
+            ok = false;
+            break;
+        }
+        strings[i] = data + offset;
+        hash = _CL_fnv32(hash, strings[i], lengths[i]);
+        offset += lengths[i];
+    }
+    uint32_t stored_hash;
+    if (!ok || size - offset != sizeof(stored_hash)) {
+        ok = false;
+    } else {
+        memcpy(&stored_hash, data + offset, sizeof(stored_hash));
+        ok = stored_hash == hash;
+    }
+
+    for (uint32_t i = count; ok && i > 0; i--) {
+        char *element = malloc(lengths[i - 1] + 1);
+        assert(element);
+        memcpy(element, strings[i - 1], lengths[i - 1]);
+        element[lengths[i - 1]] = '\0';
+        CL_push(list, element);
+        free(element);
+    }
+    free(strings);
+    free(lengths);
+    return ok;
+}
+
+// Buffered writer for a snapshot
+struct _cl_snapshot_writer {
+    int fd;
+    char *buf;
+    size_t used;
+    size_t written;
+    uint32_t hash;
+    bool failed;
+};
+
+/*
+ * Add bytes to a snapshot
+ */
+static void _CL_snapshot_put(struct _cl_snapshot_writer *w, const void *bytes, size_t n) {
+    if (w->used + n > CL_JOURNAL_BATCH) {
+        if (!_CL_write_all(w->fd, w->buf, w->used)) w->failed = true;
+        w->used = 0;
+    }
+    if (n > CL_JOURNAL_BATCH) {
+        if (!_CL_write_all(w->fd, bytes, n)) w->failed = true;
+    } else {
+        memcpy(w->buf + w->used, bytes, n);
+        w->used += n;
+    }
+    w->written += n;
+}
+
+/*
+ * CL_foreach callback that adds an element to a snapshot
+ */
+static void _CL_snapshot_element(int pos, CListElementType element, void *cb_data) {
+    (void)pos;
+    struct _cl_snapshot_writer *w = cb_data;
+    const uint32_t length = strlen(element);
+    _CL_snapshot_put(w, &length, sizeof(length));
+    _CL_snapshot_put(w, element, length);
+    w->hash = _CL_fnv32(w->hash, element, length);
+}
+
+// Documented in .h file
+bool CL_checkpoint(CList list) {
+    assert(list);
+    struct _cl_journal *journal = list->journal;
+    if (journal == NULL) return true;
+
+    // Everything logged so far is durable before the snapshot replaces it
+    if (!_CL_journal_commit(journal)) return false;
+
+    char *tmp_path = _CL_path_with(journal->path, ".tmp");
+    struct _cl_snapshot_writer w = {.fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644)};
+    if (w.fd < 0) {
+        free(tmp_path);
+        return false;
+    }
+    w.buf = malloc(CL_JOURNAL_BATCH);
+    assert(w.buf);
+    w.hash = CL_FNV32_INIT;
+
+    char header[CL_HEADER_SIZE];
+    _CL_header(header, CL_SNAPSHOT_MAGIC, journal->generation + 1);
+    _CL_snapshot_put(&w, header, sizeof(header));
+    const uint32_t count = list->length;
+    _CL_snapshot_put(&w, &count, sizeof(count));
+    list->ops->foreach(list, _CL_snapshot_element, &w);
+    _CL_snapshot_put(&w, &w.hash, sizeof(w.hash));
+    if (!_CL_write_all(w.fd, w.buf, w.used)) w.failed = true;
+    if (fsync(w.fd) != 0) w.failed = true;
+    close(w.fd);
+    free(w.buf);
+
+    if (w.failed || rename(tmp_path, journal->path) != 0 || !_CL_sync_dir(journal->path)) {
+        unlink(tmp_path);
+        free(tmp_path);
+        return false;
+    }
+    free(tmp_path);
+
+    // The new snapshot is in place; start the journal of its generation
+    journal->generation++;
+    journal->snapshot_size = w.written;
+    _CL_header(header, CL_JOURNAL_MAGIC, journal->generation);
+    if (ftruncate(journal->fd, 0) != 0 || lseek(journal->fd, 0, SEEK_SET) < 0 ||
+        !_CL_write_all(journal->fd, header, sizeof(header)) || fsync(journal->fd) != 0) {
+        journal->failed = true;
+    }
+    journal->log_size = CL_HEADER_SIZE;
+    journal->checkpoint_due = false;
+    return !journal->failed;
+}
+
+// Documented in .h file
+CList CL_open_durable(const char *path, CListBackend backend) {
+    assert(path);
+    CList list = CL_new_owning(backend);
+
+    // The snapshot, if there is one
+    uint64_t generation = 0;
+    size_t snapshot_size = 0;
+    const int snapshot_fd = open(path, O_RDONLY);
+    if (snapshot_fd >= 0) {
+        char *data = _CL_read_file(snapshot_fd, &snapshot_size);
+        close(snapshot_fd);
+        const bool ok =
+            data && _CL_parse_header(data, snapshot_size, CL_SNAPSHOT_MAGIC, &generation) &&
+            _CL_snapshot_load(list, data, snapshot_size);
+        free(data);
+        if (!ok) {
+            CL_free(list);
+            return NULL;
+        }
+    } else if (errno != ENOENT) {
+        CL_free(list);
+        return NULL;
+    }
+
+    // The journal, if it belongs to this snapshot
+    char *journal_path = _CL_path_with(path, ".journal");
+    const int fd = open(journal_path, O_RDWR | O_CREAT, 0644);
+    free(journal_path);
+    if (fd < 0) {
+        CL_free(list);
+        return NULL;
+    }
+    size_t size = 0;
+    char *data = _CL_read_file(fd, &size);
+    uint64_t journal_generation;
+    size_t valid = 0;
+    if (data && _CL_parse_header(data, size, CL_JOURNAL_MAGIC, &journal_generation)) {
+        if (journal_generation > generation) {
+            // The snapshot this journal follows is gone
+            free(data);
+            close(fd);
+            CL_free(list);
+            return NULL;
+        }
+        if (journal_generation == generation) valid = _CL_journal_replay(list, data, size);
+    }
+    free(data);
+
+    if (valid == 0) {
+        // A new or stale journal starts over
+        char header[CL_HEADER_SIZE];
+        _CL_header(header, CL_JOURNAL_MAGIC, generation);
+        if (ftruncate(fd, 0) != 0 || !_CL_write_all(fd, header, sizeof(header)) || fsync(fd) != 0) {
+            close(fd);
+            CL_free(list);
+            return NULL;
+        }
+        valid = CL_HEADER_SIZE;
+    } else if (valid < size && ftruncate(fd, valid) != 0) {
+        close(fd);
+        CL_free(list);
+        return NULL;
+    }
+    lseek(fd, valid, SEEK_SET);
+
+    struct _cl_journal *journal = calloc(1, sizeof(*journal));
+    assert(journal);
+    journal->path = strdup(path);
+    assert(journal->path);
+    journal->fd = fd;
+    journal->generation = generation;
+    journal->log_size = valid;
+    journal->snapshot_size = snapshot_size;
+    journal->interval_ms = CL_JOURNAL_DEFAULT_INTERVAL_MS;
+    clock_gettime(CLOCK_MONOTONIC, &journal->last_commit);
+    list->journal = journal;
+    return list;
+}
+
+// Documented in .h file
+bool CL_sync(CList list) {
+    assert(list);
+    return list->journal == NULL || _CL_journal_commit(list->journal);
+}
+
+// Documented in .h file
+void CL_set_group_commit(CList list, int interval_ms) {
+    assert(list);
+    assert(interval_ms >= 0);
+    if (list->journal) list->journal->interval_ms = interval_ms;
+}
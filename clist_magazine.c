@@ -0,0 +1,217 @@
+/*
+ * clist_magazine.c
+ *
+ * Thread-local node magazines. When enabled, node storage that misses
+ * a list's own cache comes from a per-thread stack of free blocks
+ * instead of the global heap. A thread whose stack runs dry takes a
+ * whole magazine (a chain of CL_MAG_ROUNDS blocks) from a shared
+ * depot, and a thread whose stack overflows hands a magazine back, so
+ * the depot lock is taken once per CL_MAG_ROUNDS operations at most.
+ *
+ * All blocks of one size class are interchangeable and come from
+ * malloc, so a node may be freed on a different thread than the one
+ * that allocated it: it simply joins the freeing thread's stack.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "clist_impl.h"
+
+// Blocks are sorted into classes of 8, 16, ... CL_MAG_CLASSES * 8 bytes
+#define CL_MAG_CLASSES 8
+
+// Number of blocks moved between a thread and the depot at once
+#define CL_MAG_ROUNDS 64
+
+// Full magazines the depot keeps per class; beyond this they are freed
+#define CL_MAG_DEPOT_LIMIT 256
+
+// A free block. next links the blocks of a magazine; next_magazine
+// links magazines in the depot and is only valid on a magazine's first
+// block.
+struct _cl_mag_block {
+    struct _cl_mag_block *next;
+    struct _cl_mag_block *next_magazine;
+};
+
+// The calling thread's stack of free blocks for one class
+struct _cl_thread_mag {
+    struct _cl_mag_block *top;
+    int count;
+};
+
+// The shared depot for one class
+struct _cl_depot {
+    pthread_mutex_t lock;
+    struct _cl_mag_block *magazines;
+    int count;
+};
+
+static atomic_bool _CL_mag_enabled = false;
+
+static __thread struct _cl_thread_mag _CL_tmag[CL_MAG_CLASSES];
+static __thread bool _CL_tmag_registered = false;
+
+static struct _cl_depot _CL_depot[CL_MAG_CLASSES] = {
+    [0 ... CL_MAG_CLASSES - 1] = {PTHREAD_MUTEX_INITIALIZER, NULL, 0},
+};
+
+static pthread_key_t _CL_mag_key;
+static pthread_once_t _CL_mag_key_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Return the class serving blocks of size bytes, or -1 if blocks of
+ * that size are not kept in magazines
+ */
+static inline int _CL_mag_class(size_t size) {
+    if (size < sizeof(struct _cl_mag_block) || size % 8 != 0 || size > CL_MAG_CLASSES * 8) {
+        return -1;
+    }
+    return (int)(size / 8) - 1;
+}
+
+/*
+ * Hand a chain of blocks to the depot of class cls, freeing it
+ * instead if the depot is full
+ */
+static void _CL_depot_put(int cls, struct _cl_mag_block *magazine) {
+    struct _cl_depot *depot = &_CL_depot[cls];
+
+    pthread_mutex_lock(&depot->lock);
+    if (depot->count < CL_MAG_DEPOT_LIMIT) {
+        magazine->next_magazine = depot->magazines;
+        depot->magazines = magazine;
+        depot->count++;
+        magazine = NULL;
+    }
+    pthread_mutex_unlock(&depot->lock);
+
+    while (magazine) {
+        struct _cl_mag_block *temp = magazine;
+        magazine = magazine->next;
+        free(temp);
+    }
+}
+
+/*
+ * Take a chain of blocks from the depot of class cls
+ *
+ * Returns: The first block of the chain, or NULL if the depot is empty
+ */
+static struct _cl_mag_block *_CL_depot_get(int cls) {
+    struct _cl_depot *depot = &_CL_depot[cls];
+
+    pthread_mutex_lock(&depot->lock);
+    struct _cl_mag_block *magazine = depot->magazines;
+    if (magazine) {
+        depot->magazines = magazine->next_magazine;
+        depot->count--;
+    }
+    pthread_mutex_unlock(&depot->lock);
+
+    return magazine;
+}
+
+/*
+ * Thread exit destructor: return the exiting thread's blocks to the
+ * depot so other threads can use them
+ */
+static void _CL_mag_thread_exit(void *unused) {
+    (void)unused;
+    for (int cls = 0; cls < CL_MAG_CLASSES; cls++) {
+        if (_CL_tmag[cls].top) _CL_depot_put(cls, _CL_tmag[cls].top);
+        _CL_tmag[cls].top = NULL;
+        _CL_tmag[cls].count = 0;
+    }
+}
+
+static void _CL_mag_key_create() {
+    int rc = pthread_key_create(&_CL_mag_key, _CL_mag_thread_exit);
+    assert(rc == 0);
+    (void)rc;
+}
+
+/*
+ * Arrange for the calling thread's blocks to be handed back to the
+ * depot when it exits. Called whenever the thread takes blocks it did
+ * not get from the heap, so that a thread which only allocates does
+ * not take a magazine with it.
+ */
+static inline void _CL_mag_register() {
+    if (_CL_tmag_registered) return;
+    pthread_once(&_CL_mag_key_once, _CL_mag_key_create);
+    pthread_setspecific(_CL_mag_key, _CL_tmag);
+    _CL_tmag_registered = true;
+}
+
+// Documented in clist_impl.h
+void *_CL_mag_alloc(size_t size) {
+    if (!atomic_load_explicit(&_CL_mag_enabled, memory_order_relaxed)) return NULL;
+    const int cls = _CL_mag_class(size);
+    if (cls < 0) return NULL;
+
+    struct _cl_thread_mag *mag = &_CL_tmag[cls];
+    if (mag->top == NULL) {
+        mag->top = _CL_depot_get(cls);
+        mag->count = 0;
+        for (struct _cl_mag_block *b = mag->top; b != NULL; b = b->next) mag->count++;
+        if (mag->top == NULL) return NULL;
+        _CL_mag_register();
+    }
+
+    struct _cl_mag_block *block = mag->top;
+    mag->top = block->next;
+    mag->count--;
+    return block;
+}
+
+// Documented in clist_impl.h
+bool _CL_mag_free(void *node, size_t size) {
+    if (!atomic_load_explicit(&_CL_mag_enabled, memory_order_relaxed)) return false;
+    const int cls = _CL_mag_class(size);
+    if (cls < 0) return false;
+
+    _CL_mag_register();
+
+    struct _cl_thread_mag *mag = &_CL_tmag[cls];
+    struct _cl_mag_block *block = (struct _cl_mag_block *)node;
+    block->next = mag->top;
+    mag->top = block;
+    mag->count++;
+
+    if (mag->count >= 2 * CL_MAG_ROUNDS) {
+        // Keep the top CL_MAG_ROUNDS blocks, which are the most recently
+        // used, and spill the rest as one magazine
+        struct _cl_mag_block *last = mag->top;
+        for (int i = 1; i < CL_MAG_ROUNDS; i++) last = last->next;
+        struct _cl_mag_block *spill = last->next;
+        last->next = NULL;
+        mag->count = CL_MAG_ROUNDS;
+        _CL_depot_put(cls, spill);
+    }
+    return true;
+}
+
+// Documented in .h file
+void CL_set_magazines(bool enable) {
+    atomic_store(&_CL_mag_enabled, enable);
+}
+
+// Documented in .h file
+void CL_flush_magazines() {
+    _CL_mag_thread_exit(NULL);
+
+    for (int cls = 0; cls < CL_MAG_CLASSES; cls++) {
+        struct _cl_mag_block *magazine;
+        while ((magazine = _CL_depot_get(cls)) != NULL) {
+            while (magazine) {
+                struct _cl_mag_block *temp = magazine;
+                magazine = magazine->next;
+                free(temp);
+            }
+        }
+    }
+}
@@ -0,0 +1,442 @@
+/*
+ * clist_rcu.c
+ *
+ * Concurrent CL_LINKED lists (see CL_new_concurrent). Any number of
+ * threads read a list while one thread at a time changes it, and
+ * readers take no locks: they only announce, in a per-thread record,
+ * the epoch in which their read began.
+ *
+ * The writer never changes a node that readers may be on, except for
+ * its next link, which it stores with release semantics after the
+ * node it points at is complete. A reader therefore always sees either
+ * the old or the new chain. A removed node is not freed at once but
+ * retired, tagged with the global epoch, which is then advanced; it is
+ * freed once every reader that announced that epoch or an earlier one
+ * has finished. Readers that begin later cannot reach the node.
+ *
+ * The epoch and the reader records are shared by all concurrent lists,
+ * so a node may safely move from one concurrent list to another while
+ * readers of the first are still on it.
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clist_impl.h"
+
+// Retired nodes a list accumulates between attempts to free them
+#define CL_RCU_BATCH 64
+
+// Per-thread reader record. Records are only ever added to the
+// registry; a record whose thread has exited is reused by the next
+// thread that reads.
+struct _cl_rcu_reader {
+    _Alignas(64) atomic_ulong epoch;  // epoch the current read began in; 0 outside reads
+    int depth;                        // nesting of reads; only used by the owning thread
+    atomic_bool in_use;
+    struct _cl_rcu_reader *next;
+};
+
+// A node waiting for the readers that may see it to finish
+struct _cl_retired {
+    struct _cl_node *node;
+    unsigned long epoch;
+};
+
+static atomic_ulong _CL_rcu_epoch = 1;
+static _Atomic(struct _cl_rcu_reader *) _CL_rcu_readers = NULL;
+
+static __thread struct _cl_rcu_reader *_CL_rcu_self = NULL;
+
+static pthread_key_t _CL_rcu_key;
+static pthread_once_t _CL_rcu_key_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Thread exit destructor: give up the exiting thread's reader record
+ */
+static void _CL_rcu_thread_exit(void *record) {
+    struct _cl_rcu_reader *self = (struct _cl_rcu_reader *)record;
+    atomic_store(&self->epoch, 0);
+    atomic_store(&self->in_use, false);
+}
+
+static void _CL_rcu_key_create() {
+    int rc = pthread_key_create(&_CL_rcu_key, _CL_rcu_thread_exit);
+    assert(rc == 0);
+    (void)rc;
+}
+
+/*
+ * Find or create the calling thread's reader record
+ */
+static struct _cl_rcu_reader *_CL_rcu_register() {
+    struct _cl_rcu_reader *self = NULL;
+    for (struct _cl_rcu_reader *r = atomic_load(&_CL_rcu_readers); r != NULL; r = r->next) {
+        bool expected = false;
+        if (atomic_compare_exchange_strong(&r->in_use, &expected, true)) {
+            self = r;
+            break;
+        }
+    }
+
+    if (self == NULL) {
+        self = (struct _cl_rcu_reader *)aligned_alloc(64, sizeof(*self));
+        assert(self);
+        atomic_init(&self->epoch, 0);
+        atomic_init(&self->in_use, true);
+        self->next = atomic_load(&_CL_rcu_readers);
+        while (!atomic_compare_exchange_weak(&_CL_rcu_readers, &self->next, self)) {
+        }
+    }
+    self->depth = 0;
+
+    pthread_once(&_CL_rcu_key_once, _CL_rcu_key_create);
+    pthread_setspecific(_CL_rcu_key, self);
+    _CL_rcu_self = self;
+    return self;
+}
+
+/*
+ * Begin a read of a concurrent list. Reads nest, so a CL_foreach
+ * callback may read the list again.
+ *
+ * Returns: The calling thread's record, for _CL_rcu_read_end
+ */
+static inline struct _cl_rcu_reader *_CL_rcu_read_begin() {
+    struct _cl_rcu_reader *self = _CL_rcu_self ? _CL_rcu_self : _CL_rcu_register();
+    if (self->depth++ == 0) {
+        atomic_store(&self->epoch, atomic_load(&_CL_rcu_epoch));
+        // The announcement must be visible before any link is read
+        atomic_thread_fence(memory_order_seq_cst);
+    }
+    return self;
+}
+
+static inline void _CL_rcu_read_end(struct _cl_rcu_reader *self) {
+    if (--self->depth == 0) atomic_store_explicit(&self->epoch, 0, memory_order_release);
+}
+
+/*
+ * Return the oldest epoch announced by a reader that is still reading,
+ * or ULONG_MAX if no thread is
+ */
+static unsigned long _CL_rcu_oldest_reader() {
+    atomic_thread_fence(memory_order_seq_cst);
+    unsigned long oldest = ULONG_MAX;
+    for (struct _cl_rcu_reader *r = atomic_load(&_CL_rcu_readers); r != NULL; r = r->next) {
+        const unsigned long epoch = atomic_load(&r->epoch);
+        if (epoch && epoch < oldest) oldest = epoch;
+    }
+    return oldest;
+}
+
+/*
+ * Read the link following a node, or the head, that the writer may be
+ * changing
+ */
+static inline struct _cl_node *_CL_rcu_next(struct _cl_node *const *link) {
+    return __atomic_load_n(link, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Point a link at node, which must be fully initialized, for readers
+ * to follow
+ */
+static inline void _CL_rcu_publish(struct _cl_node **link, struct _cl_node *node) {
+    __atomic_store_n(link, node, __ATOMIC_RELEASE);
+}
+
+/*
+ * Add delta to the length of list, which readers may be reading
+ * through CL_length at the same time. Only the writer changes it, so
+ * it need not be an atomic add.
+ */
+static inline void _CL_rcu_add_length(CList list, int delta) {
+    __atomic_store_n(&list->length, __atomic_load_n(&list->length, __ATOMIC_RELAXED) + delta,
+                     __ATOMIC_RELAXED);
+}
+
+/*
+ * Free the retired nodes of list that no reader can still reach
+ */
+static void _CL_rcu_reclaim(CList list) {
+    const unsigned long oldest = _CL_rcu_oldest_reader();
+    int n = 0;
+    // Nodes are retired in epoch order
+    while (n < list->retired_count && list->retired[n].epoch < oldest) {
+        _CL_node_recycle(list, list->retired[n].node);
+        n++;
+    }
+    list->retired_count -= n;
+    memmove(list->retired, list->retired + n, list->retired_count * sizeof(*list->retired));
+}
+
+/*
+ * Retire a node that has been unlinked from list
+ */
+static void _CL_rcu_retire(CList list, struct _cl_node *node) {
+    if (list->retired_count == list->retired_cap) {
+        const int cap = list->retired_cap ? list->retired_cap * 2 : CL_RCU_BATCH;
+        struct _cl_retired *retired = _CL_alloc(list, cap * sizeof(*retired));
+        if (list->retired) {
+            memcpy(retired, list->retired, list->retired_count * sizeof(*retired));
+            _CL_dealloc(list, list->retired, list->retired_cap * sizeof(*retired));
+        }
+        list->retired = retired;
+        list->retired_cap = cap;
+    }
+
+    // Readers that see the advanced epoch began after the unlink
+    list->retired[list->retired_count].node = node;
+    list->retired[list->retired_count].epoch = atomic_fetch_add(&_CL_rcu_epoch, 1);
+    list->retired_count++;
+
+    if (list->retired_count % CL_RCU_BATCH == 0) _CL_rcu_reclaim(list);
+}
+
+/*
+ * Return the link in front of position pos, for the writer
+ */
+static struct _cl_node **_CL_rcu_link(CList list, int pos) {
+    struct _cl_node **link = &list->head;
+    for (int current_position = 0; current_position < pos; current_position++) {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+/*
+ * Create a node for element and publish it at link
+ */
+static void _CL_rcu_insert_at(CList list, struct _cl_node **link, CListElementType element) {
+    struct _cl_node *new = (struct _cl_node *)_CL_node_alloc(list);
+    new->element = element;
+    new->next = *link;
+    _CL_rcu_publish(link, new);
+    _CL_rcu_add_length(list, 1);
+}
+
+static void _CL_rcu_destroy(CList list) {
+    // Unlink everything, then wait out readers of this list, and of
+    // any list its nodes came from
+    struct _cl_node *iter = list->head;
+    _CL_rcu_publish(&list->head, NULL);
+    CL_synchronize(list);
+
+    while (iter) {
+        struct _cl_node *temp = iter;
+        iter = iter->next;
+        _CL_node_release(list, temp);
+    }
+    if (list->retired) {
+        _CL_dealloc(list, list->retired, list->retired_cap * sizeof(*list->retired));
+    }
+    list->retired = NULL;
+    list->retired_cap = 0;
+}
+
+static int _CL_rcu_count(CList list) {
+    struct _cl_rcu_reader *self = _CL_rcu_read_begin();
+    int len = 0;
+    for (struct _cl_node *iter = _CL_rcu_next(&list->head); iter;
+         iter = _CL_rcu_next(&iter->next)) {
+        len++;
+    }
+    _CL_rcu_read_end(self);
+    return len;
+}
+
+static CListElementType _CL_rcu_nth(CList list, int pos) {
+    struct _cl_rcu_reader *self = _CL_rcu_read_begin();
+    // The writer may have shortened the list since pos was checked
+    struct _cl_node *iter = _CL_rcu_next(&list->head);
+    for (int current_position = 0; iter && current_position < pos; current_position++) {
+        iter = _CL_rcu_next(&iter->next);
+    }
+    CListElementType to_return = iter ? __atomic_load_n(&iter->element, __ATOMIC_ACQUIRE)
+                                      : INVALID_RETURN;
+    _CL_rcu_read_end(self);
+    return to_return;
+}
+
+static void _CL_rcu_insert(CList list, CListElementType element, int pos) {
+    _CL_rcu_insert_at(list, _CL_rcu_link(list, pos), element);
+}
+
+static CListElementType _CL_rcu_remove(CList list, int pos) {
+    struct _cl_node **link = _CL_rcu_link(list, pos);
+    struct _cl_node *node = *link;
+    _CL_rcu_publish(link, node->next);
+
+    CListElementType to_return = node->element;
+    _CL_rcu_retire(list, node);
+    _CL_rcu_add_length(list, -1);
+    return to_return;
+}
+
+static CList _CL_rcu_copy(CList list) {
+    CList list_copy = _CL_new_like(list);
+
+    // The copy is not shared yet, so it is built without publishing
+    struct _cl_rcu_reader *self = _CL_rcu_read_begin();
+    struct _cl_node **tail = &list_copy->head;
+    for (struct _cl_node *iter = _CL_rcu_next(&list->head); iter;
+         iter = _CL_rcu_next(&iter->next)) {
+        struct _cl_node *new = (struct _cl_node *)_CL_node_alloc(list_copy);
+        new->element = iter->element;
+        new->next = NULL;
+        *tail = new;
+        tail = &new->next;
+        list_copy->length++;
+    }
+    _CL_rcu_read_end(self);
+
+    return list_copy;
+}
+
+static int _CL_rcu_insert_sorted(CList list, CListElementType element) {
+    struct _cl_node **link = &list->head;
+    int index = 0;
+    while (*link && strcmp((*link)->element, element) < 0) {
+        link = &(*link)->next;
+        index++;
+    }
+    _CL_rcu_insert_at(list, link, element);
+    return index;
+}
+
+static void _CL_rcu_splice(CList dest, int dest_pos, CList src, int start, int end) {
+    if (start == end) return;
+
+    struct _cl_node **src_link = _CL_rcu_link(src, start);
+    struct _cl_node *first = *src_link;
+    struct _cl_node *last = first;
+    for (int i = start + 1; i < end; i++) last = last->next;
+    struct _cl_node **dest_link = _CL_rcu_link(dest, dest_pos);
+
+    // Only used to join and split, where the range ends src and goes at
+    // the end of dest: readers of src still in the range reach its end
+    // as before, and readers of dest only see the range once complete
+    _CL_rcu_publish(src_link, last->next);
+    _CL_rcu_publish(&last->next, *dest_link);
+    _CL_rcu_publish(dest_link, first);
+
+    _CL_rcu_add_length(src, start - end);
+    _CL_rcu_add_length(dest, end - start);
+}
+
+static void _CL_rcu_join(CList list1, CList list2) {
+    _CL_rcu_splice(list1, list1->length, list2, 0, list2->length);
+}
+
+static CList _CL_rcu_split(CList list, int pos) {
+    CList tail = _CL_new_like(list);
+    _CL_rcu_splice(tail, 0, list, pos, list->length);
+    return tail;
+}
+
+static void _CL_rcu_reverse(CList list) {
+    // Turning the links around would send readers backwards, so build
+    // a reversed chain of new nodes and retire the old ones
+    struct _cl_node *reversed = NULL;
+    for (struct _cl_node *iter = list->head; iter; iter = iter->next) {
+        struct _cl_node *new = (struct _cl_node *)_CL_node_alloc(list);
+        new->element = iter->element;
+        new->next = reversed;
+        reversed = new;
+    }
+
+    struct _cl_node *old = list->head;
+    _CL_rcu_publish(&list->head, reversed);
+    while (old) {
+        struct _cl_node *next = old->next;
+        _CL_rcu_retire(list, old);
+        old = next;
+    }
+}
+
+static void _CL_rcu_foreach(CList list, CL_foreach_callback callback, void *cb_data) {
+    struct _cl_rcu_reader *self = _CL_rcu_read_begin();
+    int pos = 0;
+    for (struct _cl_node *iter = _CL_rcu_next(&list->head); iter;
+         iter = _CL_rcu_next(&iter->next)) {
+        callback(pos++, __atomic_load_n(&iter->element, __ATOMIC_ACQUIRE), cb_data);
+    }
+    _CL_rcu_read_end(self);
+}
+
+static void _CL_rcu_map(CList list, _CL_map_fn fn, void *data) {
+    // Readers see either string; they are equal
+    for (struct _cl_node *iter = list->head; iter; iter = iter->next) {
+        __atomic_store_n(&iter->element, fn(iter->element, data), __ATOMIC_RELEASE);
+    }
+}
+
+static int _CL_rcu_find(CList list, CListElementType key, bool count) {
+    struct _cl_rcu_reader *self = _CL_rcu_read_begin();
+    int matches = 0;
+    int pos = 0;
+    int found = -1;
+    for (struct _cl_node *iter = _CL_rcu_next(&list->head); iter;
+         iter = _CL_rcu_next(&iter->next), pos++) {
+        if (strcmp(__atomic_load_n(&iter->element, __ATOMIC_ACQUIRE), key) == 0) {
+            if (!count) {
+                found = pos;
+                break;
+            }
+            matches++;
+        }
+    }
+    _CL_rcu_read_end(self);
+    return count ? matches : found;
+}
+
+static void _CL_rcu_compact(CList list) {
+    // Readers may be on any node, so nodes cannot move
+    (void)list;
+}
+
+static void _CL_rcu_move(CList list, int from, int to) {
+    // Readers may be on the node, so it is retired and a copy linked in
+    _CL_rcu_insert(list, _CL_rcu_remove(list, from), to);
+}
+
+const struct _cl_ops _CL_rcu_ops = {
+    .destroy = _CL_rcu_destroy,
+    .count = _CL_rcu_count,
+    .nth = _CL_rcu_nth,
+    .insert = _CL_rcu_insert,
+    .remove = _CL_rcu_remove,
+    .copy = _CL_rcu_copy,
+    .insert_sorted = _CL_rcu_insert_sorted,
+    .join = _CL_rcu_join,
+    .split = _CL_rcu_split,
+    .splice = _CL_rcu_splice,
+    .reverse = _CL_rcu_reverse,
+    .foreach = _CL_rcu_foreach,
+    .map = _CL_rcu_map,
+    .find = _CL_rcu_find,
+    .compact = _CL_rcu_compact,
+    .move = _CL_rcu_move,
+};
+
+// Documented in .h file
+void CL_synchronize(CList list) {
+    assert(list);
+    if (list->ops != &_CL_rcu_ops) return;
+
+    // Every read that began before this point announced an epoch no
+    // later than this one
+    const unsigned long epoch = atomic_fetch_add(&_CL_rcu_epoch, 1);
+    while (_CL_rcu_oldest_reader() <= epoch) sched_yield();
+
+    for (int i = 0; i < list->retired_count; i++) {
+        _CL_node_recycle(list, list->retired[i].node);
+    }
+    list->retired_count = 0;
+}
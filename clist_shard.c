@@ -0,0 +1,262 @@
+/*
+ * clist_shard.c
+ *
+ * Sharded lists (see CLS_new): one logical collection spread over
+ * several CLists, each behind its own lock and on its own cache line,
+ * so that threads adding elements at once rarely touch the same
+ * memory. Operations on the whole collection visit the shards in
+ * order, locking one at a time.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clist_impl.h"
+
+// One shard; the alignment keeps shards from sharing cache lines
+struct _cl_shard {
+    _Alignas(64) pthread_mutex_t lock;
+    CList list;
+};
+
+struct _clist_sharded {
+    struct _cl_shard *shards;
+    int nshards;
+    CListBackend backend;
+    CLShardPolicy policy;
+};
+
+// Threads are numbered in the order they first add to a sharded list
+static atomic_uint _CLS_thread_count = 0;
+static __thread int _CLS_thread_id = -1;
+
+/*
+ * Return the shard an element added by the calling thread goes to
+ */
+static struct _cl_shard *_CLS_shard_for(CListSharded sharded, CListElementType element) {
+    if (sharded->policy == CL_SHARD_BY_HASH) {
+        return &sharded->shards[_CL_hash(element) % sharded->nshards];
+    }
+
+    if (_CLS_thread_id < 0) _CLS_thread_id = (int)atomic_fetch_add(&_CLS_thread_count, 1);
+    return &sharded->shards[_CLS_thread_id % sharded->nshards];
+}
+
+// Documented in .h file
+CListSharded CLS_new(int nshards, CListBackend backend, CLShardPolicy policy) {
+    assert(nshards > 0);
+
+    CListSharded sharded = (CListSharded)malloc(sizeof(struct _clist_sharded));
+    assert(sharded);
+    sharded->shards = (struct _cl_shard *)aligned_alloc(_Alignof(struct _cl_shard),
+                                                        nshards * sizeof(struct _cl_shard));
+    assert(sharded->shards);
+    sharded->nshards = nshards;
+    sharded->backend = backend;
+    sharded->policy = policy;
+
+    for (int i = 0; i < nshards; i++) {
+        pthread_mutex_init(&sharded->shards[i].lock, NULL);
+        sharded->shards[i].list = CL_new_backend(backend);
+    }
+    return sharded;
+}
+
+// Documented in .h file
+void CLS_free(CListSharded sharded) {
+    assert(sharded);
+    for (int i = 0; i < sharded->nshards; i++) {
+        CL_free(sharded->shards[i].list);
+        pthread_mutex_destroy(&sharded->shards[i].lock);
+    }
+    free(sharded->shards);
+    free(sharded);
+}
+
+// Documented in .h file
+void CLS_push(CListSharded sharded, CListElementType element) {
+    assert(sharded);
+    struct _cl_shard *shard = _CLS_shard_for(sharded, element);
+    pthread_mutex_lock(&shard->lock);
+    CL_push(shard->list, element);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+// Documented in .h file
+void CLS_append(CListSharded sharded, CListElementType element) {
+    assert(sharded);
+    struct _cl_shard *shard = _CLS_shard_for(sharded, element);
+    pthread_mutex_lock(&shard->lock);
+    CL_append(shard->list, element);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+// Documented in .h file
+int CLS_length(CListSharded sharded) {
+    assert(sharded);
+    int length = 0;
+    for (int i = 0; i < sharded->nshards; i++) {
+        pthread_mutex_lock(&sharded->shards[i].lock);
+        length += CL_length(sharded->shards[i].list);
+        pthread_mutex_unlock(&sharded->shards[i].lock);
+    }
+    return length;
+}
+
+// Position offset and callback for the shard CLS_foreach is visiting
+struct _cls_foreach {
+    int base;
+    CL_foreach_callback callback;
+    void *cb_data;
+};
+
+/*
+ * CL_foreach callback that numbers a shard's elements after those of
+ * the shards before it
+ */
+static void _CLS_foreach_element(int pos, CListElementType element, void *cb_data) {
+    struct _cls_foreach *visit = cb_data;
+    visit->callback(visit->base + pos, element, visit->cb_data);
+}
+
+// Documented in .h file
+void CLS_foreach(CListSharded sharded, CL_foreach_callback callback, void *cb_data) {
+    assert(sharded);
+    struct _cls_foreach visit = {0, callback, cb_data};
+    for (int i = 0; i < sharded->nshards; i++) {
+        pthread_mutex_lock(&sharded->shards[i].lock);
+        CL_foreach(sharded->shards[i].list, _CLS_foreach_element, &visit);
+        visit.base += CL_length(sharded->shards[i].list);
+        pthread_mutex_unlock(&sharded->shards[i].lock);
+    }
+}
+
+// Elements gathered from every shard, and where each shard's run starts
+struct _cls_gather {
+    CListElementType *elements;
+    int count;
+    int cap;
+    int *runs;  // nshards + 1 entries; run i is [runs[i], runs[i + 1])
+};
+
+/*
+ * CL_foreach callback that adds an element to a gather
+ */
+static void _CLS_gather_element(int pos, CListElementType element, void *cb_data) {
+    (void)pos;
+    struct _cls_gather *gather = cb_data;
+    if (gather->count == gather->cap) {
+        gather->cap = gather->cap ? gather->cap * 2 : 64;
+        gather->elements = realloc(gather->elements, gather->cap * sizeof(CListElementType));
+        assert(gather->elements);
+    }
+    gather->elements[gather->count++] = element;
+}
+
+/*
+ * Copy out the elements of every shard, one shard at a time
+ */
+static void _CLS_gather(CListSharded sharded, struct _cls_gather *gather) {
+    memset(gather, 0, sizeof(*gather));
+    gather->runs = malloc((sharded->nshards + 1) * sizeof(int));
+    assert(gather->runs);
+    for (int i = 0; i < sharded->nshards; i++) {
+        gather->runs[i] = gather->count;
+        pthread_mutex_lock(&sharded->shards[i].lock);
+        CL_foreach(sharded->shards[i].list, _CLS_gather_element, gather);
+        pthread_mutex_unlock(&sharded->shards[i].lock);
+    }
+    gather->runs[sharded->nshards] = gather->count;
+}
+
+/*
+ * Build a list on the sharded list's backend from n elements. Pushing
+ * from the back is O(1) per element on every backend.
+ */
+static CList _CLS_build(CListSharded sharded, CListElementType *elements, int n) {
+    CList list = CL_new_backend(sharded->backend);
+    for (int i = n - 1; i >= 0; i--) CL_push(list, elements[i]);
+    return list;
+}
+
+// Documented in .h file
+CList CLS_copy(CListSharded sharded) {
+    assert(sharded);
+    struct _cls_gather gather;
+    _CLS_gather(sharded, &gather);
+    CList list = _CLS_build(sharded, gather.elements, gather.count);
+    free(gather.elements);
+    free(gather.runs);
+    return list;
+}
+
+// Runs being merged by CLS_merge: heap holds the indices of the runs
+// not yet used up, ordered by each run's next element
+struct _cls_merge {
+    CListElementType *elements;
+    int *next;  // index in elements of each run's next element
+    int *heap;
+    int heap_size;
+};
+
+/*
+ * Restore the heap order below position parent
+ */
+static void _CLS_sift_down(struct _cls_merge *m, int parent) {
+    for (int child; (child = 2 * parent + 1) < m->heap_size; parent = child) {
+        if (child + 1 < m->heap_size && strcmp(m->elements[m->next[m->heap[child + 1]]],
+                                               m->elements[m->next[m->heap[child]]]) < 0) {
+            child++;
+        }
+        if (strcmp(m->elements[m->next[m->heap[parent]]],
+                   m->elements[m->next[m->heap[child]]]) <= 0) {
+            break;
+        }
+        const int temp = m->heap[parent];
+        m->heap[parent] = m->heap[child];
+        m->heap[child] = temp;
+    }
+}
+
+// Documented in .h file
+CList CLS_merge(CListSharded sharded) {
+    assert(sharded);
+    struct _cls_gather gather;
+    _CLS_gather(sharded, &gather);
+    const int k = sharded->nshards;
+
+    // Sort each shard's run, then merge the runs
+    struct _cls_merge m = {gather.elements, malloc(k * sizeof(int)), malloc(k * sizeof(int)), 0};
+    assert(m.next && m.heap);
+    for (int i = 0; i < k; i++) {
+        const int start = gather.runs[i];
+        m.next[i] = start;
+        // An empty run is left out; if every run is, elements is NULL
+        if (start == gather.runs[i + 1]) continue;
+        qsort(gather.elements + start, gather.runs[i + 1] - start, sizeof(CListElementType),
+              _CL_element_cmp);
+        m.heap[m.heap_size++] = i;
+    }
+    for (int i = m.heap_size / 2 - 1; i >= 0; i--) _CLS_sift_down(&m, i);
+
+    CListElementType *merged = malloc((gather.count ? gather.count : 1) * sizeof(CListElementType));
+    assert(merged);
+    for (int n = 0; n < gather.count; n++) {
+        const int run = m.heap[0];
+        merged[n] = gather.elements[m.next[run]++];
+        if (m.next[run] == gather.runs[run + 1]) m.heap[0] = m.heap[--m.heap_size];
+        _CLS_sift_down(&m, 0);
+    }
+
+    CList list = _CLS_build(sharded, merged, gather.count);
+    free(merged);
+    free(m.heap);
+    free(m.next);
+    free(gather.elements);
+    free(gather.runs);
+    return list;
+}
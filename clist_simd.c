@@ -0,0 +1,73 @@
+/*
+ * clist_simd.c
+ *
+ * Vector kernels for CL_find and CL_count over arrays of key prefixes
+ * (see _CL_key_prefix). On x86-64 there is an SSE2 kernel, which every
+ * such CPU has, and an AVX2 kernel that is chosen at run time when the
+ * CPU supports it. Other targets use the scalar loop.
+ */
+
+#include <stdint.h>
+
+#include "clist_impl.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+
+/*
+ * SSE2 kernel, two prefixes per compare. SSE2 has no 64-bit equality,
+ * so both 32-bit halves of a lane must compare equal.
+ */
+static int _CL_prefix_scan_sse2(const uint64_t *keys, int n, uint64_t prefix) {
+    const __m128i target = _mm_set1_epi64x((long long)prefix);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        int mask = 0;
+        for (int j = 0; j < 4; j++) {
+            const __m128i v = _mm_loadu_si128((const __m128i *)&keys[i + 2 * j]);
+            __m128i eq = _mm_cmpeq_epi32(v, target);
+            eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+            mask |= _mm_movemask_pd(_mm_castsi128_pd(eq)) << (2 * j);
+        }
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    for (; i < n; i++) {
+        if (keys[i] == prefix) return i;
+    }
+    return n;
+}
+
+/*
+ * AVX2 kernel, four prefixes per compare
+ */
+__attribute__((target("avx2"))) static int _CL_prefix_scan_avx2(const uint64_t *keys, int n,
+                                                                uint64_t prefix) {
+    const __m256i target = _mm256_set1_epi64x((long long)prefix);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256i a = _mm256_loadu_si256((const __m256i *)&keys[i]);
+        const __m256i b = _mm256_loadu_si256((const __m256i *)&keys[i + 4]);
+        const int mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(a, target))) |
+                         _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(b, target)))
+                             << 4;
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    for (; i < n; i++) {
+        if (keys[i] == prefix) return i;
+    }
+    return n;
+}
+#endif  // __x86_64__
+
+// Documented in clist_impl.h
+int _CL_prefix_scan(const uint64_t *keys, int n, uint64_t prefix) {
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2")) return _CL_prefix_scan_avx2(keys, n, prefix);
+    return _CL_prefix_scan_sse2(keys, n, prefix);
+#else
+    for (int i = 0; i < n; i++) {
+        if (keys[i] == prefix) return i;
+    }
+    return n;
+#endif
+}
@@ -7,9 +7,13 @@
 #include "clist.h"
 
 #include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 // Some known testdata, for testing
 const char *testdata[] = {"Zero",     "One",      "Two",      "Three",   "Four",    "Five",
@@ -59,9 +63,45 @@ static const int num_testdata = sizeof(testdata) / sizeof(testdata[0]);
 
 // Function to print elements during iteration
 void print_callback(int pos, CListElementType element, void *cb_data) {
+    (void)cb_data;
     printf("Position: %d, Element: %s\n", pos, element);
 }
 
+// Function to count elements during iteration
+void count_callback(int pos, CListElementType element, void *cb_data) {
+    (void)pos;
+    (void)element;
+    (*(int *)cb_data)++;
+}
+
+// Kinds of list the tests run against: one of each backend, then a
+// keyed and an inline linked list, then a CL_new list, which starts
+// out in its small array
+static const CListBackend kind_backends[] = {CL_LINKED,   CL_TREE,    CL_DEQUE,
+                                             CL_PRIORITY, CL_COMPACT, CL_DLINKED};
+#define KIND_PRIORITY 3
+#define KIND_DLINKED 5
+#define KIND_KEYED 6
+#define KIND_INLINE 7
+#define KIND_SMALL 8
+#define NUM_KINDS 9
+
+/*
+ * Create an empty list of the given kind
+ */
+CList new_list_of_kind(int kind) {
+    switch (kind) {
+    case KIND_KEYED:
+        return CL_new_keyed();
+    case KIND_INLINE:
+        return CL_new_inline();
+    case KIND_SMALL:
+        return CL_new();
+    default:
+        return CL_new_backend(kind_backends[kind]);
+    }
+}
+
 /*
  * Tests the CL_new, CL_push, CL_pop, and CL_free functions
  *
@@ -364,6 +404,28 @@ int test_cl_join() {
     CL_free(list);
 
     CL_free(list_join);
+
+    // Keyed and inline nodes are the same size but laid out differently,
+    // so joining one kind to the other must copy the elements
+    CList keyed = CL_new_keyed();
+    CList inline_list = CL_new_inline();
+    CL_append(keyed, "alpha");
+    CL_append(inline_list, "omega");
+    CL_append(inline_list, "a string too long to fit inline");
+    CL_join(keyed, inline_list);
+    test_assert(CL_length(keyed) == 3);
+    test_assert(CL_length(inline_list) == 0);
+    test_assert(CL_find(keyed, "omega") == 1);
+    test_compare(CL_nth(keyed, 2), "a string too long to fit inline");
+    CL_join(inline_list, keyed);
+    test_assert(CL_length(inline_list) == 3);
+    test_assert(CL_find(inline_list, "alpha") == 0);
+    test_assert(CL_find(inline_list, "omega") == 1);
+    const char *omega = CL_remove(inline_list, 1);
+    CL_push(inline_list, "zzzzzzzz");
+    test_compare(omega, "omega");
+    CL_free(keyed);
+    CL_free(inline_list);
     return 1;
 }
 
@@ -427,6 +489,2284 @@ int test_cl_foreach() {
     return 1;
 }
 
+/*
+ * Apply the same random sequence of operations to a list on the given
+ * backend and to a linked list, checking that they agree throughout.
+ * On success the two lists are returned through *out and *linked_out
+ * for further checks.
+ *
+ * Returns: 1 if all tests pass, 0 otherwise
+ */
+int random_ops_match_linked(CListBackend backend, unsigned seed, CList *out, CList *linked_out) {
+    CList list = CL_new_backend(backend);
+    CList linked = CL_new();
+
+    srand(seed);
+    for (int i = 0; i < 2000; i++) {
+        const char *element = testdata[rand() % num_testdata];
+        int len = CL_length(linked);
+        int pos = rand() % (2 * len + 3) - (len + 1);
+        switch (rand() % 6) {
+            case 0:
+                CL_push(list, element);
+                CL_push(linked, element);
+                break;
+            case 1:
+                CL_append(list, element);
+                CL_append(linked, element);
+                break;
+            case 2:
+                test_assert(CL_insert(list, element, pos) == CL_insert(linked, element, pos));
+                break;
+            case 3:
+                test_assert(CL_remove(list, pos) == CL_remove(linked, pos));
+                break;
+            case 4:
+                test_assert(CL_pop(list) == CL_pop(linked));
+                break;
+            case 5:
+                if (rand() % 10 == 0) {
+                    CL_reverse(list);
+                    CL_reverse(linked);
+                }
+                break;
+        }
+        test_assert(CL_length(list) == CL_length(linked));
+    }
+    for (int i = -CL_length(linked) - 1; i <= CL_length(linked); i++)
+        test_assert(CL_nth(list, i) == CL_nth(linked, i));
+
+    *out = list;
+    *linked_out = linked;
+    return 1;
+}
+
+/*
+ * Tests the CL_TREE backend
+ *
+ * Returns: 1 if all tests pass, 0 otherwise
+ */
+
+int test_cl_tree() {
+    CList tree, linked;
+    if (!random_ops_match_linked(CL_TREE, 26, &tree, &linked)) return 0;
+
+    // A copy is independent of the original, including pending reversals
+    CList copy = CL_copy(tree);
+    CL_reverse(tree);
+    CL_reverse(linked);
+    for (int i = 0; i < CL_length(copy); i++) test_assert(CL_nth(copy, i) == CL_nth(linked, -1 - i));
+
+    // Joining two trees concatenates them and empties the second
+    int len = CL_length(tree);
+    CL_join(tree, copy);
+    test_assert(CL_length(tree) == 2 * len);
+    test_assert(CL_length(copy) == 0);
+    for (int i = 0; i < len; i++) test_assert(CL_nth(tree, len + i) == CL_nth(linked, -1 - i));
+    CL_free(copy);
+    CL_free(tree);
+    CL_free(linked);
+
+    // Sorted inserts land in the same place as on a linked list
+    tree = CL_new_backend(CL_TREE);
+    for (int i = 0; i < num_testdata; i++) CL_insert_sorted(tree, testdata[i]);
+    for (int i = 0; i < num_testdata; i++) test_compare(CL_nth(tree, i), testdata_sorted[i]);
+    CL_free(tree);
+
+    return 1;
+}
+
+/*
+ * Tests the CL_DEQUE backend
+ *
+ * Returns: 1 if all tests pass, 0 otherwise
+ */
+
+int test_cl_deque() {
+    CList deque, linked;
+    if (!random_ops_match_linked(CL_DEQUE, 31, &deque, &linked)) return 0;
+    CL_free(deque);
+    CL_free(linked);
+
+    // Queue usage wraps around the end of the array many times
+    deque = CL_new_backend(CL_DEQUE);
+    for (int i = 0; i < 5; i++) CL_append(deque, testdata[i]);
+    for (int i = 5; i < 1000; i++) {
+        test_compare(CL_pop(deque), testdata[(i - 5) % num_testdata]);
+        CL_append(deque, testdata[i % num_testdata]);
+        test_compare(CL_nth(deque, 4), testdata[i % num_testdata]);
+    }
+
+    // Stack usage at the tail, growing then shrinking the array
+    for (int i = 0; i < 1000; i++) CL_insert(deque, testdata[i % num_testdata], -1);
+    test_assert(CL_length(deque) == 1005);
+    for (int i = 999; i >= 0; i--) test_compare(CL_remove(deque, -1), testdata[i % num_testdata]);
+    test_assert(CL_length(deque) == 5);
+
+    // Sorted inserts, copy and foreach over a wrapped array
+    CL_free(deque);
+    deque = CL_new_backend(CL_DEQUE);
+    for (int i = 0; i < num_testdata; i++) CL_insert_sorted(deque, testdata[i]);
+    for (int i = 0; i < num_testdata; i++) test_compare(CL_nth(deque, i), testdata_sorted[i]);
+    CList copy = CL_copy(deque);
+    CL_free(deque);
+    for (int i = 0; i < num_testdata; i++) test_compare(CL_nth(copy, i), testdata_sorted[i]);
+    CL_free(copy);
+
+    return 1;
+}
+
+/*
+ * Tests the CL_PRIORITY backend and CL_meld
+ *
+ * Returns: 1 if all tests pass, 0 otherwise
+ */
+
+int test_cl_priority() {
+    CList queue = CL_new_backend(CL_PRIORITY);
+
+    test_invalid(CL_pop(queue));
+    test_invalid(CL_nth(queue, 0));
+
+    // Every insertion function orders by strcmp
+    for (int i = 0; i < num_testdata; i++) {
+        switch (i % 4) {
+            case 0:
+                CL_push(queue, testdata[i]);
+                break;
+            case 1:
+                CL_append(queue, testdata[i]);
+                break;
+            case 2:
+                test_assert(CL_insert(queue, testdata[i], 0));
+                break;
+            case 3:
+                CL_insert_sorted(queue, testdata[i]);
+                break;
+        }
+    }
+    test_assert(CL_length(queue) == num_testdata);
+    test_compare(CL_nth(queue, 0), testdata_sorted[0]);
+    test_compare(CL_nth(queue, 5), testdata_sorted[5]);
+    test_compare(CL_nth(queue, -1), testdata_sorted[num_testdata - 1]);
+    test_assert(CL_length(queue) == num_testdata);
+
+    // A copy pops in the same order, and is independent
+    CList copy = CL_copy(queue);
+    for (int i = 0; i < num_testdata; i++) test_compare(CL_pop(copy), testdata_sorted[i]);
+    test_invalid(CL_pop(copy));
+    test_assert(CL_length(queue) == num_testdata);
+
+    // Positions other than the head count in ascending order
+    test_compare(CL_remove(queue, 3), testdata_sorted[3]);
+    CList tail = CL_split(queue, 10);
+    test_assert(CL_length(queue) == 10);
+    test_assert(CL_length(tail) == num_testdata - 11);
+    test_compare(CL_nth(tail, 0), testdata_sorted[11]);
+
+    // Melding gives back one queue in order
+    test_assert(!CL_meld(queue, queue));
+    test_assert(CL_meld(queue, tail));
+    test_assert(CL_length(tail) == 0);
+    CL_insert_sorted(queue, testdata_sorted[3]);
+    for (int i = 0; i < num_testdata; i++) test_compare(CL_pop(queue), testdata_sorted[i]);
+
+    // Only priority queues meld
+    CList linked = CL_new();
+    test_assert(!CL_meld(queue, linked));
+
+    // Joining into a linked list drains the queue in order
+    for (int i = 0; i < num_testdata; i++) CL_push(queue, testdata[i]);
+    CL_join(linked, queue);
+    for (int i = 0; i < num_testdata; i++) test_compare(CL_nth(linked, i), testdata_sorted[i]);
+
+    // Descending inserts build a chain of first children as deep as the
+    // queue is long; walking and freeing it must not recurse
+    char(*keys)[8] = malloc(100000 * sizeof(*keys));
+    for (int i = 0; i < 100000; i++) {
+        snprintf(keys[i], sizeof(keys[i]), "%06d", 99999 - i);
+        CL_push(queue, keys[i]);
+    }
+    test_assert(CL_find(queue, "050000") == 50000);
+    CList deep = CL_copy(queue);
+    test_compare(CL_pop(deep), "000000");
+    test_compare(CL_pop(deep), "000001");
+    CL_free(deep);
+    CL_free(queue);
+    free(keys);
+
+    CL_free(copy);
+    CL_free(tail);
+    CL_free(linked);
+    return 1;
+}
+
+/*
+ * Tests the CL_COMPACT backend, which stores copies of its elements
+ *
+ * Returns: 1 if all tests pass, 0 otherwise
+ */
+
+int test_cl_compact() {
+    CList compact = CL_new_backend(CL_COMPACT);
+    CList linked = CL_new();
+
+    // The same random operations as random_ops_match_linked, comparing
+    // contents rather than pointers
+    srand(34);
+    for (int i = 0; i < 2000; i++) {
+        const char *element = testdata[rand() % num_testdata];
+        int len = CL_length(linked);
+        int pos = rand() % (2 * len + 3) - (len + 1);
+        switch (rand() % 5) {
+            case 0:
+                CL_push(compact, element);
+                CL_push(linked, element);
+                break;
+            case 1:
+                test_assert(CL_insert(compact, element, pos) == CL_insert(linked, element, pos));
+                break;
+            case 2:
+                if (pos < -len || pos >= len) {
+                    test_invalid(CL_remove(compact, pos));
+                    test_invalid(CL_remove(linked, pos));
+                } else {
+                    test_compare(CL_remove(compact, pos), CL_remove(linked, pos));
+                }
+                break;
+            case 3:
+                CL_append(compact, element);
+                CL_append(linked, element);
+                break;
+            case 4:
+                if (rand() % 10 == 0) {
+                    CL_reverse(compact);
+                    CL_reverse(linked);
+                }
+                break;
+        }
+        test_assert(CL_length(compact) == CL_length(linked));
+    }
+    for (int i = 0; i < CL_length(linked); i++) test_compare(CL_nth(compact, i), CL_nth(linked, i));
+    CL_free(compact);
+    CL_free(linked);
+
+    // Elements are copied: the caller's buffer can be reused, and
+    // removed elements stay readable until the list is freed
+    compact = CL_new_backend(CL_COMPACT);
+    char buf[16];
+    for (int i = 0; i < 1000; i++) {
+        snprintf(buf, sizeof(buf), "id%04d", i);
+        CL_append(compact, buf);
+    }
+    test_assert(CL_nth(compact, 0) != CL_nth(compact, 1));
+    const char *first = CL_pop(compact);
+    const char *last = CL_remove(compact, -1);
+    for (int i = 0; i < 500; i++) CL_push(compact, "filler");
+    test_compare(first, "id0000");
+    test_compare(last, "id0999");
+    test_compare(CL_nth(compact, 500), "id0001");
+
+    // A copy owns its own strings
+    CList copy = CL_copy(compact);
+    CL_free(compact);
+    test_assert(CL_length(copy) == 1498);
+    test_compare(CL_nth(copy, -1), "id0998");
+    CL_free(copy);
+
+    compact = CL_new_backend(CL_COMPACT);
+    for (int i = 0; i < num_testdata; i++) CL_insert_sorted(compact, testdata[i]);
+    for (int i = 0; i < num_testdata; i++) test_compare(CL_nth(compact, i), testdata_sorted[i]);
+    CL_free(compact);
+
+    return 1;
+}
+
+/*
+ * Tests CL_new_keyed lists, whose nodes cache a sort key prefix
+ *
+ * Returns: 1 if all tests pass, 0 otherwise
+ */
+
+int test_cl_keyed() {
+    // Ties within the first 8 bytes, strings of exactly 8 bytes, the
+    // empty string and bytes above 0x7f all have to sort as strcmp does
+    const char *tricky[] = {"abcdefgh", "abcdefghi", "abcdefg",  "abcdefgh\x80", "",
+                            "abcdefgz", "\xff",      "abcdefgh", "abcdefghij",   "a",
+                            "abcdefgha"};
+    const int num_tricky = sizeof(tricky) / sizeof(tricky[0]);
+
+    CList keyed = CL_new_keyed();
+    CList plain = CL_new();
+    srand(36);
+    for (int i = 0; i < 500; i++) {
+        const char *element =
+            (i % 2) ? testdata[rand() % num_testdata] : tricky[rand() % num_tricky];
+        test_assert(CL_insert_sorted(keyed, element) == CL_insert_sorted(plain, element));
+    }
+    for (int i = 0; i < 500; i++) test_compare(CL_nth(keyed, i), CL_nth(plain, i));
+
+    // Copies, split-off tails and nodes moved in from another list all
+    // carry keys
+    CList lists[2] = {keyed, plain};
+    CList tails[2];
+    for (int k = 0; k < 2; k++) {
+        CList copy = CL_copy(lists[k]);
+        tails[k] = CL_split(copy, 250);
+        CList other = CL_new();
+        CL_append(other, "\xff\xff");
+        CL_join(tails[k], other);
+        CL_free(other);
+        CL_free(copy);
+    }
+    test_assert(CL_insert_sorted(tails[0], "zzzz") == CL_insert_sorted(tails[1], "zzzz"));
+    test_assert(CL_insert_sorted(tails[0], "\xff\xff\xff") ==
+                CL_insert_sorted(tails[1], "\xff\xff\xff"));
+    test_compare(CL_nth(tails[0], -1), "\xff\xff\xff");
+    CL_free(tails[0]);
+    CL_free(tails[1]);
+
+    CL_free(keyed);
+    CL_free(plain);
+    return 1;
+}
+
+/*
+ * Tests CL_new_inline lists, which store short strings in their nodes
+ *
+ * Returns: 1 if all tests pass, 0 otherwise
+ */
+
+int test_cl_inline() {
+    const char *long_string = "a string too long to fit in a node";
+    CList list = CL_new_inline();
+    char buf[16];
+
+    // Short strings are copied, long ones referenced
+    for (int i = 0; i < 20; i++) {
+        snprintf(buf, sizeof(buf), "id%02d", i);
+        CL_append(list, buf);
+    }
+    CL_insert(list, long_string, 10);
+    test_assert(CL_nth(list, 10) == long_string);
+    test_assert(CL_nth(list, 0) != CL_nth(list, 1));
+    for (int i = 0; i < 20; i++) {
+        snprintf(buf, sizeof(buf), "id%02d", i);
+        test_compare(CL_nth(list, i < 10 ? i : i + 1), buf);
+    }
+
+    // Popped short strings survive their node being reused
+    const char *first = CL_pop(list);
+    const char *second = CL_pop(list);
+    test_assert(CL_remove(list, 8) == long_string);
+    CL_push(list, "new1");
+    CL_push(list, "new2");
+    test_compare(first, "id00");
+    test_compare(second, "id01");
+    test_assert(CL_compact_strings(list) == 10);
+    test_assert(CL_compact_strings(list) == 0);
+
+    // Sorted inserts, copies, splits and joins with other inline lists
+    // and with plain ones
+    CList copy = CL_copy(list);
+    CL_free(list);
+    test_assert(CL_insert_sorted(copy, "id055") == 0);
+    CList tail = CL_split(copy, 10);
+    CList plain = CL_new();
+    CL_append(plain, long_string);
+    CL_join(tail, plain);
+    CL_join(copy, tail);
+    test_assert(CL_length(copy) == 22);
+    test_compare(CL_nth(copy, 0), "id055");
+    test_compare(CL_nth(copy, 1), "new2");
+    test_compare(CL_nth(copy, 20), "id19");
+    test_assert(CL_nth(copy, -1) == long_string);
+    CL_free(plain);
+    CL_free(tail);
+    CL_free(copy);
+
+    return 1;
+}
+
+/*
+ * Checks CL_find and CL_count on list against a scan with CL_nth
+ *
+ * Returns: 1 if they agree for every key, 0 otherwise
+ */
+int find_matches_scan(CList list, const char **keys, int num_keys) {
+    for (int k = 0; k < num_keys; k++) {
+        int first = -1;
+        int count = 0;
+        for (int i = 0; i < CL_length(list); i++) {
+            if (strcmp(CL_nth(list, i), keys[k]) == 0) {
+                if (first < 0) first = i;
+                count++;
+            }
+        }
+        test_assert(CL_find(list, keys[k]) == first);
+        test_assert(CL_count(list, keys[k]) == count);
+    }
+    return 1;
+}
+
+/*
+ * Tests CL_find and CL_count on each backend and kind of list
+ *
+ * Returns: 1 if all tests pass, 0 otherwise
+ */
+
+int test_cl_find() {
+    // Keys that share their first 8 bytes, or end within them
+    const char *keys[] = {"",         "a",        "prefix0",       "prefix00", "prefix00-long-a",
+                          "prefix00-long-b", "prefix01", "\xffprefix", "Seven",    "absent-key"};
+    const int num_keys = sizeof(keys) / sizeof(keys[0]);
+
+    for (int kind = 0; kind < NUM_KINDS; kind++) {
+        CList list = new_list_of_kind(kind);
+        test_assert(CL_find(list, keys[0]) == -1);
+        test_assert(CL_count(list, keys[0]) == 0);
+
+        srand(38);
+        for (int i = 0; i < 300; i++) CL_append(list, keys[rand() % (num_keys - 1)]);
+        if (!find_matches_scan(list, keys, num_keys)) return 0;
+
+        // Changes to the list are seen by the next search, including a
+        // deque wrapping around its array
+        for (int i = 0; i < 100; i++) {
+            CL_pop(list);
+            CL_append(list, keys[rand() % (num_keys - 1)]);
+        }
+        CL_insert(list, "absent-key", 150);
+        if (!find_matches_scan(list, keys, num_keys)) return 0;
+        CL_reverse(list);
+        if (!find_matches_scan(list, keys, num_keys)) return 0;
+
+        CL_free(list);
+    }
+
+    return 1;
+}
+
+/*
+ * Tests that walks with prefetching on give the same results, for
+ * lists shorter and longer than the prefetch distance
+ *
+ * Returns: 1 if all tests pass, 0 otherwise
+ */
+
+int test_cl_prefetch() {
+    CL_set_prefetch_distance(8);
+
+    for (int len = 0; len < 30; len += 3) {
+        CList list = CL_new_keyed();
+        CList plain = CL_new();
+        for (int i = 0; i < len; i++) {
+            CL_insert_sorted(list, testdata[i % num_testdata]);
+            CL_insert_sorted(plain, testdata[i % num_testdata]);
+        }
+        CList copy = CL_copy(plain);
+        for (int i = 0; i < len; i++) {
+            test_compare(CL_nth(list, i), CL_nth(plain, i));
+            test_compare(CL_nth(copy, i), CL_nth(plain, i));
+        }
+        test_assert(CL_find(plain, "Two") == CL_find(list, "Two"));
+        test_assert(CL_count(plain, "Zero") == CL_count(list, "Zero"));
+        int count = 0;
+        CL_foreach(copy, count_callback, &count);
+        test_assert(count == len);
+        CL_free(copy);
+        CL_free(plain);
+        CL_free(list);
+    }
+
+    CL_set_prefetch_distance(0);
+    return 1;
+}
+
+/*
+ * Build a list of n elements from testdata whose consecutive nodes were
+ * allocated far apart, by pushing onto many lists and joining them
+ *
+ * Returns: The list
+ */
+CList scattered_list(CList (*new_list)(), int n) {
+    CList lists[64];
+    for (int i = 0; i < 64; i++) lists[i] = new_list();
+    for (int i = 0; i < n; i++) CL_push(lists[rand() % 64], testdata[i % num_testdata]);
+    for (int i = 1; i < 64; i++) {
+        CL_join(lists[0], lists[i]);
+        CL_free(lists[i]);
+    }
+    return lists[0];
+}
+
+/*
+ * Checks that two lists hold equal strings in the same order
+ *
+ * Returns: 1 if they do, 0 otherwise
+ */
+int same_elements(CList list1, CList list2) {
+    test_assert(CL_length(list1) == CL_length(list2));
+    for (int i = 0; i < CL_length(list1); i++) test_compare(CL_nth(list1, i), CL_nth(list2, i));
+    return 1;
+}
+
+/*
+ * Tests CL_compact, CL_fragmentation and CL_set_auto_compact
+ *
+ * Returns: 1 if all tests pass, 0 otherwise
+ */
+
+int test_cl_compact_nodes() {
+    srand(40);
+    CList list = scattered_list(CL_new, 2000);
+    CList expected = CL_copy(list);
+    test_assert(CL_fragmentation(list) > 0.5);
+
+    CL_compact(list);
+    test_assert(CL_fragmentation(list) == 0);
+    if (!same_elements(list, expected)) return 0;
+
+    // Churn reuses block nodes; compacting again retires the old block
+    for (int i = 0; i < 500; i++) {
+        CL_remove(list, rand() % CL_length(list));
+        CL_remove(expected, 0);
+        CL_insert(expected, testdata[i % num_testdata], 0);
+        CL_insert(list, CL_nth(expected, 0), 0);
+    }
+    CL_compact(list);
+    test_assert(CL_fragmentation(list) == 0);
+
+    // Split-off tails share the block and may outlive the list
+    CList tail = CL_split(list, 1000);
+    CList tail2 = CL_split(tail, 500);
+    CL_join(tail, tail2);
+    CL_free(tail2);
+    CL_free(list);
+    test_assert(CL_length(tail) == CL_length(expected) - 1000);
+    while (CL_length(tail)) CL_pop(tail);
+    CL_free(tail);
+    CL_free(expected);
+
+    // Nodes move freely into a compacted list, but are copied out of it
+    list = scattered_list(CL_new, 200);
+    CList plain = scattered_list(CL_new, 200);
+    CL_compact(list);
+    CL_join(list, plain);
+    CL_join(plain, list);
+    test_assert(CL_length(plain) == 400);
+    CL_free(list);
+    CL_free(plain);
+
+    // A foreach over a fragmented list compacts it once turned on
+    list = scattered_list(CL_new_inline, 500);
+    expected = CL_copy(list);
+    int count = 0;
+    CL_foreach(list, count_callback, &count);
+    test_assert(CL_fragmentation(list) > 0.5);
+    CL_set_auto_compact(list, 0.5);
+    CL_foreach(list, count_callback, &count);
+    test_assert(CL_fragmentation(list) == 0);
+    if (!same_elements(list, expected)) return 0;
+    CL_free(list);
+    CL_free(expected);
+
+    // Every other backend keeps its contents
+    const CListBackend backends[] = {CL_TREE, CL_DEQUE, CL_COMPACT, CL_PRIORITY};
+    for (int b = 0; b < 4; b++) {
+        CList other = CL_new_backend(backends[b]);
+        expected = CL_new();
+        for (int i = 0; i < 300; i++) {
+            const char *element = testdata[rand() % num_testdata];
+            int pos = rand() % (CL_length(expected) + 1);
+            if (backends[b] == CL_PRIORITY) {
+                CL_push(other, element);
+                CL_insert_sorted(expected, element);
+            } else {
+                CL_insert(other, element, pos);
+                CL_insert(expected, element, pos);
+            }
+            if (i % 3 == 0) {
+                CL_pop(other);
+                CL_pop(expected);
+            }
+        }
+        CL_compact(other);
+        if (!same_elements(other, expected)) return 0;
+        if (backends[b] != CL_PRIORITY) {
+            CL_reverse(other);
+            CL_reverse(expected);
+            CL_push(other, "Extra");
+            CL_push(expected, "Extra");
+            CL_compact(other);
+            if (!same_elements(other, expected)) return 0;
+        }
+        CL_free(other);
+        CL_free(expected);
+    }
+
+    return 1;
+}
+
+/*
+ * Tests CL_freeze, CL_thaw and CL_to_array on each backend, mixing
+ * changes at the ends, which the array follows, with changes it cannot
+ * follow
+ *
+ * Returns: 1 if all tests pass, 0 otherwise
+ */
+
+int test_cl_freeze() {
+    srand(41);
+    for (int kind = 0; kind < NUM_KINDS; kind++) {
+        CList list = new_list_of_kind(kind);
+        const bool heap = kind == KIND_PRIORITY;
+        CList expected = CL_new();
+
+        CL_freeze(list);
+        test_assert(CL_nth(list, 0) == INVALID_RETURN);
+        for (int i = 0; i < 400; i++) {
+            const char *element = testdata[rand() % num_testdata];
+            const int op = rand() % 10;
+            if (op < 3) {
+                CL_push(list, element);
+                heap ? CL_insert_sorted(expected, element) : CL_push(expected, element);
+            } else if (op < 6) {
+                CL_append(list, element);
+                heap ? CL_insert_sorted(expected, element) : CL_append(expected, element);
+            } else if (op == 6) {
+                CL_pop(list);
+                CL_pop(expected);
+            } else if (op == 7) {
+                CL_remove(list, -1);
+                CL_remove(expected, -1);
+            } else if (op == 8 && CL_length(expected)) {
+                const int pos = rand() % CL_length(expected);
+                CL_remove(list, pos);
+                CL_remove(expected, pos);
+            } else if (!heap) {
+                const int pos = rand() % (CL_length(expected) + 1);
+                CL_insert(list, element, pos);
+                CL_insert(expected, element, pos);
+            }
+            if (i % 50 == 0 && !heap) {
+                CL_reverse(list);
+                CL_reverse(expected);
+            }
+            if (!same_elements(list, expected)) return 0;
+        }
+
+        const CListElementType *array = CL_to_array(list);
+        for (int i = 0; i < CL_length(list); i++) test_assert(array[i] == CL_nth(list, i));
+        CL_thaw(list);
+        if (!same_elements(list, expected)) return 0;
+
+        CL_free(list);
+        CL_free(expected);
+    }
+
+    return 1;
+}
+
+// Set by test_cl_concurrent to stop its reader threads
+static atomic_bool concurrent_stop;
+
+/*
+ * CL_foreach callback for concurrent_reader: count elements that are
+ * not from testdata, which would mean a reader saw a broken node
+ */
+void check_testdata_element(int pos, CListElementType element, void *cb_data) {
+    (void)pos;
+    for (int i = 0; i < num_testdata; i++) {
+        if (element == testdata[i]) return;
+    }
+    (*(int *)cb_data)++;
+}
+
+/*
+ * Thread body for test_cl_concurrent: read the list until told to
+ * stop
+ *
+ * Returns: The number of bad elements seen, cast to a pointer
+ */
+void *concurrent_reader(void *arg) {
+    CList list = arg;
+    int bad = 0;
+    unsigned seed = 42;
+    while (!atomic_load(&concurrent_stop)) {
+        CL_foreach(list, check_testdata_element, &bad);
+        const int len = CL_length(list);
+        if (len > 0) {
+            CListElementType element = CL_nth(list, rand_r(&seed) % len);
+            if (element != INVALID_RETURN) check_testdata_element(0, element, &bad);
+        }
+        CL_count(list, "Seven");
+    }
+    return (void *)(long)bad;
+}
+
+/*
+ * Tests CL_new_concurrent: first that it behaves as a plain list,
+ * then with reader threads running while this thread writes
+ *
+ * Returns: 1 if all tests pass, 0 otherwise
+ */
+
+int test_cl_concurrent() {
+    srand(42);
+    CList list = CL_new_concurrent();
+    // The list is not sorted, so CL_insert_sorted must search from the
+    // head on both lists to agree; CL_COMPACT always does
+    CList expected = CL_new_backend(CL_COMPACT);
+    for (int i = 0; i < 1000; i++) {
+        const char *element = testdata[rand() % num_testdata];
+        const int op = rand() % 8;
+        const int pos = rand() % (CL_length(expected) + 1);
+        if (op < 3) {
+            CL_insert(list, element, pos);
+            CL_insert(expected, element, pos);
+        } else if (op < 5 && pos < CL_length(expected)) {
+            test_compare(CL_remove(list, pos), CL_remove(expected, pos));
+        } else if (op == 5) {
+            test_assert(CL_insert_sorted(list, element) == CL_insert_sorted(expected, element));
+        } else if (op == 6 && i % 20 == 0) {
+            CL_reverse(list);
+            CL_reverse(expected);
+        } else if (op == 7 && i % 10 == 0) {
+            // Split and join through another concurrent list
+            CList tail = CL_split(list, pos);
+            CList copy = CL_copy(tail);
+            CL_join(list, copy);
+            test_assert(CL_length(tail) == CL_length(expected) - pos);
+            CL_free(copy);
+            CL_free(tail);
+        } else if (op == 7 && i % 10 == 5 && pos < CL_length(expected)) {
+            // Splice a range out into the middle of another concurrent
+            // list and back
+            CList other = CL_new_concurrent();
+            CL_append(other, "x");
+            CL_append(other, "y");
+            const int end = pos + 3 < CL_length(expected) ? pos + 3 : CL_length(expected);
+            test_assert(CL_splice(other, 1, list, pos, end));
+            test_assert(CL_length(list) == CL_length(expected) - (end - pos));
+            test_assert(CL_splice(list, pos, other, 1, 1 + end - pos));
+            test_compare(CL_pop(other), "x");
+            test_compare(CL_pop(other), "y");
+            test_assert(CL_length(other) == 0);
+            CL_free(other);
+        }
+        if (i % 100 == 0 && !same_elements(list, expected)) return 0;
+    }
+    if (!same_elements(list, expected)) return 0;
+    test_assert(CL_find(list, "Seven") == CL_find(expected, "Seven"));
+    test_assert(CL_count(list, "Seven") == CL_count(expected, "Seven"));
+    CL_synchronize(list);
+    CL_free(expected);
+
+    // Freed nodes go straight back to malloc, so that any reader still
+    // on one would be caught
+    CL_set_cache_limit(list, 0);
+    atomic_store(&concurrent_stop, false);
+    pthread_t threads[4];
+    for (int t = 0; t < 4; t++) pthread_create(&threads[t], NULL, concurrent_reader, list);
+    for (int i = 0; i < 20000; i++) {
+        const char *element = testdata[rand() % num_testdata];
+        const int len = CL_length(list);
+        if (rand() % 2 && len > 0) {
+            CL_remove(list, rand() % len);
+        } else {
+            CL_insert(list, element, rand() % (len + 1));
+        }
+        if (i % 5000 == 0) CL_reverse(list);
+    }
+    atomic_store(&concurrent_stop, true);
+    for (int t = 0; t < 4; t++) {
+        void *bad;
+        pthread_join(threads[t], &bad);
+        test_assert(bad == NULL);
+    }
+
+    CL_free(list);
+    return 1;
+}
+
+/*
+ * Thread body for test_cl_sharded: append 1000 elements
+ */
+void *sharded_worker(void *arg) {
+    CListSharded sharded = arg;
+    for (int i = 0; i < 1000; i++) CLS_append(sharded, testdata[i % num_testdata]);
+    return NULL;
+}
+
+/*
+ * CL_foreach callback that checks positions run 0, 1, 2, ...
+ */
+void check_position(int pos, CListElementType element, void *cb_data) {
+    (void)element;
+    int *expected = cb_data;
+    if (pos == *expected) (*expected)++;
+}
+
+/*
+ * Tests sharded lists filled by several threads at once, and their
+ * aggregate operations
+ *
+ * Returns: 1 if all tests pass, 0 otherwise
+ */
+
+int test_cl_sharded() {
+    const CLShardPolicy policies[] = {CL_SHARD_BY_THREAD, CL_SHARD_BY_HASH};
+    const int shard_counts[] = {1, 3, 8};
+
+    for (int p = 0; p < 2; p++) {
+        for (int s = 0; s < 3; s++) {
+            CListSharded sharded = CLS_new(shard_counts[s], CL_DEQUE, policies[p]);
+            CList merged = CLS_merge(sharded);
+            test_assert(CLS_length(sharded) == 0);
+            test_assert(CL_length(merged) == 0);
+            CL_free(merged);
+
+            pthread_t threads[4];
+            for (int t = 0; t < 4; t++) pthread_create(&threads[t], NULL, sharded_worker, sharded);
+            for (int t = 0; t < 4; t++) pthread_join(threads[t], NULL);
+            CLS_push(sharded, "Extra");
+            test_assert(CLS_length(sharded) == 4001);
+
+            int next_pos = 0;
+            CLS_foreach(sharded, check_position, &next_pos);
+            test_assert(next_pos == 4001);
+
+            // The merge is the sorted copy
+            CList copy = CLS_copy(sharded);
+            test_assert(CL_length(copy) == 4001);
+            CList expected = CL_new_backend(CL_DEQUE);
+            for (int i = 0; i < CL_length(copy); i++) CL_insert_sorted(expected, CL_nth(copy, i));
+            merged = CLS_merge(sharded);
+            if (!same_elements(merged, expected)) return 0;
+
+            CL_free(expected);
+            CL_free(merged);
+            CL_free(copy);
+            CLS_free(sharded);
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * Tests CL_write and CL_to_string in both formats, against the same
+ * output built with snprintf, including strings long enough to be
+ * written direct and output larger than the write buffer
+ *
+ * Returns: 1 if all tests pass, 0 otherwise
+ */
+
+int test_cl_write() {
+    char long_string[1000];
+    memset(long_string, 'L', sizeof(long_string) - 1);
+    long_string[sizeof(long_string) - 1] = '\0';
+
+    CList list = CL_new_backend(CL_DEQUE);
+    for (int i = 0; i < 20000; i++) {
+        CL_append(list, i % 7 == 0 ? long_string : testdata[i % num_testdata]);
+    }
+    CL_append(list, "");
+
+    const CListFormat formats[] = {CL_FORMAT_INDEXED, CL_FORMAT_LINES};
+    for (int f = 0; f < 2; f++) {
+        // Expected output
+        size_t expected_len = 0;
+        for (int i = 0; i < CL_length(list); i++) {
+            expected_len += strlen(CL_nth(list, i)) + 1 + (f == 0 ? 20 : 0);
+        }
+        char *expected = malloc(expected_len + 1);
+        char *p = expected;
+        for (int i = 0; i < CL_length(list); i++) {
+            p += f == 0 ? sprintf(p, "  [%d]: %s\n", i, CL_nth(list, i))
+                        : sprintf(p, "%s\n", CL_nth(list, i));
+        }
+        expected_len = p - expected;
+
+        // CL_to_string, large enough and truncated
+        test_assert(CL_to_string(list, NULL, 0, formats[f]) == expected_len);
+        char *string = malloc(expected_len + 1);
+        test_assert(CL_to_string(list, string, expected_len + 1, formats[f]) == expected_len);
+        test_assert(strcmp(string, expected) == 0);
+        test_assert(CL_to_string(list, string, 10, formats[f]) == expected_len);
+        test_assert(strlen(string) == 9 && strncmp(string, expected, 9) == 0);
+
+        // CL_write, read back from a file
+        FILE *file = tmpfile();
+        test_assert(file);
+        test_assert(CL_write(list, fileno(file), formats[f]));
+        test_assert(fseek(file, 0, SEEK_SET) == 0);
+        test_assert(fread(string, 1, expected_len + 1, file) == expected_len);
+        test_assert(memcmp(string, expected, expected_len) == 0);
+        fclose(file);
+
+        free(string);
+        free(expected);
+    }
+
+    // A bad descriptor is reported
+    test_assert(!CL_write(list, -1, CL_FORMAT_LINES));
+    CL_free(list);
+
+    // An empty list writes nothing
+    list = CL_new();
+    char buf[4] = "xyz";
+    test_assert(CL_to_string(list, buf, sizeof(buf), CL_FORMAT_INDEXED) == 0);
+    test_assert(buf[0] == '\0');
+    test_assert(CL_write(list, -1, CL_FORMAT_INDEXED));
+    CL_free(list);
+
+    return 1;
+}
+
+/*
+ * Return the size of the file at path, or -1 if there is none
+ */
+long file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (long)st.st_size : -1;
+}
+
+/*
+ * Make the same random change to a durable list and its in-memory
+ * mirror on the same backend, and to a second pair that elements move
+ * from and to
+ *
+ * Returns: 1 if all tests pass, 0 otherwise
+ */
+int durable_random_op(CList list, CList mirror, CList other, CList other_mirror, bool heap) {
+    const char *element = testdata[rand() % num_testdata];
+    const int len = CL_length(mirror);
+    const int pos = rand() % (len + 1);
+    const int op = rand() % (heap ? 4 : 10);
+    if (op == 0) {
+        CL_push(list, element);
+        CL_push(mirror, element);
+    } else if (op == 1) {
+        CL_append(list, element);
+        CL_append(mirror, element);
+    } else if (op == 2) {
+        CL_pop(list);
+        CL_pop(mirror);
+    } else if (op == 3 && pos < len) {
+        test_compare(CL_remove(list, pos), CL_remove(mirror, pos));
+    } else if (op == 4) {
+        CL_insert(list, element, pos);
+        CL_insert(mirror, element, pos);
+    } else if (op == 5) {
+        // On an unsorted list the position depends on the backend's
+        // layout, so the mirror follows the durable list
+        CL_insert(mirror, element, CL_insert_sorted(list, element));
+    } else if (op == 6 && rand() % 10 == 0) {
+        CL_reverse(list);
+        CL_reverse(mirror);
+    } else if (op == 7 && rand() % 10 == 0) {
+        CL_free(CL_split(list, pos));
+        CL_free(CL_split(mirror, pos));
+    } else if (op == 8) {
+        const int other_len = CL_length(other_mirror);
+        const int start = rand() % (other_len + 1);
+        const int end = start + rand() % (other_len - start + 1);
+        CL_splice(list, pos, other, start, end);
+        CL_splice(mirror, pos, other_mirror, start, end);
+    } else if (op == 9) {
+        if (rand() % 2) {
+            CL_join(list, other);
+            CL_join(mirror, other_mirror);
+        } else {
+            CL_join(other, list);
+            CL_join(other_mirror, mirror);
+        }
+    }
+    if (rand() % 3 == 0) {
+        CL_append(other, element);
+        CL_append(other_mirror, element);
+    }
+    return 1;
+}
+
+/*
+ * Tests CL_open_durable on each backend: reopening after changes,
+ * after CL_sync without closing, with a torn record at the end of the
+ * journal, with a journal left over from before a checkpoint, and
+ * with automatic checkpoints
+ *
+ * Returns: 1 if all tests pass, 0 otherwise
+ */
+
+int test_cl_durable() {
+    char dir[] = "/tmp/clist_test_XXXXXX";
+    test_assert(mkdtemp(dir));
+    char path[64], journal[64], other_path[64], other_journal[64];
+    snprintf(path, sizeof(path), "%s/list", dir);
+    snprintf(journal, sizeof(journal), "%s/list.journal", dir);
+    snprintf(other_path, sizeof(other_path), "%s/other", dir);
+    snprintf(other_journal, sizeof(other_journal), "%s/other.journal", dir);
+
+    const CListBackend backends[] = {CL_LINKED, CL_TREE, CL_DEQUE, CL_COMPACT, CL_PRIORITY};
+    srand(45);
+    for (int b = 0; b < 5; b++) {
+        const bool heap = backends[b] == CL_PRIORITY;
+        CList list = CL_open_durable(path, backends[b]);
+        CList other = CL_open_durable(other_path, backends[b]);
+        test_assert(list && other);
+        test_assert(CL_length(list) == 0);
+        CList mirror = CL_new_backend(backends[b]);
+        CList other_mirror = CL_new_backend(backends[b]);
+
+        for (int round = 0; round < 4; round++) {
+            for (int i = 0; i < 300; i++) {
+                if (!durable_random_op(list, mirror, other, other_mirror, heap)) return 0;
+            }
+            if (round == 1) test_assert(CL_checkpoint(list));
+
+            // Committed changes are seen by a second opening, before
+            // the first is closed
+            test_assert(CL_sync(list));
+            CList reopened = CL_open_durable(path, backends[b]);
+            if (!same_elements(reopened, mirror)) return 0;
+            CL_free(reopened);
+
+            CL_free(list);
+            list = CL_open_durable(path, backends[b]);
+            if (!same_elements(list, mirror)) return 0;
+        }
+        CL_free(other);
+        other = CL_open_durable(other_path, backends[b]);
+        if (!same_elements(other, other_mirror)) return 0;
+
+        // A record cut short by a crash is dropped, and the journal
+        // carries on from before it
+        CL_free(list);
+        const long size = file_size(journal);
+        FILE *file = fopen(journal, "a");
+        fwrite("\x40\0\0\0garbage", 1, 11, file);
+        fclose(file);
+        list = CL_open_durable(path, backends[b]);
+        if (!same_elements(list, mirror)) return 0;
+        test_assert(file_size(journal) == size);
+        CL_push(list, "Torn");
+        CL_push(mirror, "Torn");
+        CL_free(list);
+        list = CL_open_durable(path, backends[b]);
+        if (!same_elements(list, mirror)) return 0;
+
+        // A crash between writing the snapshot and emptying the journal
+        // leaves a journal the snapshot already contains
+        CL_free(list);
+        char *old = malloc(file_size(journal));
+        file = fopen(journal, "r");
+        const size_t old_size = fread(old, 1, file_size(journal), file);
+        fclose(file);
+        list = CL_open_durable(path, backends[b]);
+        test_assert(CL_checkpoint(list));
+        CL_free(list);
+        file = fopen(journal, "w");
+        fwrite(old, 1, old_size, file);
+        fclose(file);
+        free(old);
+        list = CL_open_durable(path, backends[b]);
+        if (!same_elements(list, mirror)) return 0;
+
+        CL_free(list);
+        CL_free(other);
+        CL_free(mirror);
+        CL_free(other_mirror);
+        unlink(path);
+        unlink(journal);
+        unlink(other_path);
+        unlink(other_journal);
+    }
+
+    // Long runs of changes are checkpointed, which keeps the journal
+    // small, and commits every change when asked to
+    CList list = CL_open_durable(path, CL_DEQUE);
+    CList mirror = CL_new_backend(CL_DEQUE);
+    CL_set_group_commit(list, 0);
+    for (int i = 0; i < 200; i++) CL_push(list, testdata[i % num_testdata]);
+    CL_set_group_commit(list, 1000);
+    for (int i = 0; i < 100000; i++) {
+        CL_append(list, testdata[i % num_testdata]);
+        if (i % 3 == 0) CL_pop(list);
+    }
+    test_assert(file_size(journal) < 2 * (1 << 20));
+    test_assert(file_size(path) > 0);
+    CL_free(list);
+    list = CL_open_durable(path, CL_DEQUE);
+    for (int i = 0; i < 200; i++) CL_push(mirror, testdata[i % num_testdata]);
+    for (int i = 0; i < 100000; i++) {
+        CL_append(mirror, testdata[i % num_testdata]);
+        if (i % 3 == 0) CL_pop(mirror);
+    }
+    if (!same_elements(list, mirror)) return 0;
+    CL_free(list);
+    CL_free(mirror);
+    unlink(path);
+    unlink(journal);
+
+    // A checkpoint that falls due while an operation is still logging
+    // its records waits for the operation to finish
+    list = CL_open_durable(path, CL_LINKED);
+    mirror = CL_new();
+    for (int i = 0; i < 4000; i++) {
+        CList batch = CL_new();
+        for (int j = 0; j < 16; j++) CL_append(batch, testdata[(i + j) % num_testdata]);
+        CList batch_copy = CL_copy(batch);
+        CL_splice(list, i % 3, batch, 0, 16);
+        CL_splice(mirror, i % 3, batch_copy, 0, 16);
+        CL_free(batch);
+        CL_free(batch_copy);
+        if (CL_length(list) > 200) {
+            CL_free(CL_split(list, 100));
+            CL_free(CL_split(mirror, 100));
+        }
+    }
+    test_assert(file_size(path) > 0);
+    CL_free(list);
+    list = CL_open_durable(path, CL_LINKED);
+    if (!same_elements(list, mirror)) return 0;
+    CL_free(list);
+    CL_free(mirror);
+    unlink(path);
+    unlink(journal);
+
+    // The same holds for a move, which is logged as one record
+    const char *letters[] = {"a", "b", "c", "d", "e", "f", "g", "h"};
+    list = CL_open_durable(path, CL_DLINKED);
+    mirror = CL_new();
+    CListHandle handles[8];
+    for (int i = 0; i < 8; i++) {
+        handles[i] = CL_append_h(list, letters[i]);
+        CL_append(mirror, letters[i]);
+    }
+    for (int i = 0; i < 200000; i++) {
+        const int k = (i * 5 + i / 8) % 8;
+        CL_move_to_front_h(list, handles[k]);
+        CL_push(mirror, CL_remove(mirror, CL_find(mirror, letters[k])));
+    }
+    test_assert(file_size(path) > 0);
+    CL_free(list);
+    list = CL_open_durable(path, CL_DLINKED);
+    if (!same_elements(list, mirror)) return 0;
+    CL_free(list);
+    CL_free(mirror);
+
+    // Files that are not a list are refused
+    FILE *file = fopen(path, "w");
+    fputs("not a list", file);
+    fclose(file);
+    test_assert(CL_open_durable(path, CL_LINKED) == NULL);
+
+    unlink(path);
+    unlink(journal);
+    test_assert(rmdir(dir) == 0);
+    return 1;
+}
+
+/*
+ * Apply to replica every change a subscription has waiting
+ *
+ * Returns: 1 if the changes could be applied and none was lost, 0
+ *   otherwise
+ */
+int apply_changes(CListSubscription subscription, CList replica) {
+    CListChange change;
+    while (CL_next_change(subscription, &change)) {
+        if (change.kind == CL_CHANGE_INSERT) {
+            test_assert(change.count == 1 && change.element);
+            test_assert(CL_insert(replica, change.element, change.pos));
+        } else if (change.kind == CL_CHANGE_REMOVE) {
+            test_assert(change.count > 0);
+            if (change.count == 1) {
+                test_compare(CL_remove(replica, change.pos), change.element);
+            } else {
+                test_assert(change.element == NULL);
+                CL_free(CL_split(replica, change.pos));
+                test_assert(CL_length(replica) == change.pos);
+            }
+        } else if (change.kind == CL_CHANGE_REVERSE) {
+            CL_reverse(replica);
+        } else {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// State shared with the thread reading a feed in test_cl_feed
+struct feed_reader {
+    CListSubscription subscription;
+    CList replica;
+    atomic_bool done;
+    int result;
+};
+
+/*
+ * Thread body for test_cl_feed: follow a list from its feed until
+ * told the writer is done
+ */
+static void *feed_reader_thread(void *arg) {
+    struct feed_reader *reader = arg;
+    reader->result = 1;
+    while (!atomic_load(&reader->done)) {
+        if (!apply_changes(reader->subscription, reader->replica)) reader->result = 0;
+    }
+    if (!apply_changes(reader->subscription, reader->replica)) reader->result = 0;
+    return NULL;
+}
+
+/*
+ * Tests CL_subscribe: replicas built from the changes a subscription
+ * delivers match the list on each backend, a subscriber that falls
+ * behind is told it lost changes, and a subscription can be read from
+ * another thread and after its list is freed
+ *
+ * Returns: 1 if all tests pass, 0 otherwise
+ */
+
+int test_cl_feed() {
+    const CListBackend backends[] = {CL_LINKED, CL_TREE, CL_DEQUE, CL_COMPACT};
+    srand(46);
+    for (int b = 0; b < 4; b++) {
+        CList list = CL_new_backend(backends[b]);
+        CList other = CL_new_backend(backends[b]);
+        CList mirror = CL_new_backend(backends[b]);
+        CList other_mirror = CL_new_backend(backends[b]);
+        for (int i = 0; i < 20; i++) {
+            CL_append(list, testdata[i % num_testdata]);
+            CL_append(mirror, testdata[i % num_testdata]);
+        }
+
+        // Subscribers start from a copy taken when they subscribe
+        CListSubscription subscription = CL_subscribe(list);
+        CListSubscription other_subscription = CL_subscribe(other);
+        CList replica = CL_new_owning(CL_DEQUE);
+        CList other_replica = CL_new_owning(CL_DEQUE);
+        CList start = CL_copy(list);
+        CL_join(replica, start);
+        CL_free(start);
+        for (int i = 0; i < 2000; i++) {
+            if (!durable_random_op(list, mirror, other, other_mirror, false)) return 0;
+            // Joins send every element they move, so both are read
+            // often enough that neither is lapped
+            if (rand() % 50 == 0) {
+                if (!apply_changes(subscription, replica)) return 0;
+                if (!apply_changes(other_subscription, other_replica)) return 0;
+                if (!same_elements(replica, list)) return 0;
+            }
+        }
+        if (!apply_changes(subscription, replica)) return 0;
+        if (!apply_changes(other_subscription, other_replica)) return 0;
+        if (!same_elements(replica, list)) return 0;
+        if (!same_elements(other_replica, other)) return 0;
+
+        CL_unsubscribe(subscription);
+        CL_unsubscribe(other_subscription);
+        CL_free(list);
+        CL_free(other);
+        CL_free(mirror);
+        CL_free(other_mirror);
+        CL_free(replica);
+        CL_free(other_replica);
+    }
+
+    // A subscriber that lets the writer lap it loses changes, once,
+    // and then follows again
+    CList list = CL_new_backend(CL_DEQUE);
+    CListSubscription slow = CL_subscribe(list);
+    CListSubscription fast = CL_subscribe(list);
+    CList replica = CL_new_owning(CL_DEQUE);
+    CListChange change;
+    for (int i = 0; i < 100000; i++) {
+        CL_push(list, testdata[i % num_testdata]);
+        CL_pop(list);
+        if (!apply_changes(fast, replica)) return 0;
+    }
+    test_assert(CL_next_change(slow, &change) && change.kind == CL_CHANGE_LOST);
+    test_assert(!CL_next_change(slow, &change));
+    CL_append(list, "After");
+    test_assert(CL_next_change(slow, &change) && change.kind == CL_CHANGE_INSERT);
+    test_compare(change.element, "After");
+    test_assert(change.pos == 0);
+
+    // Changes to elements too long for the ring are lost
+    char *long_element = malloc(1 << 20);
+    memset(long_element, 'x', (1 << 20) - 1);
+    long_element[(1 << 20) - 1] = '\0';
+    CL_push(list, long_element);
+    test_assert(CL_next_change(slow, &change) && change.kind == CL_CHANGE_LOST);
+    CL_pop(list);
+    free(long_element);
+    CL_unsubscribe(fast);
+
+    // Changes made before the list is freed can still be read
+    CL_reverse(list);
+    CL_free(list);
+    test_assert(CL_next_change(slow, &change) && change.kind == CL_CHANGE_LOST);
+    test_assert(CL_next_change(slow, &change) && change.kind == CL_CHANGE_REVERSE);
+    test_assert(!CL_next_change(slow, &change));
+    CL_unsubscribe(slow);
+    CL_free(replica);
+
+    // An insert into a CL_PRIORITY list has no position
+    list = CL_new_backend(CL_PRIORITY);
+    slow = CL_subscribe(list);
+    CL_push(list, "Heap");
+    CL_insert_sorted(list, "Heap");
+    test_assert(CL_next_change(slow, &change) && change.pos == -1);
+    test_assert(CL_next_change(slow, &change) && change.pos == -1);
+    CL_unsubscribe(slow);
+    CL_free(list);
+
+    // Another thread follows the list while it changes; the changes
+    // fit in the ring, so none can be lost
+    list = CL_new_backend(CL_DEQUE);
+    struct feed_reader reader = {.subscription = CL_subscribe(list),
+                                 .replica = CL_new_owning(CL_DEQUE)};
+    atomic_init(&reader.done, false);
+    pthread_t thread;
+    pthread_create(&thread, NULL, feed_reader_thread, &reader);
+    for (int i = 0; i < 20000; i++) {
+        if (i % 3 == 2) {
+            CL_remove(list, rand() % CL_length(list));
+        } else {
+            CL_insert(list, testdata[i % num_testdata], rand() % (CL_length(list) + 1));
+        }
+    }
+    atomic_store(&reader.done, true);
+    pthread_join(thread, NULL);
+    test_assert(reader.result);
+    if (!same_elements(reader.replica, list)) return 0;
+    CL_unsubscribe(reader.subscription);
+    CL_free(reader.replica);
+    CL_free(list);
+    return 1;
+}
+
+/*
+ * Tests the CL_DLINKED backend and the handle API: a small LRU cache
+ * kept with handles matches one kept by position, handles follow
+ * their elements between lists, and changes made through handles
+ * reach subscribers and the journal of a durable list
+ *
+ * Returns: 1 if all tests pass, 0 otherwise
+ */
+
+int test_cl_dlinked() {
+    CList dlist, linked;
+    if (!random_ops_match_linked(CL_DLINKED, 47, &dlist, &linked)) return 0;
+    CList copy = CL_copy(dlist);
+    if (!same_elements(copy, linked)) return 0;
+    CL_free(copy);
+    CL_free(dlist);
+    CL_free(linked);
+
+    // An LRU cache of 8 keys: a hit moves the key to the front, a miss
+    // adds it there and evicts the key at the back
+    const int cap = 8;
+    CList lru = CL_new_backend(CL_DLINKED);
+    CList expected = CL_new();
+    CListHandle *handles = calloc(num_testdata, sizeof(CListHandle));
+    srand(47);
+    for (int i = 0; i < 5000; i++) {
+        const int key = rand() % num_testdata;
+        if (handles[key]) {
+            test_assert(CL_element_h(handles[key]) == testdata[key]);
+            CL_move_to_front_h(lru, handles[key]);
+            CL_push(expected, CL_remove(expected, CL_find(expected, testdata[key])));
+        } else {
+            handles[key] = CL_push_h(lru, testdata[key]);
+            CL_push(expected, testdata[key]);
+        }
+        if (CL_length(lru) > cap) {
+            int victim = 0;
+            while (testdata[victim] != CL_nth(lru, -1)) victim++;
+            test_assert(CL_remove_h(lru, handles[victim]) == CL_remove(expected, -1));
+            handles[victim] = NULL;
+        }
+        if (!same_elements(lru, expected)) return 0;
+    }
+    free(handles);
+    CL_free(lru);
+    CL_free(expected);
+
+    // Handles follow their elements into other lists, and CL_compact
+    // leaves them where they are
+    CList list = CL_new_backend(CL_DLINKED);
+    CListHandle first = CL_append_h(list, "One");
+    CListHandle third = CL_append_h(list, "Three");
+    CListHandle second = CL_insert_after_h(list, first, "Two");
+    CListHandle zero = CL_insert_h(list, "Zero", 0);
+    test_assert(CL_insert_h(list, "Out", 6) == NULL);
+    CListHandle last = CL_insert_h(list, "Four", -1);
+    CL_compact(list);
+    CList other = CL_split(list, 2);
+    test_assert(CL_length(list) == 2 && CL_length(other) == 3);
+    CL_move_to_front_h(other, last);
+    test_compare(CL_remove_h(other, third), "Three");
+    CL_join(list, other);
+    test_compare(CL_remove_h(list, zero), "Zero");
+    CL_insert_after_h(list, second, "Two and a half");
+    const char *order[] = {"One", "Four", "Two", "Two and a half"};
+    for (int i = 0; i < 4; i++) test_compare(CL_nth(list, i), order[i]);
+    CL_splice(other, 0, list, 1, 3);
+    test_compare(CL_remove_h(other, second), "Two");
+    test_compare(CL_remove_h(list, first), "One");
+    CL_free(list);
+    CL_free(other);
+
+    // Changes made through handles reach subscribers and the journal,
+    // with their positions
+    char dir[] = "/tmp/clist_test_XXXXXX";
+    test_assert(mkdtemp(dir));
+    char path[64], journal[64];
+    snprintf(path, sizeof(path), "%s/list", dir);
+    snprintf(journal, sizeof(journal), "%s/list.journal", dir);
+    list = CL_open_durable(path, CL_DLINKED);
+    CListSubscription subscription = CL_subscribe(list);
+    CList replica = CL_new_owning(CL_DEQUE);
+    handles = calloc(num_testdata, sizeof(CListHandle));
+    for (int i = 0; i < 2000; i++) {
+        const int key = rand() % num_testdata;
+        if (!handles[key]) {
+            const int pos = rand() % (CL_length(list) + 1);
+            handles[key] = rand() % 2 ? CL_append_h(list, testdata[key])
+                                      : CL_insert_h(list, testdata[key], pos);
+        } else if (rand() % 3 == 0) {
+            CL_remove_h(list, handles[key]);
+            handles[key] = NULL;
+        } else if (rand() % 2) {
+            CL_move_to_front_h(list, handles[key]);
+        } else {
+            const int next = (key + 1) % num_testdata;
+            if (!handles[next]) {
+                handles[next] = CL_insert_after_h(list, handles[key], testdata[next]);
+            }
+        }
+    }
+    if (!apply_changes(subscription, replica)) return 0;
+    if (!same_elements(replica, list)) return 0;
+    CL_free(list);
+    list = CL_open_durable(path, CL_DLINKED);
+    if (!same_elements(list, replica)) return 0;
+
+    CL_unsubscribe(subscription);
+    free(handles);
+    CL_free(list);
+    CL_free(replica);
+    unlink(path);
+    unlink(journal);
+    test_assert(rmdir(dir) == 0);
+    return 1;
+}
+
+/*
+ * Return the number of times key was found so far, per the counts
+ * kept by test_cl_find_adaptive
+ */
+static int found_count(const char **keys, const int *counts, int n, const char *key) {
+    for (int i = 0; i < n; i++) {
+        if (strcmp(keys[i], key) == 0) return counts[i];
+    }
+    return 0;
+}
+
+/*
+ * Tests CL_find_adaptive with each policy on each backend and kind of
+ * list, against the same moves made by position on a linked list
+ *
+ * Returns: 1 if all tests pass, 0 otherwise
+ */
+
+int test_cl_find_adaptive() {
+    const CListFindPolicy policies[] = {CL_FIND_MOVE_TO_FRONT, CL_FIND_TRANSPOSE, CL_FIND_COUNT};
+    const char *absent = "absent-key";
+
+    srand(48);
+    for (int kind = 0; kind < NUM_KINDS; kind++) {
+        // A heap keeps its own order, so elements cannot be moved
+        if (kind == KIND_PRIORITY) continue;
+        for (int p = 0; p < 3; p++) {
+            // The small list is kept short enough to stay in its array
+            const int length = kind == KIND_SMALL ? 6 : 60;
+            CList list = new_list_of_kind(kind);
+            CList expected = CL_new();
+            for (int i = 0; i < length; i++) {
+                CL_append(list, testdata[i % num_testdata]);
+                CL_append(expected, testdata[i % num_testdata]);
+            }
+            const char *keys[64];
+            int counts[64] = {0};
+            int num_keys = 0;
+
+            for (int i = 0; i < 1000; i++) {
+                // Skewed: low positions of testdata are looked up most
+                const int r = rand() % (length + 1);
+                const char *key = r == length ? absent : testdata[(r * r / length) % num_testdata];
+                int pos = CL_find(expected, key);
+                int to = 0;
+                if (pos >= 0 && policies[p] == CL_FIND_TRANSPOSE) {
+                    to = pos ? pos - 1 : 0;
+                } else if (pos >= 0 && policies[p] == CL_FIND_COUNT) {
+                    int k = 0;
+                    while (k < num_keys && strcmp(keys[k], key) != 0) k++;
+                    if (k == num_keys) keys[num_keys++] = key;
+                    const int count = ++counts[k];
+                    while (to < pos &&
+                           found_count(keys, counts, num_keys, CL_nth(expected, to)) >= count) {
+                        to++;
+                    }
+                }
+                if (pos >= 0) CL_insert(expected, CL_remove(expected, pos), to);
+
+                test_assert(CL_find_adaptive(list, key, policies[p]) == (pos >= 0 ? to : -1));
+                test_assert(CL_length(list) == length);
+                if (!same_elements(list, expected)) return 0;
+            }
+
+            // The most popular key has made its way to the front
+            if (policies[p] == CL_FIND_COUNT) test_compare(CL_nth(list, 0), testdata[0]);
+            CL_free(list);
+            CL_free(expected);
+        }
+    }
+
+    // A priority queue keeps its order
+    CList queue = CL_new_backend(CL_PRIORITY);
+    for (int i = 0; i < num_testdata; i++) CL_push(queue, testdata[i]);
+    const int rank = CL_find(queue, testdata[3]);
+    test_assert(CL_find_adaptive(queue, testdata[3], CL_FIND_MOVE_TO_FRONT) == rank);
+    test_assert(CL_find(queue, testdata[3]) == rank);
+    CL_free(queue);
+
+    // A durable list comes back as it was left, however many
+    // checkpoints its moves went through
+    char dir[] = "/tmp/clist_test_XXXXXX";
+    test_assert(mkdtemp(dir));
+    char path[64], journal[64];
+    snprintf(path, sizeof(path), "%s/list", dir);
+    snprintf(journal, sizeof(journal), "%s/list.journal", dir);
+    const char *letters[] = {"a", "b", "c", "d", "e", "f", "g", "h"};
+    for (int p = 0; p < 3; p++) {
+        CList durable = CL_open_durable(path, CL_LINKED);
+        CList expected = CL_new();
+        for (int i = 0; i < 8; i++) {
+            CL_append(durable, letters[i]);
+            CL_append(expected, letters[i]);
+        }
+        for (int i = 0; i < 100000; i++) {
+            const char *key = letters[(i * 5 + i / 8) % 8];
+            test_assert(CL_find_adaptive(durable, key, policies[p]) ==
+                        CL_find_adaptive(expected, key, policies[p]));
+        }
+        CL_free(durable);
+        durable = CL_open_durable(path, CL_LINKED);
+        if (!same_elements(durable, expected)) return 0;
+        CL_free(durable);
+        CL_free(expected);
+        unlink(path);
+        unlink(journal);
+    }
+    test_assert(rmdir(dir) == 0);
+
+    // Handles stay valid, and subscribers see each move
+    CList list = CL_new_backend(CL_DLINKED);
+    CListHandle handle = NULL;
+    for (int i = 0; i < 20; i++) {
+        CListHandle h = CL_append_h(list, testdata[i]);
+        if (i == 15) handle = h;
+    }
+    CListSubscription subscription = CL_subscribe(list);
+    CList replica = CL_new_owning(CL_DEQUE);
+    for (int i = 0; i < 20; i++) CL_append(replica, testdata[i]);
+    test_assert(CL_find_adaptive(list, testdata[15], CL_FIND_MOVE_TO_FRONT) == 0);
+    test_assert(CL_find_adaptive(list, testdata[10], CL_FIND_TRANSPOSE) == 10);
+    test_assert(CL_find_adaptive(list, testdata[10], CL_FIND_COUNT) == 0);
+    if (!apply_changes(subscription, replica)) return 0;
+    if (!same_elements(replica, list)) return 0;
+    test_compare(CL_element_h(handle), testdata[15]);
+    test_compare(CL_remove_h(list, handle), testdata[15]);
+    CL_unsubscribe(subscription);
+    CL_free(replica);
+    CL_free(list);
+    return 1;
+}
+
+/*
+ * Tests CL_insert_sorted on input that is mostly in order, mixed with
+ * other changes, and CL_insert_sorted_stream, on each kind of list
+ *
+ * Returns: 1 if all tests pass, 0 otherwise
+ */
+
+int test_cl_insert_sorted_stream() {
+    static char keys[300][8];
+    for (int i = 0; i < 300; i++) snprintf(keys[i], sizeof(keys[i]), "k%03d", i);
+    srand(49);
+    for (int kind = 0; kind < NUM_KINDS; kind++) {
+        // A heap keeps its own order, so positions are not comparable
+        if (kind == KIND_PRIORITY) continue;
+        CList list = new_list_of_kind(kind);
+        CList expected = CL_new_backend(CL_DEQUE);
+        int next = 0;
+        for (int i = 0; i < 2000; i++) {
+            const int r = rand() % 20;
+            if (r == 0 && CL_length(expected)) {
+                const int pos = rand() % CL_length(expected);
+                test_compare(CL_remove(list, pos), CL_remove(expected, pos));
+            } else if (r == 1) {
+                CList tail = CL_split(list, rand() % (CL_length(expected) + 1));
+                CL_join(list, tail);
+                CL_free(tail);
+            } else {
+                // Ascending with repeats, wrapping around now and then,
+                // and the odd straggler
+                const char *element = keys[r == 2 ? rand() % 300 : next % 300];
+                next += rand() % 3;
+                const int pos = CL_insert_sorted(list, element);
+                test_assert(pos >= 0 && pos <= CL_length(expected));
+                test_assert(pos == 0 || strcmp(CL_nth(expected, pos - 1), element) <= 0);
+                test_assert(pos == CL_length(expected) ||
+                            strcmp(CL_nth(expected, pos), element) >= 0);
+                CL_insert(expected, element, pos);
+            }
+            if (i % 250 == 0 && !same_elements(list, expected)) return 0;
+        }
+        if (!same_elements(list, expected)) return 0;
+
+        // A batch in order, one out of order, and an empty one
+        const char *batch[100];
+        for (int i = 0; i < 100; i++) batch[i] = keys[i * 3];
+        CL_insert_sorted_stream(list, batch, 100);
+        for (int i = 0; i < 100; i++) batch[i] = keys[rand() % 300];
+        CL_insert_sorted_stream(list, batch, 100);
+        CL_insert_sorted_stream(list, NULL, 0);
+        test_assert(CL_length(list) == CL_length(expected) + 200);
+        for (int i = 0; i < 100; i++) test_assert(CL_count(list, batch[i]) > 0);
+        const CListElementType *elements = CL_to_array(list);
+        for (int i = 1; i < CL_length(list); i++) {
+            test_assert(strcmp(elements[i - 1], elements[i]) <= 0);
+        }
+        CL_free(list);
+        CL_free(expected);
+    }
+    return 1;
+}
+
+/*
+ * Tests CL_contains with a membership filter kept through every kind
+ * of change, on each backend, and the counters of CL_filter_stats
+ *
+ * Returns: 1 if all tests pass, 0 otherwise
+ */
+
+int test_cl_filter() {
+    static char keys[400][12];
+    for (int i = 0; i < 400; i++) {
+        snprintf(keys[i], sizeof(keys[i]), i < 200 ? "key%03d" : "miss%03d", i);
+    }
+
+    srand(50);
+    // Every kind of list, and then an owning one
+    for (int kind = 0; kind <= NUM_KINDS; kind++) {
+        CList list = kind == NUM_KINDS ? CL_new_owning(CL_LINKED) : new_list_of_kind(kind);
+        CList other = kind == NUM_KINDS ? CL_new_owning(CL_LINKED) : new_list_of_kind(kind);
+        for (int i = 0; i < 50; i++) CL_append(list, keys[i]);
+        CL_set_filter(list, 10);
+
+        for (int i = 0; i < 3000; i++) {
+            // Only the first 200 keys are ever added
+            const char *element = keys[rand() % 200];
+            const int len = CL_length(list);
+            const int op = rand() % 10;
+            if (op == 0) {
+                CL_push(list, element);
+            } else if (op == 1) {
+                CL_append(list, element);
+            } else if (op == 2) {
+                CL_insert(list, element, rand() % (len + 1));
+            } else if (op == 3) {
+                CL_insert_sorted(list, element);
+            } else if (op < 6 && len) {
+                CL_remove(list, rand() % len);
+            } else if (op == 6 && len) {
+                CL_pop(list);
+            } else if (op == 7 && i % 10 == 0) {
+                // Away to the other list and back again
+                CList tail = CL_split(list, rand() % (len + 1));
+                CL_join(other, tail);
+                CL_free(tail);
+                CL_splice(list, 0, other, 0, rand() % (CL_length(other) + 1));
+            } else if (op == 8 && kind == KIND_DLINKED) {
+                CL_remove_h(list, CL_append_h(list, element));
+                CL_push_h(list, element);
+            }
+
+            const char *key = keys[rand() % 400];
+            test_assert(CL_contains(list, key) == (CL_find(list, key) >= 0));
+        }
+
+        CListFilterStats stats;
+        CL_filter_stats(list, &stats);
+        test_assert(stats.bits > 0 && stats.lookups == 3000);
+        test_assert(stats.rejected > 0 && stats.rebuilds > 0);
+        test_assert(stats.false_positive_rate < 0.1 && stats.expected_rate < 0.1);
+
+        // Without the filter, CL_contains still answers
+        CL_set_filter(list, 0);
+        CL_filter_stats(list, &stats);
+        test_assert(stats.bits == 0 && stats.lookups == 0);
+        test_assert(!CL_contains(list, keys[300]));
+        if (CL_length(list)) test_assert(CL_contains(list, CL_nth(list, 0)));
+        CL_set_filter(list, 10);
+        CL_free(list);
+        CL_free(other);
+    }
+
+    // Misses on a large list are mostly turned away, about as often as
+    // the bits set predict
+    CList list = CL_new();
+    static char ids[20000][12];
+    for (int i = 0; i < 20000; i++) {
+        snprintf(ids[i], sizeof(ids[i]), "id%05d", i);
+        if (i % 2 == 0) CL_append(list, ids[i]);
+    }
+    CL_set_filter(list, 10);
+    for (int i = 1; i < 20000; i += 2) test_assert(!CL_contains(list, ids[i]));
+    CListFilterStats stats;
+    CL_filter_stats(list, &stats);
+    test_assert(stats.lookups == 10000 && stats.rejected + stats.false_positives == 10000);
+    test_assert(stats.false_positive_rate < 0.03);
+    test_assert(stats.expected_rate > stats.false_positive_rate / 3);
+    test_assert(stats.expected_rate < stats.false_positive_rate * 3);
+    CL_free(list);
+    return 1;
+}
+
+/*
+ * Tests CL_new_owning and CL_compact_strings on each backend
+ *
+ * Returns: 1 if all tests pass, 0 otherwise
+ */
+
+int test_cl_owning() {
+    const CListBackend backends[] = {CL_LINKED, CL_TREE, CL_DEQUE, CL_PRIORITY, CL_COMPACT};
+    char buf[16];
+
+    for (int b = 0; b < 5; b++) {
+        CList list = CL_new_owning(backends[b]);
+
+        // Every insertion function copies the caller's string
+        for (int i = 0; i < 100; i++) {
+            snprintf(buf, sizeof(buf), "id%03d", i);
+            switch (i % 4) {
+                case 0:
+                    CL_append(list, buf);
+                    break;
+                case 1:
+                    CL_push(list, buf);
+                    break;
+                case 2:
+                    CL_insert(list, buf, CL_length(list) / 2);
+                    break;
+                case 3:
+                    CL_insert_sorted(list, buf);
+                    break;
+            }
+        }
+        snprintf(buf, sizeof(buf), "overwritten");
+        test_assert(CL_length(list) == 100);
+        for (int i = 0; i < 100; i++) test_assert(strncmp(CL_nth(list, i), "id", 2) == 0);
+
+        // Nothing to reclaim until something is removed
+        test_assert(CL_compact_strings(list) == 0);
+
+        // Removed elements stay readable until compaction
+        char removed[16];
+        const char *element = CL_pop(list);
+        strcpy(removed, element);
+        for (int i = 0; i < 49; i++) CL_remove(list, -1);
+        test_compare(element, removed);
+        test_assert(CL_compact_strings(list) == 50 * 6);
+        test_assert(CL_compact_strings(list) == 0);
+        test_assert(CL_length(list) == 50);
+
+        // Copies and split-off tails own their strings
+        CList copy = CL_copy(list);
+        CList tail = CL_split(list, 20);
+        test_assert(CL_length(tail) == 30);
+        test_assert(CL_compact_strings(list) == 30 * 6);
+        for (int i = 0; i < 20; i++) test_compare(CL_nth(list, i), CL_nth(copy, i));
+        for (int i = 0; i < 30; i++) test_compare(CL_nth(tail, i), CL_nth(copy, 20 + i));
+        CL_free(copy);
+
+        // Joining owning lists copies the strings again
+        CL_join(list, tail);
+        CL_free(tail);
+        test_assert(CL_length(list) == 50);
+        for (int i = 0; i < 50; i++) test_assert(strncmp(CL_nth(list, i), "id", 2) == 0);
+        CL_free(list);
+    }
+
+    // A borrowing list can take elements that stay in the owner's arena
+    CList owner = CL_new_owning(CL_LINKED);
+    CList borrower = CL_new();
+    for (int i = 0; i < num_testdata; i++) CL_append(owner, testdata[i]);
+    test_assert(CL_splice(borrower, 0, owner, 0, 10));
+    test_assert(CL_nth(borrower, 0) != testdata[0]);
+    for (int i = 0; i < 10; i++) test_compare(CL_nth(borrower, i), testdata[i]);
+    CL_free(borrower);
+    CL_free(owner);
+
+    // A list that does not own its strings has nothing to reclaim
+    CList plain = CL_new();
+    CL_push(plain, testdata[0]);
+    CL_pop(plain);
+    test_assert(CL_compact_strings(plain) == 0);
+    CL_free(plain);
+
+    return 1;
+}
+
+/*
+ * Tests the CL_split function on each backend
+ *
+ * Returns: 1 if all tests pass, 0 otherwise
+ */
+
+int test_cl_split() {
+    const CListBackend backends[] = {CL_LINKED, CL_TREE, CL_DEQUE, CL_COMPACT};
+
+    for (int b = 0; b < 4; b++) {
+        CList list = CL_new_backend(backends[b]);
+
+        // Out-of-range positions fail and leave the list alone
+        test_assert(CL_split(list, 1) == NULL);
+        test_assert(CL_split(list, -1) == NULL);
+
+        for (int i = 0; i < 10; i++) CL_append(list, testdata[i]);
+        test_assert(CL_split(list, 11) == NULL);
+        test_assert(CL_split(list, -11) == NULL);
+
+        // Splitting at the length gives an empty tail
+        CList tail = CL_split(list, 10);
+        test_assert(CL_length(tail) == 0);
+        test_assert(CL_length(list) == 10);
+        CL_free(tail);
+
+        // Negative positions count from the end
+        tail = CL_split(list, -4);
+        test_assert(CL_length(list) == 6);
+        test_assert(CL_length(tail) == 4);
+        for (int i = 0; i < 6; i++) test_compare(CL_nth(list, i), testdata[i]);
+        for (int i = 0; i < 4; i++) test_compare(CL_nth(tail, i), testdata[6 + i]);
+
+        // Splitting at 0 moves everything, and joining puts it back
+        CList all = CL_split(list, 0);
+        test_assert(CL_length(list) == 0);
+        test_assert(CL_length(all) == 6);
+        CL_join(all, tail);
+        for (int i = 0; i < 10; i++) test_compare(CL_nth(all, i), testdata[i]);
+
+        CL_free(list);
+        CL_free(tail);
+        CL_free(all);
+    }
+
+    return 1;
+}
+
+/*
+ * Tests the CL_splice function, on each backend and between backends
+ *
+ * Returns: 1 if all tests pass, 0 otherwise
+ */
+
+int test_cl_splice() {
+    const CListBackend backends[] = {CL_LINKED, CL_TREE, CL_DEQUE, CL_COMPACT};
+
+    for (int b = 0; b < 16; b++) {
+        CList dest = CL_new_backend(backends[b / 4]);
+        CList src = CL_new_backend(backends[b % 4]);
+
+        for (int i = 0; i < 3; i++) CL_append(dest, testdata[i]);
+        for (int i = 10; i < 15; i++) CL_append(src, testdata[i]);
+
+        // Invalid ranges fail and leave both lists alone
+        test_assert(!CL_splice(dest, 0, dest, 0, 1));
+        test_assert(!CL_splice(dest, 5, src, 0, 1));
+        test_assert(!CL_splice(dest, 0, src, 3, 2));
+        test_assert(!CL_splice(dest, 0, src, 0, 6));
+        test_assert(CL_length(dest) == 3);
+        test_assert(CL_length(src) == 5);
+
+        // An empty range is a no-op
+        test_assert(CL_splice(dest, 1, src, 2, 2));
+        test_assert(CL_length(dest) == 3);
+        test_assert(CL_length(src) == 5);
+
+        // dest = Zero Eleven Twelve One Two, src = Ten Thirteen Fourteen
+        test_assert(CL_splice(dest, 1, src, 1, 3));
+        test_assert(CL_length(dest) == 5);
+        test_assert(CL_length(src) == 3);
+        test_compare(CL_nth(dest, 0), testdata[0]);
+        test_compare(CL_nth(dest, 1), testdata[11]);
+        test_compare(CL_nth(dest, 2), testdata[12]);
+        test_compare(CL_nth(dest, 3), testdata[1]);
+        test_compare(CL_nth(dest, 4), testdata[2]);
+        test_compare(CL_nth(src, 0), testdata[10]);
+        test_compare(CL_nth(src, 1), testdata[13]);
+
+        // Negative positions: move the last two of src to the end of dest
+        test_assert(CL_splice(dest, -1, src, -2, 3));
+        test_assert(CL_length(dest) == 7);
+        test_assert(CL_length(src) == 1);
+        test_compare(CL_nth(dest, -2), testdata[13]);
+        test_compare(CL_nth(dest, -1), testdata[14]);
+
+        // Move everything that is left into an empty position 0
+        test_assert(CL_splice(src, 0, dest, 0, CL_length(dest)));
+        test_assert(CL_length(dest) == 0);
+        test_assert(CL_length(src) == 8);
+        test_compare(CL_nth(src, 0), testdata[0]);
+        test_compare(CL_nth(src, -1), testdata[10]);
+
+        CL_free(dest);
+        CL_free(src);
+    }
+
+    return 1;
+}
+
+/*
+ * Tests the node cache: CL_set_cache_limit, CL_trim and CL_cache_stats
+ *
+ * Returns: 1 if all tests pass, 0 otherwise
+ */
+
+int test_cl_cache() {
+    CList list = CL_new();
+    CListCacheStats stats;
+
+    CL_cache_stats(list, &stats);
+    test_assert(stats.hits == 0 && stats.misses == 0);
+    test_assert(stats.cached == 0 && stats.high_water == 0);
+
+    // Fresh nodes come from malloc; popped ones go to the cache
+    for (int i = 0; i < 10; i++) CL_push(list, testdata[i]);
+    for (int i = 0; i < 10; i++) CL_pop(list);
+    CL_cache_stats(list, &stats);
+    test_assert(stats.misses == 10);
+    test_assert(stats.cached == 10);
+    test_assert(stats.high_water == 10);
+
+    // Queue-style churn on a list too long to be stored inline is then
+    // served from the cache, apart from the one node needed beyond the
+    // ten already cached
+    for (int i = 0; i < 10; i++) CL_append(list, testdata[i]);
+    for (int i = 0; i < 1000; i++) {
+        CL_append(list, testdata[i % num_testdata]);
+        CL_pop(list);
+        test_assert(CL_length(list) == 10);
+    }
+    for (int i = 0; i < 10; i++) CL_pop(list);
+    CL_cache_stats(list, &stats);
+    test_assert(stats.hits == 1009);
+    test_assert(stats.misses == 11);
+    test_assert(stats.cached == 11);
+    test_assert(stats.high_water == 11);
+
+    // The cache never grows past its limit
+    CL_set_cache_limit(list, 4);
+    CL_cache_stats(list, &stats);
+    test_assert(stats.cached == 4 && stats.limit == 4);
+    for (int i = 0; i < 10; i++) CL_push(list, testdata[i]);
+    for (int i = 0; i < 10; i++) CL_remove(list, -1);
+    CL_cache_stats(list, &stats);
+    test_assert(stats.cached == 4);
+
+    // CL_trim gives all cached nodes back
+    CL_trim(list);
+    CL_cache_stats(list, &stats);
+    test_assert(stats.cached == 0);
+    CL_free(list);
+
+    // Tree nodes are cached the same way
+    list = CL_new_backend(CL_TREE);
+    for (int i = 0; i < 5; i++) CL_append(list, testdata[i]);
+    test_compare(CL_remove(list, 2), testdata[2]);
+    CL_insert(list, testdata[2], 2);
+    CL_cache_stats(list, &stats);
+    test_assert(stats.hits == 1 && stats.misses == 5);
+    for (int i = 0; i < 5; i++) test_compare(CL_nth(list, i), testdata[i]);
+    CL_free(list);
+
+    return 1;
+}
+
+/*
+ * Thread body for test_cl_magazines: build a list and hand it back
+ * to the caller, which frees it on another thread
+ */
+void *magazine_worker(void *arg) {
+    (void)arg;
+    CList list = CL_new();
+    CL_set_cache_limit(list, 0);
+    for (int i = 0; i < 1000; i++) CL_append(list, testdata[i % num_testdata]);
+    for (int i = 0; i < 500; i++) CL_pop(list);
+    return list;
+}
+
+/*
+ * Thread body for test_cl_magazines: only allocate, so the thread
+ * exits holding most of a magazine taken from the depot
+ */
+void *magazine_alloc_worker(void *arg) {
+    (void)arg;
+    CList list = CL_new();
+    CL_set_cache_limit(list, 0);
+    for (int i = 0; i < 20; i++) CL_push(list, testdata[i]);
+    return list;
+}
+
+/*
+ * Tests thread-local magazines, including freeing nodes on a
+ * different thread than the one that allocated them
+ *
+ * Returns: 1 if all tests pass, 0 otherwise
+ */
+
+int test_cl_magazines() {
+    pthread_t threads[4];
+    CList lists[4];
+
+    CL_set_magazines(true);
+    for (int round = 0; round < 3; round++) {
+        for (int t = 0; t < 4; t++) pthread_create(&threads[t], NULL, magazine_worker, NULL);
+        for (int t = 0; t < 4; t++) pthread_join(threads[t], (void **)&lists[t]);
+
+        for (int t = 0; t < 4; t++) {
+            test_assert(CL_length(lists[t]) == 500);
+            for (int i = 0; i < 500; i++)
+                test_compare(CL_nth(lists[t], i), testdata[(500 + i) % num_testdata]);
+            CL_free(lists[t]);
+        }
+    }
+
+    // Nodes freed above are handed out again on this thread
+    CList list = CL_new();
+    for (int i = 0; i < 3000; i++) CL_push(list, testdata[i % num_testdata]);
+    for (int i = 2999; i >= 0; i--) test_compare(CL_pop(list), testdata[i % num_testdata]);
+    CL_free(list);
+
+    // A thread that only allocates hands back the rest of its magazine
+    // when it exits; otherwise the leak checker reports it
+    pthread_create(&threads[0], NULL, magazine_alloc_worker, NULL);
+    pthread_join(threads[0], (void **)&list);
+    test_assert(CL_length(list) == 20);
+    CL_free(list);
+
+    CL_set_magazines(false);
+    CL_flush_magazines();
+    return 1;
+}
+
+// Allocator for test_cl_allocator that counts outstanding allocations
+struct counting_allocator {
+    int outstanding;
+    size_t bytes;
+};
+
+void *counting_alloc(void *ctx, size_t size) {
+    struct counting_allocator *a = ctx;
+    a->outstanding++;
+    a->bytes += size;
+    return malloc(size);
+}
+
+void counting_free(void *ctx, void *ptr, size_t size) {
+    struct counting_allocator *a = ctx;
+    a->outstanding--;
+    a->bytes -= size;
+    free(ptr);
+}
+
+// Bump allocator for test_cl_allocator that only frees in bulk
+struct bump_arena {
+    char buf[16384];
+    size_t used;
+};
+
+void *bump_alloc(void *ctx, size_t size) {
+    struct bump_arena *a = ctx;
+    size = (size + 15) & ~(size_t)15;
+    if (a->used + size > sizeof(a->buf)) return NULL;
+    void *ptr = a->buf + a->used;
+    a->used += size;
+    return ptr;
+}
+
+/*
+ * Tests the CL_new_with_allocator function
+ *
+ * Returns: 1 if all tests pass, 0 otherwise
+ */
+
+int test_cl_allocator() {
+    struct counting_allocator counter = {0, 0};
+    CList list = CL_new_with_allocator(counting_alloc, counting_free, &counter);
+
+    // The list itself comes from the allocator
+    test_assert(counter.outstanding == 1);
+
+    for (int i = 0; i < num_testdata; i++) CL_append(list, testdata[i]);
+    test_assert(counter.outstanding == 1 + num_testdata);
+
+    // Copies and split-off tails share the allocator
+    CList copy = CL_copy(list);
+    CList tail = CL_split(copy, 10);
+    test_assert(counter.outstanding == 3 + 2 * num_testdata);
+    CL_join(copy, tail);
+    test_assert(CL_length(copy) == num_testdata);
+    for (int i = 0; i < num_testdata; i++) test_compare(CL_nth(copy, i), testdata[i]);
+    CL_free(tail);
+    CL_free(copy);
+
+    // Moving nodes into a malloc'd list copies them instead
+    CList plain = CL_new();
+    CL_join(plain, list);
+    test_assert(CL_length(plain) == num_testdata);
+    CL_set_cache_limit(list, 0);
+    test_assert(counter.outstanding == 1);
+    CL_free(list);
+    CL_free(plain);
+    test_assert(counter.outstanding == 0);
+    test_assert(counter.bytes == 0);
+
+    // A bulk-freeing arena: CL_free releases nothing, resetting the arena does
+    struct bump_arena *arena = malloc(sizeof(struct bump_arena));
+    arena->used = 0;
+    list = CL_new_with_allocator(bump_alloc, NULL, arena);
+    for (int i = 0; i < 100; i++) CL_push(list, testdata[i % num_testdata]);
+    size_t used = arena->used;
+    for (int i = 0; i < 10; i++) {
+        // Churn is served from the list's cache, not the arena
+        CL_pop(list);
+        CL_push(list, testdata[i]);
+    }
+    test_assert(arena->used == used);
+    CL_free(list);
+    test_assert(arena->used == used);
+
+    // The feed is still released when the subscription ends
+    arena->used = 0;
+    list = CL_new_with_allocator(bump_alloc, NULL, arena);
+    CListSubscription subscription = CL_subscribe(list);
+    CL_push(list, testdata[0]);
+    CL_free(list);
+    CL_unsubscribe(subscription);
+    free(arena);
+
+    return 1;
+}
+
+/*
+ * Tests short CL_LINKED lists, which keep their first elements inside
+ * the list itself, across the switch to and from nodes
+ *
+ * Returns: 1 if all tests pass, 0 otherwise
+ */
+
+int test_cl_small_lists() {
+    struct counting_allocator counter = {0, 0};
+    CList list = CL_new_with_allocator(counting_alloc, counting_free, &counter);
+
+    // A short list needs a single allocation
+    for (int i = 0; i < 5; i++) CL_insert(list, testdata[i], i);
+    CL_reverse(list);
+    CL_insert_sorted(list, testdata[5]);
+    test_assert(counter.outstanding == 1);
+    test_compare(CL_nth(list, 0), testdata[5]);
+    test_compare(CL_nth(list, -1), testdata[0]);
+    CL_free(list);
+    test_assert(counter.outstanding == 0);
+
+    // Compare against a deque while the length wanders across the
+    // inline capacity, mixing in the bulk operations
+    CList small = CL_new();
+    CList other = CL_new();
+    CList deque = CL_new_backend(CL_DEQUE);
+    CList deque_other = CL_new_backend(CL_DEQUE);
+    srand(33);
+    for (int i = 0; i < 3000; i++) {
+        const char *element = testdata[rand() % num_testdata];
+        int len = CL_length(small);
+        int pos = rand() % (len + 1);
+        switch (rand() % 8) {
+            case 0:
+            case 1:
+                CL_insert(small, element, pos);
+                CL_insert(deque, element, pos);
+                break;
+            case 2:
+            case 3:
+                test_assert(CL_remove(small, pos) == CL_remove(deque, pos));
+                break;
+            case 4:
+                CL_append(small, element);
+                CL_append(deque, element);
+                break;
+            case 5: {
+                CList tail = CL_split(small, pos);
+                CList deque_tail = CL_split(deque, pos);
+                CL_join(other, tail);
+                CL_join(deque_other, deque_tail);
+                CL_free(tail);
+                CL_free(deque_tail);
+                break;
+            }
+            case 6: {
+                int other_len = CL_length(other);
+                int start = rand() % (other_len + 1);
+                int end = start + rand() % (other_len - start + 1);
+                test_assert(CL_splice(small, pos, other, start, end));
+                test_assert(CL_splice(deque, pos, deque_other, start, end));
+                break;
+            }
+            case 7:
+                CL_reverse(small);
+                CL_reverse(deque);
+                if (CL_length(small) > 12) {
+                    CL_free(other);
+                    other = CL_split(small, 4);
+                    CL_free(deque_other);
+                    deque_other = CL_split(deque, 4);
+                }
+                break;
+        }
+        test_assert(CL_length(small) == CL_length(deque));
+        test_assert(CL_length(other) == CL_length(deque_other));
+        for (int j = 0; j < CL_length(small); j++) test_assert(CL_nth(small, j) == CL_nth(deque, j));
+    }
+    for (int j = 0; j < CL_length(other); j++) test_assert(CL_nth(other, j) == CL_nth(deque_other, j));
+
+    CList copy = CL_copy(small);
+    for (int j = 0; j < CL_length(small); j++) test_assert(CL_nth(copy, j) == CL_nth(deque, j));
+
+    CL_free(copy);
+    CL_free(small);
+    CL_free(other);
+    CL_free(deque);
+    CL_free(deque_other);
+    return 1;
+}
+
 /*
  * A demonstration of how to use a CList, which also doubles as a
  * test case.
@@ -527,6 +2867,60 @@ int main() {
     passed += test_cl_foreach();
     num_tests++;
     passed += test_cl_free();
+    num_tests++;
+    passed += test_cl_tree();
+    num_tests++;
+    passed += test_cl_deque();
+    num_tests++;
+    passed += test_cl_priority();
+    num_tests++;
+    passed += test_cl_compact();
+    num_tests++;
+    passed += test_cl_owning();
+    num_tests++;
+    passed += test_cl_keyed();
+    num_tests++;
+    passed += test_cl_inline();
+    num_tests++;
+    passed += test_cl_find();
+    num_tests++;
+    passed += test_cl_prefetch();
+    num_tests++;
+    passed += test_cl_compact_nodes();
+    num_tests++;
+    passed += test_cl_freeze();
+    num_tests++;
+    passed += test_cl_concurrent();
+    num_tests++;
+    passed += test_cl_sharded();
+    num_tests++;
+    passed += test_cl_write();
+    num_tests++;
+    passed += test_cl_durable();
+    num_tests++;
+    passed += test_cl_feed();
+    num_tests++;
+    passed += test_cl_dlinked();
+    num_tests++;
+    passed += test_cl_find_adaptive();
+    num_tests++;
+    passed += test_cl_insert_sorted_stream();
+    num_tests++;
+    passed += test_cl_filter();
+    num_tests++;
+    passed += test_cl_join();
+    num_tests++;
+    passed += test_cl_split();
+    num_tests++;
+    passed += test_cl_splice();
+    num_tests++;
+    passed += test_cl_cache();
+    num_tests++;
+    passed += test_cl_magazines();
+    num_tests++;
+    passed += test_cl_allocator();
+    num_tests++;
+    passed += test_cl_small_lists();
 
     num_tests++;
     passed += sample_clist_usage();
@@ -0,0 +1,388 @@
+/*
+ * clist_tree.c
+ *
+ * CL_TREE backend: the list is stored as an implicit-key treap. Each
+ * node records the size of its subtree, so the node at a given
+ * position is found by descending the tree, and every positional
+ * operation is a split and/or merge costing O(log n) expected time.
+ *
+ * Reversal is lazy: a node's rev flag means both of its children
+ * should be swapped, and the flag is pushed down to the children the
+ * next time a mutator passes through the node.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "clist_impl.h"
+
+/*
+ * Return the number of nodes in the subtree rooted at t
+ */
+static inline int _CL_tsize(struct _cl_tnode *t) {
+    return t ? t->size : 0;
+}
+
+/*
+ * Recompute t->size from its children
+ */
+static inline void _CL_tupdate(struct _cl_tnode *t) {
+    t->size = 1 + _CL_tsize(t->left) + _CL_tsize(t->right);
+}
+
+/*
+ * Apply a pending reversal at t to its children
+ */
+static inline void _CL_tpush(struct _cl_tnode *t) {
+    if (t->rev) {
+        struct _cl_tnode *temp = t->left;
+        t->left = t->right;
+        t->right = temp;
+        if (t->left) t->left->rev = !t->left->rev;
+        if (t->right) t->right->rev = !t->right->rev;
+        t->rev = false;
+    }
+}
+
+/*
+ * Create a new tree node holding element, with a fresh random
+ * priority drawn from the list's xorshift state
+ *
+ * Returns: The new node
+ */
+static struct _cl_tnode *_CL_new_tnode(CList list, CListElementType element) {
+    struct _cl_tnode *new = (struct _cl_tnode *)_CL_node_alloc(list);
+
+    unsigned x = list->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    list->seed = x;
+
+    new->element = element;
+    new->left = NULL;
+    new->right = NULL;
+    new->priority = x;
+    new->size = 1;
+    new->rev = false;
+
+    return new;
+}
+
+/*
+ * Split t into two treaps: *l receives the first pos nodes, *r the
+ * rest.
+ */
+static void _CL_tsplit(struct _cl_tnode *t, int pos, struct _cl_tnode **l, struct _cl_tnode **r) {
+    if (t == NULL) {
+        *l = *r = NULL;
+        return;
+    }
+    _CL_tpush(t);
+    if (_CL_tsize(t->left) < pos) {
+        _CL_tsplit(t->right, pos - _CL_tsize(t->left) - 1, &t->right, r);
+        *l = t;
+    } else {
+        _CL_tsplit(t->left, pos, l, &t->left);
+        *r = t;
+    }
+    _CL_tupdate(t);
+}
+
+/*
+ * Concatenate two treaps, every node of l ending up before every node
+ * of r.
+ *
+ * Returns: The root of the merged treap
+ */
+static struct _cl_tnode *_CL_tmerge(struct _cl_tnode *l, struct _cl_tnode *r) {
+    if (l == NULL) return r;
+    if (r == NULL) return l;
+    if (l->priority >= r->priority) {
+        _CL_tpush(l);
+        l->right = _CL_tmerge(l->right, r);
+        _CL_tupdate(l);
+        return l;
+    } else {
+        _CL_tpush(r);
+        r->left = _CL_tmerge(l, r->left);
+        _CL_tupdate(r);
+        return r;
+    }
+}
+
+/*
+ * Free every node of the subtree rooted at t, which belongs to list
+ */
+static void _CL_tfree(CList list, struct _cl_tnode *t) {
+    while (t) {
+        // Recurse on one side and loop on the other to bound the stack
+        _CL_tfree(list, t->left);
+        struct _cl_tnode *temp = t;
+        t = t->right;
+        _CL_node_release(list, temp);
+    }
+}
+
+/*
+ * Return a structural copy of the subtree rooted at t, including any
+ * pending reversal flags, with nodes allocated from list
+ */
+static struct _cl_tnode *_CL_tclone(CList list, struct _cl_tnode *t) {
+    if (t == NULL) return NULL;
+    struct _cl_tnode *new = (struct _cl_tnode *)_CL_node_alloc(list);
+    *new = *t;
+    new->left = _CL_tclone(list, t->left);
+    new->right = _CL_tclone(list, t->right);
+    return new;
+}
+
+/*
+ * In-order walk of the subtree rooted at t. flip is true when an odd
+ * number of ancestors carry a pending reversal, in which case the
+ * subtree is visited right to left. Pending flags are honoured rather
+ * than pushed, so the walk does not modify the tree.
+ *
+ * Returns: The position following the last element visited
+ */
+static int _CL_twalk(struct _cl_tnode *t, bool flip, int pos, CL_foreach_callback callback,
+                     void *cb_data) {
+    while (t) {
+        flip ^= t->rev;
+        struct _cl_tnode *first = flip ? t->right : t->left;
+        struct _cl_tnode *second = flip ? t->left : t->right;
+        pos = _CL_twalk(first, flip, pos, callback, cb_data);
+        callback(pos++, t->element, cb_data);
+        t = second;
+    }
+    return pos;
+}
+
+/*
+ * Replace every element in the subtree at t with fn's result, ignoring
+ * the order of the elements
+ */
+static void _CL_tmap(struct _cl_tnode *t, _CL_map_fn fn, void *data) {
+    while (t) {
+        _CL_tmap(t->left, fn, data);
+        t->element = fn(t->element, data);
+        t = t->right;
+    }
+}
+
+/*
+ * Find the first element equal to key in the subtree at t, whose
+ * first position is pos
+ *
+ * Returns: The position of the element, or -1
+ */
+static int _CL_tfind(struct _cl_tnode *t, bool flip, int pos, CListElementType key) {
+    while (t) {
+        flip ^= t->rev;
+        struct _cl_tnode *first = flip ? t->right : t->left;
+        struct _cl_tnode *second = flip ? t->left : t->right;
+        const int found = _CL_tfind(first, flip, pos, key);
+        if (found >= 0) return found;
+        pos += _CL_tsize(first);
+        if (strcmp(t->element, key) == 0) return pos;
+        pos++;
+        t = second;
+    }
+    return -1;
+}
+
+/*
+ * Count the elements equal to key in the subtree at t
+ */
+static int _CL_tcount(struct _cl_tnode *t, CListElementType key) {
+    int matches = 0;
+    while (t) {
+        matches += _CL_tcount(t->left, key);
+        if (strcmp(t->element, key) == 0) matches++;
+        t = t->right;
+    }
+    return matches;
+}
+
+/*
+ * Copy the subtree at t into consecutive nodes starting at *slot, in
+ * order, releasing the originals
+ *
+ * Returns: The root of the copy
+ */
+static struct _cl_tnode *_CL_tcompact(CList list, struct _cl_tnode *t, struct _cl_tnode **slot) {
+    struct _cl_tnode *root = NULL;
+    struct _cl_tnode **link = &root;
+    while (t) {
+        struct _cl_tnode *left = _CL_tcompact(list, t->left, slot);
+        struct _cl_tnode *new = (*slot)++;
+        *new = *t;
+        new->left = left;
+        *link = new;
+        link = &new->right;
+
+        struct _cl_tnode *right = t->right;
+        _CL_node_release(list, t);
+        t = right;
+    }
+    return root;
+}
+
+static void _CL_tree_destroy(CList list) {
+    _CL_tfree(list, list->root);
+    list->root = NULL;
+}
+
+static int _CL_tree_count(CList list) {
+    // The root's size is maintained independently of list->length
+    return _CL_tsize(list->root);
+}
+
+static CListElementType _CL_tree_nth(CList list, int pos) {
+    struct _cl_tnode *t = list->root;
+    bool flip = false;
+    while (t) {
+        flip ^= t->rev;
+        struct _cl_tnode *first = flip ? t->right : t->left;
+        struct _cl_tnode *second = flip ? t->left : t->right;
+        const int first_size = _CL_tsize(first);
+        if (pos < first_size) {
+            t = first;
+        } else if (pos == first_size) {
+            return t->element;
+        } else {
+            pos -= first_size + 1;
+            t = second;
+        }
+    }
+    assert(!"position out of range");
+    return INVALID_RETURN;
+}
+
+static void _CL_tree_insert(CList list, CListElementType element, int pos) {
+    struct _cl_tnode *l, *r;
+    _CL_tsplit(list->root, pos, &l, &r);
+    list->root = _CL_tmerge(_CL_tmerge(l, _CL_new_tnode(list, element)), r);
+    list->length++;
+}
+
+static CListElementType _CL_tree_remove(CList list, int pos) {
+    struct _cl_tnode *l, *mid, *r;
+    _CL_tsplit(list->root, pos, &l, &r);
+    _CL_tsplit(r, 1, &mid, &r);
+    list->root = _CL_tmerge(l, r);
+
+    assert(mid && mid->size == 1);
+    CListElementType to_return = mid->element;
+    _CL_node_recycle(list, mid);
+    list->length--;
+    return to_return;
+}
+
+static CList _CL_tree_copy(CList list) {
+    CList list_copy = _CL_new_like(list);
+    list_copy->root = _CL_tclone(list_copy, list->root);
+    list_copy->length = list->length;
+    return list_copy;
+}
+
+static int _CL_tree_insert_sorted(CList list, CListElementType element) {
+    // Descend to find the number of elements that compare less than
+    // element, pushing reversals so left/right are in list order
+    int index = 0;
+    struct _cl_tnode *t = list->root;
+    while (t) {
+        _CL_tpush(t);
+        if (strcmp(t->element, element) < 0) {
+            index += _CL_tsize(t->left) + 1;
+            t = t->right;
+        } else {
+            t = t->left;
+        }
+    }
+
+    _CL_tree_insert(list, element, index);
+    return index;
+}
+
+static void _CL_tree_join(CList list1, CList list2) {
+    list1->root = _CL_tmerge(list1->root, list2->root);
+    list1->length += list2->length;
+    list2->root = NULL;
+    list2->length = 0;
+}
+
+static CList _CL_tree_split(CList list, int pos) {
+    CList tail = _CL_new_like(list);
+    _CL_tsplit(list->root, pos, &list->root, &tail->root);
+    tail->length = list->length - pos;
+    list->length = pos;
+    return tail;
+}
+
+static void _CL_tree_splice(CList dest, int dest_pos, CList src, int start, int end) {
+    struct _cl_tnode *before, *moved, *after;
+    _CL_tsplit(src->root, start, &before, &after);
+    _CL_tsplit(after, end - start, &moved, &after);
+    src->root = _CL_tmerge(before, after);
+
+    _CL_tsplit(dest->root, dest_pos, &before, &after);
+    dest->root = _CL_tmerge(_CL_tmerge(before, moved), after);
+
+    src->length -= end - start;
+    dest->length += end - start;
+}
+
+static void _CL_tree_reverse(CList list) {
+    if (list->root) list->root->rev = !list->root->rev;
+}
+
+static void _CL_tree_foreach(CList list, CL_foreach_callback callback, void *cb_data) {
+    _CL_twalk(list->root, false, 0, callback, cb_data);
+}
+
+static void _CL_tree_map(CList list, _CL_map_fn fn, void *data) {
+    _CL_tmap(list->root, fn, data);
+}
+
+static int _CL_tree_find(CList list, CListElementType key, bool count) {
+    return count ? _CL_tcount(list->root, key) : _CL_tfind(list->root, false, 0, key);
+}
+
+static void _CL_tree_compact(CList list) {
+    if (list->root == NULL) return;
+
+    // Nodes are laid out in order, ignoring pending reversals
+    struct _cl_block *block = _CL_block_new(list, list->length);
+    struct _cl_tnode *slot = (struct _cl_tnode *)block->base;
+    list->root = _CL_tcompact(list, list->root, &slot);
+    _CL_block_install(list, block);
+}
+
+static void _CL_tree_move(CList list, int from, int to) {
+    // Split the node out and merge it back in at to, in O(log n)
+    struct _cl_tnode *l, *mid, *r;
+    _CL_tsplit(list->root, from, &l, &r);
+    _CL_tsplit(r, 1, &mid, &r);
+    _CL_tsplit(_CL_tmerge(l, r), to, &l, &r);
+    list->root = _CL_tmerge(_CL_tmerge(l, mid), r);
+}
+
+const struct _cl_ops _CL_tree_ops = {
+    .destroy = _CL_tree_destroy,
+    .count = _CL_tree_count,
+    .nth = _CL_tree_nth,
+    .insert = _CL_tree_insert,
+    .remove = _CL_tree_remove,
+    .copy = _CL_tree_copy,
+    .insert_sorted = _CL_tree_insert_sorted,
+    .join = _CL_tree_join,
+    .split = _CL_tree_split,
+    .splice = _CL_tree_splice,
+    .reverse = _CL_tree_reverse,
+    .foreach = _CL_tree_foreach,
+    .map = _CL_tree_map,
+    .find = _CL_tree_find,
+    .compact = _CL_tree_compact,
+    .move = _CL_tree_move,
+};
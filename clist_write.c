@@ -0,0 +1,217 @@
+/*
+ * clist_write.c
+ *
+ * Serialization of lists: CL_write sends the formatted elements to a
+ * file descriptor, and CL_to_string formats them into a caller's
+ * buffer. Both format each element by hand instead of through stdio.
+ *
+ * CL_write copies the short parts of each entry (the position, the
+ * separators and short strings) into one large buffer, but passes
+ * long strings to the kernel where they are, so its output is a list
+ * of iovecs flushed with one writev per CL_WRITE_IOV pieces or
+ * CL_WRITE_BUF buffered bytes.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "clist_impl.h"
+
+// Bytes CL_write buffers before flushing
+#define CL_WRITE_BUF ((size_t)1 << 18)
+
+// Pieces CL_write hands to one writev; at most IOV_MAX
+#define CL_WRITE_IOV 256
+
+// Strings at least this long are written from where they are, not copied
+#define CL_WRITE_DIRECT 256
+
+// Longest entry prefix, "  [-2147483648]: "
+#define CL_PREFIX_MAX 20
+
+/*
+ * Format the part of an entry that comes before the element
+ *
+ * Returns: The number of bytes written to out, at most CL_PREFIX_MAX
+ */
+static size_t _CL_format_prefix(char *out, int pos, CListFormat format) {
+    if (format == CL_FORMAT_LINES) return 0;
+
+    // Positions are never negative; digits are produced backwards
+    char digits[12];
+    int n = 0;
+    unsigned value = (unsigned)pos;
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+
+    char *p = out;
+    *p++ = ' ';
+    *p++ = ' ';
+    *p++ = '[';
+    while (n) *p++ = digits[--n];
+    *p++ = ']';
+    *p++ = ':';
+    *p++ = ' ';
+    return p - out;
+}
+
+// State of a CL_write in progress. Bytes of buf from mark to used are
+// not yet covered by an iovec.
+struct _cl_writer {
+    int fd;
+    CListFormat format;
+    bool failed;
+    char *buf;
+    size_t used;
+    size_t mark;
+    struct iovec iov[CL_WRITE_IOV];
+    int niov;
+};
+
+/*
+ * End the run of buffered bytes not yet in an iovec
+ */
+static void _CL_writer_seal(struct _cl_writer *w) {
+    if (w->used > w->mark) {
+        w->iov[w->niov].iov_base = w->buf + w->mark;
+        w->iov[w->niov].iov_len = w->used - w->mark;
+        w->niov++;
+        w->mark = w->used;
+    }
+}
+
+/*
+ * Write out everything gathered so far, retrying partial writes
+ */
+static void _CL_writer_flush(struct _cl_writer *w) {
+    _CL_writer_seal(w);
+
+    struct iovec *iov = w->iov;
+    int niov = w->niov;
+    while (niov && !w->failed) {
+        ssize_t n = writev(w->fd, iov, niov);
+        // Every iovec is non-empty, so writing nothing is a failure too
+        if (n <= 0) {
+            if (n == 0 || errno != EINTR) w->failed = true;
+            continue;
+        }
+        while (niov && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            niov--;
+        }
+        if (niov) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+
+    w->used = w->mark = 0;
+    w->niov = 0;
+}
+
+/*
+ * CL_foreach callback that adds one entry to a CL_write
+ */
+static void _CL_write_element(int pos, CListElementType element, void *cb_data) {
+    struct _cl_writer *w = cb_data;
+    if (w->failed) return;
+
+    const size_t len = strlen(element);
+    const bool direct = len >= CL_WRITE_DIRECT;
+    // Room for the prefix, the newline and, unless it goes direct, the
+    // string; and for the iovecs that sealing and a direct string take
+    const size_t need = CL_PREFIX_MAX + 1 + (direct ? 0 : len);
+    if (w->used + need > CL_WRITE_BUF || w->niov + 3 > CL_WRITE_IOV) _CL_writer_flush(w);
+
+    w->used += _CL_format_prefix(w->buf + w->used, pos, w->format);
+    if (direct) {
+        _CL_writer_seal(w);
+        w->iov[w->niov].iov_base = (void *)element;
+        w->iov[w->niov].iov_len = len;
+        w->niov++;
+    } else {
+        memcpy(w->buf + w->used, element, len);
+        w->used += len;
+    }
+    w->buf[w->used++] = '\n';
+}
+
+// Documented in .h file
+bool CL_write(CList list, int fd, CListFormat format) {
+    assert(list);
+
+    struct _cl_writer *w = (struct _cl_writer *)malloc(sizeof(*w));
+    assert(w);
+    w->fd = fd;
+    w->format = format;
+    w->failed = false;
+    w->buf = (char *)malloc(CL_WRITE_BUF);
+    assert(w->buf);
+    w->used = w->mark = 0;
+    w->niov = 0;
+
+    list->ops->foreach(list, _CL_write_element, w);
+    _CL_writer_flush(w);
+
+    const bool ok = !w->failed;
+    free(w->buf);
+    free(w);
+    return ok;
+}
+
+// State of a CL_to_string in progress
+struct _cl_stringer {
+    char *buf;
+    size_t size;    // capacity of buf, including the terminator
+    size_t length;  // length of the whole output so far
+    CListFormat format;
+};
+
+/*
+ * Append n bytes to a CL_to_string, storing as many as fit
+ */
+static void _CL_stringer_put(struct _cl_stringer *s, const char *bytes, size_t n) {
+    if (s->length + 1 < s->size) {
+        const size_t room = s->size - 1 - s->length;
+        memcpy(s->buf + s->length, bytes, n < room ? n : room);
+    }
+    s->length += n;
+}
+
+/*
+ * CL_foreach callback that adds one entry to a CL_to_string
+ */
+static void _CL_string_element(int pos, CListElementType element, void *cb_data) {
+    struct _cl_stringer *s = cb_data;
+    char prefix[CL_PREFIX_MAX];
+    _CL_stringer_put(s, prefix, _CL_format_prefix(prefix, pos, s->format));
+    _CL_stringer_put(s, element, strlen(element));
+    _CL_stringer_put(s, "\n", 1);
+}
+
+// Documented in .h file
+size_t CL_to_string(CList list, char *buf, size_t size, CListFormat format) {
+    assert(list);
+    assert(buf || size == 0);
+
+    struct _cl_stringer s = {buf, size, 0, format};
+    list->ops->foreach(list, _CL_string_element, &s);
+    if (size) buf[s.length < size ? s.length : size - 1] = '\0';
+    return s.length;
+}
+
+// Documented in .h file
+void CL_print(CList list) {
+    assert(list);
+    // Anything the caller printed first must come out first
+    fflush(stdout);
+    CL_write(list, fileno(stdout), CL_FORMAT_INDEXED);
+}